@@ -0,0 +1,188 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+//
+// End to end benchmarks of the client against the in-process mock server.
+//
+//   macro_bench [threads] [seconds] [latency_us]
+//
+// One line per api, key=value pairs separated by spaces, latencies in
+// microseconds per call:
+//
+//   api=getDocument threads=8 ops=41000 ops_per_sec=20500 p50_us=310 p99_us=900 max_us=4100
+//
+// bulk sends 1000 documents per call and fullScan reads 10000 documents
+// by pages of 1000, their docs_per_sec is printed as well.
+//
+#include "ElasticSearch.h"
+#include "Metrics.h"
+#include "MockServer.h"
+#include <vector>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+using namespace cppes;
+
+static const int BULK_DOCS = 1000;
+static const int SCAN_DOCS = 10000;
+static const int SCAN_PAGE = 1000;
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static Json::Value sourceDoc(long i)
+{
+    Json::Value doc;
+    doc["user"] = "kimchy";
+    doc["sequence"] = (Json::Int) i;
+    doc["post_date"] = "2018-08-02T12:34:56";
+    doc["message"] = "trying out Elasticsearch, the benchmark of the client against the mock server";
+    return doc;
+}
+
+struct Worker
+{
+    ElasticSearch* es;
+    const std::string* bulk;
+    int id;
+    double deadline;
+    long ops;
+    LatencyHistogram* latency;
+};
+
+typedef void (*Operation)(Worker& worker, long n);
+
+static void indexOp(Worker& worker, long n)
+{
+    std::ostringstream id;
+    id << worker.id << "-" << n;
+    worker.es->index("bench", "doc", id.str(), sourceDoc(n));
+}
+
+static void getOp(Worker& worker, long n)
+{
+    Json::Value doc;
+    worker.es->getDocument("bench", "doc", "1", doc);
+}
+
+static void bulkOp(Worker& worker, long n)
+{
+    std::vector<BulkItemError> errors;
+    worker.es->bulk(worker.bulk->c_str(), errors);
+}
+
+static void scanOp(Worker& worker, long n)
+{
+    Json::Value hits(Json::arrayValue);
+    worker.es->fullScan("scan", "doc", "{\"query\":{\"match_all\":{}}}", hits, SCAN_PAGE);
+}
+
+struct Job
+{
+    Worker* worker;
+    Operation operation;
+};
+
+static void* loop(void* arg)
+{
+    Job* job = (Job*) arg;
+    Worker& worker = *job->worker;
+
+    while (now() < worker.deadline)
+    {
+        double start = now();
+        job->operation(worker, worker.ops);
+        worker.latency->record((uint64_t) ((now() - start) * 1000000.0));
+        ++worker.ops;
+    }
+    return NULL;
+}
+
+static void run(const char* api, Operation operation, ElasticSearch& es, const std::string& bulk,
+                int threads, double seconds, int docsPerOp)
+{
+    std::vector<pthread_t> tids(threads);
+    std::vector<Worker> workers(threads);
+    std::vector<Job> jobs(threads);
+    LatencyHistogram latency;
+    double start = now();
+
+    for (int i = 0; i < threads; ++i)
+    {
+        Worker& worker = workers[i];
+        worker.es = &es;
+        worker.bulk = &bulk;
+        worker.id = i;
+        worker.deadline = start + seconds;
+        worker.ops = 0;
+        worker.latency = &latency;
+
+        jobs[i].worker = &worker;
+        jobs[i].operation = operation;
+        pthread_create(&tids[i], NULL, loop, &jobs[i]);
+    }
+
+    long ops = 0;
+    for (int i = 0; i < threads; ++i)
+    {
+        pthread_join(tids[i], NULL);
+        ops += workers[i].ops;
+    }
+    double elapsed = now() - start;
+
+    printf("api=%s threads=%d ops=%ld ops_per_sec=%.0f p50_us=%llu p99_us=%llu max_us=%llu",
+           api, threads, ops, ops / elapsed,
+           (unsigned long long) latency.percentile(50),
+           (unsigned long long) latency.percentile(99),
+           (unsigned long long) latency.max());
+    if (docsPerOp > 1)
+        printf(" docs_per_sec=%.0f", (double) ops * docsPerOp / elapsed);
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+    unsigned int latency = argc > 3 ? atoi(argv[3]) : 0;
+
+    mock::MockServer server;
+    if (!server.start())
+    {
+        fprintf(stderr, "cannot start mock server\n");
+        return 1;
+    }
+    server.setLatency(latency);
+    server.setSyntheticCount(SCAN_DOCS);
+
+    BulkBuilder builder;
+    for (int i = 0; i < BULK_DOCS; ++i)
+    {
+        std::ostringstream id;
+        id << "bulk-" << i;
+        builder.index("bulk", "doc", id.str(), sourceDoc(i));
+    }
+    std::string bulk = builder.str();
+
+    ElasticSearch es(server.url());
+    run("index", indexOp, es, bulk, threads, seconds, 1);
+    run("getDocument", getOp, es, bulk, threads, seconds, 1);
+    run("bulk", bulkOp, es, bulk, threads, seconds, BULK_DOCS);
+    run("fullScan", scanOp, es, bulk, threads, seconds, SCAN_DOCS);
+
+    server.stop();
+    return 0;
+}
@@ -0,0 +1,349 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+//
+// Microbenchmarks of the client hot paths, no network.
+//
+//   micro_bench [seconds_per_case]
+//
+// One line per case, key=value pairs separated by spaces:
+//
+//   bench=json_parse case=search_100_hits ops=1234 ns_per_op=810000 mb_per_sec=120.5
+//
+// mb_per_sec is only printed when a case has a byte size.
+//
+#include "ElasticSearch.h"
+#include "Exception.h"
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+using namespace cppes;
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/// Something a case computes, so the compiler cannot drop the work.
+static volatile size_t s_sink = 0;
+
+/// One benchmark case, run() does one operation.
+class Case
+{
+public:
+    Case(const char* bench, const std::string& name, size_t bytes = 0)
+    : _bench(bench)
+    , _name(name)
+    , _bytes(bytes)
+    {
+    }
+
+    virtual ~Case() { }
+    virtual void run() = 0;
+
+    /// Repeat run() for about seconds and print the result line.
+    void measure(double seconds)
+    {
+        // warm up, and size the batches so now() is not measured
+        long batch = 1;
+        double start = now();
+        while (now() - start < 0.05)
+        {
+            for (long i = 0; i < batch; ++i)
+                run();
+            batch *= 2;
+        }
+
+        long ops = 0;
+        start = now();
+        double elapsed = 0;
+        do
+        {
+            for (long i = 0; i < batch; ++i)
+                run();
+            ops += batch;
+            elapsed = now() - start;
+        } while (elapsed < seconds);
+
+        printf("bench=%s case=%s ops=%ld ns_per_op=%.0f", _bench, _name.c_str(), ops, elapsed * 1e9 / ops);
+        if (_bytes > 0)
+            printf(" mb_per_sec=%.1f", (double) _bytes * ops / elapsed / (1024 * 1024));
+        printf("\n");
+        fflush(stdout);
+    }
+
+private:
+    const char* _bench;
+    std::string _name;
+    size_t _bytes;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+/// _source of a log line like document, about 500 bytes.
+static Json::Value sourceDoc(int i)
+{
+    Json::Value doc;
+    doc["@timestamp"] = "2018-08-02T12:34:56.789Z";
+    doc["host"] = "web-01.beijing.example.com";
+    doc["user"] = "kimchy";
+    doc["sequence"] = i;
+    doc["latency_ms"] = 12.5 + i % 100;
+    doc["status"] = 200;
+    doc["message"] = "GET /api/v1/products?category=books&page=3 HTTP/1.1 \"Mozilla/5.0 (X11; Linux x86_64)\"";
+    doc["tags"].append("production");
+    doc["tags"].append("frontend");
+    doc["geo"]["country"] = "CN";
+    doc["geo"]["city"] = "beijing";
+    doc["geo"]["location"]["lat"] = 39.9042;
+    doc["geo"]["location"]["lon"] = 116.4074;
+    return doc;
+}
+
+/// Search response with hits hits, as sent by ES.
+static std::string searchResponse(int hits)
+{
+    Json::Value msg;
+    msg["took"] = 12;
+    msg["timed_out"] = false;
+    msg["_shards"]["total"] = 5;
+    msg["_shards"]["successful"] = 5;
+    msg["_shards"]["failed"] = 0;
+    msg["hits"]["total"] = 12345;
+    msg["hits"]["max_score"] = 1.0;
+
+    Json::Value& array = msg["hits"]["hits"];
+    array = Json::Value(Json::arrayValue);
+    for (int i = 0; i < hits; ++i)
+    {
+        std::ostringstream id;
+        id << "AWU" << 1000000 + i;
+
+        Json::Value hit;
+        hit["_index"] = "logs-2018.08.02";
+        hit["_type"] = "doc";
+        hit["_id"] = id.str();
+        hit["_score"] = 1.0;
+        hit["_source"] = sourceDoc(i);
+        array.append(hit);
+    }
+
+    return Json::FastWriter().write(msg);
+}
+
+/// Get response of one document.
+static std::string getResponse()
+{
+    Json::Value msg;
+    msg["_index"] = "logs-2018.08.02";
+    msg["_type"] = "doc";
+    msg["_id"] = "AWU1000000";
+    msg["_version"] = 1;
+    msg["found"] = true;
+    msg["_source"] = sourceDoc(0);
+    return Json::FastWriter().write(msg);
+}
+
+class ParseCase : public Case
+{
+public:
+    ParseCase(const std::string& name, const std::string& json)
+    : Case("json_parse", name, json.size())
+    , _json(json)
+    {
+    }
+
+    virtual void run()
+    {
+        Json::Value msg;
+        Json::Reader().parse(_json, msg);
+        s_sink += msg.size();
+    }
+
+private:
+    std::string _json;
+};
+
+class WriteCase : public Case
+{
+public:
+    WriteCase(const std::string& name, const std::string& json)
+    : Case("json_write", name, json.size())
+    , _msg()
+    {
+        Json::Reader().parse(json, _msg);
+    }
+
+    virtual void run()
+    {
+        s_sink += Json::FastWriter().write(_msg).size();
+    }
+
+private:
+    Json::Value _msg;
+};
+
+class BulkCase : public Case
+{
+public:
+    BulkCase(int docs)
+    : Case("bulk_str", name(docs))
+    , _bulk()
+    {
+        for (int i = 0; i < docs; ++i)
+        {
+            std::ostringstream id;
+            id << i;
+            _bulk.index("logs-2018.08.02", "doc", id.str(), sourceDoc(i));
+        }
+    }
+
+    virtual void run()
+    {
+        s_sink += _bulk.str().size();
+    }
+
+private:
+    static std::string name(int docs)
+    {
+        std::ostringstream oss;
+        oss << "docs_" << docs;
+        return oss.str();
+    }
+
+    BulkBuilder _bulk;
+};
+
+class AppendHitsCase : public Case
+{
+public:
+    AppendHitsCase(const std::string& name, const std::string& json)
+    : Case("append_hits", name)
+    , _msg()
+    {
+        Json::Reader().parse(json, _msg);
+    }
+
+    virtual void run()
+    {
+        Json::Value array(Json::arrayValue);
+        ElasticSearch::appendHitsToArray(_msg, array);
+        s_sink += array.size();
+    }
+
+private:
+    Json::Value _msg;
+};
+
+class ExceptionCase : public Case
+{
+public:
+    explicit ExceptionCase(bool trace)
+    : Case("exception", trace ? "throw_stack_trace" : "throw_catch")
+    , _trace(trace)
+    {
+    }
+
+    virtual void run()
+    {
+        try
+        {
+            EXCEPTION("Result corrupted, no member \"hits\".");
+        }
+        catch (Exception& e)
+        {
+            s_sink += _trace ? strlen(e.stackTrace()) : strlen(e.what());
+        }
+    }
+
+private:
+    bool _trace;
+};
+
+/// The same bool query, from a reused QueryBuilder or through a Json::Value.
+class QueryCase : public Case
+{
+public:
+    explicit QueryCase(bool builder)
+    : Case("query_build", builder ? "query_builder" : "json_value")
+    , _builder(builder)
+    , _query()
+    , _title("quick \"brown\" fox")
+    {
+    }
+
+    virtual void run()
+    {
+        if (_builder)
+        {
+            _query.query(boolQuery()
+                             .must(matchQuery("title", _title))
+                             .filter(termQuery("status", "published"))
+                             .filter(rangeQuery("age").gte(18).lt(65)))
+                  .size(20)
+                  .sort("date", false);
+            s_sink += _query.str().size();
+            return;
+        }
+
+        Json::Value query;
+        Json::Value& clauses = query["query"]["bool"];
+        clauses["must"][0u]["match"]["title"] = _title;
+        clauses["filter"][0u]["term"]["status"] = "published";
+        clauses["filter"][1u]["range"]["age"]["gte"] = 18;
+        clauses["filter"][1u]["range"]["age"]["lt"] = 65;
+        query["size"] = 20;
+        query["sort"][0u]["date"]["order"] = "desc";
+        s_sink += Json::FastWriter().write(query).size();
+    }
+
+private:
+    bool _builder;
+    QueryBuilder _query;
+    std::string _title;
+};
+
+int main(int argc, char* argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+
+    std::string search10 = searchResponse(10);
+    std::string search100 = searchResponse(100);
+    std::string search1000 = searchResponse(1000);
+    std::string get = getResponse();
+
+    ParseCase("get_1_doc", get).measure(seconds);
+    ParseCase("search_10_hits", search10).measure(seconds);
+    ParseCase("search_100_hits", search100).measure(seconds);
+    ParseCase("search_1000_hits", search1000).measure(seconds);
+
+    WriteCase("get_1_doc", get).measure(seconds);
+    WriteCase("search_100_hits", search100).measure(seconds);
+
+    BulkCase(1000).measure(seconds);
+    BulkCase(10000).measure(seconds);
+    BulkCase(100000).measure(seconds);
+
+    AppendHitsCase("search_100_hits", search100).measure(seconds);
+    AppendHitsCase("search_1000_hits", search1000).measure(seconds);
+
+    ExceptionCase(false).measure(seconds);
+    ExceptionCase(true).measure(seconds);
+
+    QueryCase(true).measure(seconds);
+    QueryCase(false).measure(seconds);
+
+    return 0;
+}
@@ -0,0 +1,161 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+//
+// Contention benchmark of the curl handle pool.
+//
+//   pool_bench [max_threads] [seconds]
+//
+// (1) checkout/check-in of HandlePool against a single mutex-guarded
+//     vector, from 1..max_threads threads;
+// (2) ElasticSearch::getDocument from 1..max_threads threads sharing one
+//     client against the in-process mock server.
+//
+#include "ElasticSearch.h"
+#include "HandlePool.h"
+#include "Mutex.h"
+#include "MockServer.h"
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+using namespace cppes;
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/// The pool shape HttpClient used before HandlePool.
+class MutexPool
+{
+public:
+    void* acquire()
+    {
+        MutexLockGuard lock(_mutex);
+        if (_handles.empty())
+            return NULL;
+
+        void* handle = _handles.back();
+        _handles.pop_back();
+        return handle;
+    }
+
+    bool release(void* handle)
+    {
+        MutexLockGuard lock(_mutex);
+        _handles.push_back(handle);
+        return true;
+    }
+
+private:
+    std::vector<void*> _handles;
+    MutexLock _mutex;
+};
+
+struct Worker
+{
+    void* target;
+    double deadline;
+    long ops;
+};
+
+template <class Pool>
+static void* poolLoop(void* arg)
+{
+    Worker* worker = (Worker*) arg;
+    Pool* pool = (Pool*) worker->target;
+    static char handle;
+
+    while (now() < worker->deadline)
+    {
+        for (int i = 0; i < 1000; ++i)
+        {
+            void* h = pool->acquire();
+            pool->release(NULL == h ? &handle : h);
+        }
+        worker->ops += 1000;
+    }
+    return NULL;
+}
+
+static void* getLoop(void* arg)
+{
+    Worker* worker = (Worker*) arg;
+    ElasticSearch* es = (ElasticSearch*) worker->target;
+
+    while (now() < worker->deadline)
+    {
+        Json::Value doc;
+        es->getDocument("bench", "doc", "1", doc);
+        ++worker->ops;
+    }
+    return NULL;
+}
+
+static long run(void* (*loop)(void*), void* target, int threads, double seconds)
+{
+    std::vector<pthread_t> tids(threads);
+    std::vector<Worker> workers(threads);
+    double deadline = now() + seconds;
+
+    for (int i = 0; i < threads; ++i)
+    {
+        workers[i].target = target;
+        workers[i].deadline = deadline;
+        workers[i].ops = 0;
+        pthread_create(&tids[i], NULL, loop, &workers[i]);
+    }
+
+    long ops = 0;
+    for (int i = 0; i < threads; ++i)
+    {
+        pthread_join(tids[i], NULL);
+        ops += workers[i].ops;
+    }
+    return ops;
+}
+
+int main(int argc, char* argv[])
+{
+    int maxThreads = argc > 1 ? atoi(argv[1]) : 16;
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+
+    for (int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        HandlePool sharded(64, NULL);
+        MutexPool locked;
+
+        long ops = run(poolLoop<HandlePool>, &sharded, threads, seconds);
+        printf("pool=sharded threads=%d ops_per_sec=%.0f\n", threads, ops / seconds);
+
+        ops = run(poolLoop<MutexPool>, &locked, threads, seconds);
+        printf("pool=mutex threads=%d ops_per_sec=%.0f\n", threads, ops / seconds);
+    }
+
+    mock::MockServer server;
+    if (!server.start())
+    {
+        fprintf(stderr, "cannot start mock server\n");
+        return 1;
+    }
+
+    ElasticSearch es(server.url());
+    for (int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        long ops = run(getLoop, &es, threads, seconds);
+        printf("api=getDocument threads=%d ops_per_sec=%.0f\n", threads, ops / seconds);
+    }
+
+    server.stop();
+    return 0;
+}
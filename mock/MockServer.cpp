@@ -0,0 +1,1292 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "MockServer.h"
+#include "json/json.h"
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+namespace mock {
+
+struct Connection
+{
+    MockServer* server;
+    int fd;
+};
+
+MockServer::MockServer()
+: _listen_fd(-1)
+, _port(0)
+, _running(false)
+, _acceptor()
+, _connections()
+, _mutex()
+, _idle(_mutex)
+, _latency_us(0)
+, _synthetic(true)
+, _synthetic_count(10)
+, _requests(0)
+, _documents()
+, _indices()
+, _scrolls()
+, _synthetic_source()
+, _seq_no(0)
+, _next_id(0)
+, _store_mutex()
+{
+    setPayloadSize(0);
+}
+
+MockServer::~MockServer()
+{
+    stop();
+}
+
+std::string MockServer::url() const
+{
+    std::ostringstream oss;
+    oss << "http://127.0.0.1:" << _port;
+    return oss.str();
+}
+
+bool MockServer::start(int port)
+{
+    _listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (_listen_fd < 0)
+        return false;
+
+    int on = 1;
+    ::setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t len = sizeof (addr);
+    if (0 != ::bind(_listen_fd, (struct sockaddr*) &addr, sizeof (addr))
+        || 0 != ::listen(_listen_fd, 1024)
+        || 0 != ::getsockname(_listen_fd, (struct sockaddr*) &addr, &len))
+    {
+        ::close(_listen_fd);
+        _listen_fd = -1;
+        return false;
+    }
+
+    _port = ntohs(addr.sin_port);
+    _running = true;
+    if (0 != pthread_create(&_acceptor, NULL, acceptThread, this))
+    {
+        _running = false;
+        ::close(_listen_fd);
+        _listen_fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+void MockServer::stop()
+{
+    if (!_running)
+        return;
+
+    // wake up accept() and every blocking recv()
+    _running = false;
+    ::shutdown(_listen_fd, SHUT_RDWR);
+    pthread_join(_acceptor, NULL);
+    ::close(_listen_fd);
+    _listen_fd = -1;
+
+    cppes::MutexLockGuard lock(_mutex);
+    for (std::set<int>::iterator it = _connections.begin(); it != _connections.end(); ++it)
+        ::shutdown(*it, SHUT_RDWR);
+
+    while (!_connections.empty())
+        _idle.wait();
+}
+
+void* MockServer::acceptThread(void* arg)
+{
+    MockServer* server = (MockServer*) arg;
+    while (server->_running)
+    {
+        int fd = ::accept(server->_listen_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            if (EINTR == errno)
+                continue;
+            break;
+        }
+
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof (on));
+
+        {
+            cppes::MutexLockGuard lock(server->_mutex);
+            server->_connections.insert(fd);
+        }
+
+        Connection* connection = new Connection;
+        connection->server = server;
+        connection->fd = fd;
+
+        pthread_t thread;
+        if (0 != pthread_create(&thread, NULL, connectionThread, connection))
+        {
+            delete connection;
+            ::close(fd);
+
+            cppes::MutexLockGuard lock(server->_mutex);
+            server->_connections.erase(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    return NULL;
+}
+
+void* MockServer::connectionThread(void* arg)
+{
+    Connection* connection = (Connection*) arg;
+    MockServer* server = connection->server;
+    int fd = connection->fd;
+    delete connection;
+
+    server->serve(fd);
+
+    cppes::MutexLockGuard lock(server->_mutex);
+    ::close(fd);
+    server->_connections.erase(fd);
+    server->_idle.notifyAll();
+    return NULL;
+}
+
+static bool sendAll(int fd, const char* data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t n = ::send(fd, data, length, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            if (n < 0 && EINTR == errno)
+                continue;
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+/// Read more bytes into buffer, false when the peer has gone.
+static bool receive(int fd, std::string& buffer)
+{
+    char chunk[16384];
+    for (;;)
+    {
+        ssize_t n = ::recv(fd, chunk, sizeof (chunk), 0);
+        if (n > 0)
+        {
+            buffer.append(chunk, n);
+            return true;
+        }
+        if (n < 0 && EINTR == errno)
+            continue;
+        return false;
+    }
+}
+
+static const char* reasonPhrase(int status)
+{
+    switch (status)
+    {
+        case 100: return "Continue";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 409: return "Conflict";
+        case 500: return "Internal Server Error";
+        default: return "Unknown";
+    }
+}
+
+void MockServer::serve(int fd)
+{
+    std::string buffer;
+    while (_running)
+    {
+        size_t headerEnd;
+        while (std::string::npos == (headerEnd = buffer.find("\r\n\r\n")))
+        {
+            if (!receive(fd, buffer))
+                return;
+        }
+
+        Request request;
+        std::istringstream head(buffer.substr(0, headerEnd));
+        std::string line, version;
+        std::getline(head, line);
+        std::istringstream requestLine(line);
+        requestLine >> request.method >> request.path >> version;
+
+        size_t mark = request.path.find('?');
+        if (std::string::npos != mark)
+        {
+            request.query = request.path.substr(mark + 1);
+            request.path.erase(mark);
+        }
+
+        while (std::getline(head, line))
+        {
+            size_t colon = line.find(':');
+            if (std::string::npos == colon)
+                continue;
+
+            std::string name = line.substr(0, colon);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+            size_t first = line.find_first_not_of(" \t", colon + 1);
+            size_t last = line.find_last_not_of(" \t\r");
+            request.headers[name] = (std::string::npos == first) ? "" : line.substr(first, last - first + 1);
+        }
+        buffer.erase(0, headerEnd + 4);
+
+        if (request.headers.count("expect"))
+        {
+            const char* goOn = "HTTP/1.1 100 Continue\r\n\r\n";
+            if (!sendAll(fd, goOn, strlen(goOn)))
+                return;
+        }
+
+        if (request.headers.count("content-length"))
+        {
+            size_t length = strtoul(request.headers["content-length"].c_str(), NULL, 10);
+            while (buffer.size() < length)
+            {
+                if (!receive(fd, buffer))
+                    return;
+            }
+            request.body = buffer.substr(0, length);
+            buffer.erase(0, length);
+        }
+        else if ("chunked" == request.headers["transfer-encoding"])
+        {
+            for (;;)
+            {
+                size_t lineEnd;
+                while (std::string::npos == (lineEnd = buffer.find("\r\n")))
+                {
+                    if (!receive(fd, buffer))
+                        return;
+                }
+
+                size_t size = strtoul(buffer.c_str(), NULL, 16);
+                while (buffer.size() < lineEnd + 2 + size + 2)
+                {
+                    if (!receive(fd, buffer))
+                        return;
+                }
+
+                request.body.append(buffer, lineEnd + 2, size);
+                buffer.erase(0, lineEnd + 2 + size + 2);
+                if (0 == size)
+                    break;
+            }
+        }
+
+        Response response;
+        handle(request, response);
+
+        std::ostringstream reply;
+        reply << "HTTP/1.1 " << response.status << " " << reasonPhrase(response.status) << "\r\n"
+              << "Content-Type: application/json; charset=UTF-8\r\n"
+              << "Content-Length: " << response.body.size() << "\r\n\r\n";
+        if ("HEAD" != request.method)
+            reply << response.body;
+
+        std::string data = reply.str();
+        if (!sendAll(fd, data.data(), data.size()))
+            return;
+
+        if ("close" == request.headers["connection"])
+            return;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// elasticsearch emulation
+
+static void split(const std::string& path, std::vector<std::string>& parts, char sep = '/')
+{
+    std::istringstream iss(path);
+    std::string part;
+    while (std::getline(iss, part, sep))
+    {
+        if (!part.empty())
+            parts.push_back(part);
+    }
+}
+
+static std::string urlDecode(const std::string& value)
+{
+    std::string result;
+    for (size_t i = 0; i < value.length(); ++i)
+    {
+        if ('%' == value[i] && i + 2 < value.length())
+        {
+            result += (char) strtol(value.substr(i + 1, 2).c_str(), NULL, 16);
+            i += 2;
+        }
+        else
+        {
+            result += ('+' == value[i]) ? ' ' : value[i];
+        }
+    }
+    return result;
+}
+
+/// Value of an url parameter, empty if absent.
+static std::string param(const std::string& query, const char* name, bool* present = NULL)
+{
+    std::vector<std::string> pairs;
+    split(query, pairs, '&');
+    for (size_t i = 0; i < pairs.size(); ++i)
+    {
+        size_t eq = pairs[i].find('=');
+        if (pairs[i].substr(0, eq) != name)
+            continue;
+
+        if (NULL != present)
+            *present = true;
+        return std::string::npos == eq ? "" : urlDecode(pairs[i].substr(eq + 1));
+    }
+
+    if (NULL != present)
+        *present = false;
+    return "";
+}
+
+static std::string quote(const std::string& value)
+{
+    return Json::valueToQuotedString(value.c_str());
+}
+
+static std::string toJson(const Json::Value& value)
+{
+    std::string json = Json::FastWriter().write(value);
+    if (!json.empty() && '\n' == json[json.length() - 1])
+        json.erase(json.length() - 1);
+    return json;
+}
+
+static std::string key(const std::string& index, const std::string& type, const std::string& id)
+{
+    return index + '\n' + type + '\n' + id;
+}
+
+static void error(Response& response, int status, const char* type, const std::string& reason)
+{
+    response.status = status;
+    response.body = "{\"error\":{\"type\":\"" + std::string(type) + "\",\"reason\":" + quote(reason) + "},\"status\":";
+    std::ostringstream oss;
+    oss << status << "}";
+    response.body += oss.str();
+}
+
+static const char* s_shards = "\"_shards\":{\"total\":1,\"successful\":1,\"failed\":0}";
+
+/*
+ * filter_path: keep the members whose path matches one of paths, a
+ * segment is a name or '*'; arrays are transparent as in ES.
+ */
+typedef std::vector<std::vector<std::string> > paths_type;
+
+static bool filter(const Json::Value& value, const paths_type& paths, const std::vector<size_t>& depths, Json::Value& out)
+{
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        if (depths[i] == paths[i].size())
+        {
+            out = value;
+            return true;
+        }
+    }
+
+    if (value.isArray())
+    {
+        out = Json::Value(Json::arrayValue);
+        for (size_t i = 0; i < value.size(); ++i)
+        {
+            Json::Value child;
+            if (filter(value[(Json::UInt) i], paths, depths, child))
+                out.append(child);
+        }
+        return !out.empty();
+    }
+
+    if (!value.isObject())
+        return false;
+
+    out = Json::Value(Json::objectValue);
+    Json::Value::Members names = value.getMemberNames();
+    for (size_t m = 0; m < names.size(); ++m)
+    {
+        paths_type next;
+        std::vector<size_t> nextDepths;
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            const std::string& segment = paths[i][depths[i]];
+            if ("*" == segment || names[m] == segment)
+            {
+                next.push_back(paths[i]);
+                nextDepths.push_back(depths[i] + 1);
+            }
+        }
+
+        Json::Value child;
+        if (!next.empty() && filter(value[names[m]], next, nextDepths, child))
+            out[names[m]] = child;
+    }
+    return !out.empty();
+}
+
+static void filterPath(const std::string& spec, std::string& body)
+{
+    Json::Value value;
+    if (!Json::Reader().parse(body, value))
+        return;
+
+    std::vector<std::string> specs;
+    split(spec, specs, ',');
+
+    paths_type paths;
+    for (size_t i = 0; i < specs.size(); ++i)
+    {
+        std::vector<std::string> path;
+        split(specs[i], path, '.');
+        if (!path.empty())
+            paths.push_back(path);
+    }
+
+    Json::Value out;
+    if (!filter(value, paths, std::vector<size_t>(paths.size(), 0), out))
+        out = Json::Value(Json::objectValue);
+    body = toJson(out);
+}
+
+/*
+ * _source_includes/_source_excludes: includes are paths as in filter_path,
+ * excludes drop top level fields, a trailing '*' matching any rest.
+ */
+struct SourceFilter
+{
+    paths_type includes;
+    std::vector<std::string> excludes;
+
+    bool empty ( ) const { return includes.empty() && excludes.empty(); }
+};
+
+static SourceFilter sourceFilter(const Request& request)
+{
+    SourceFilter result;
+    std::vector<std::string> specs;
+    split(param(request.query, "_source_includes"), specs, ',');
+    for (size_t i = 0; i < specs.size(); ++i)
+    {
+        std::vector<std::string> path;
+        split(specs[i], path, '.');
+        if (!path.empty())
+            result.includes.push_back(path);
+    }
+
+    split(param(request.query, "_source_excludes"), result.excludes, ',');
+    return result;
+}
+
+static bool fieldMatches(const std::string& pattern, const std::string& name)
+{
+    if (!pattern.empty() && '*' == pattern[pattern.length() - 1])
+        return 0 == name.compare(0, pattern.length() - 1, pattern, 0, pattern.length() - 1);
+
+    return pattern == name;
+}
+
+/// trim the _source member of object
+static void trimSource(const SourceFilter& spec, Json::Value& object)
+{
+    if (!object.isObject() || !object.isMember("_source"))
+        return;
+
+    Json::Value& source = object["_source"];
+    if (!spec.includes.empty())
+    {
+        Json::Value kept;
+        if (!filter(source, spec.includes, std::vector<size_t>(spec.includes.size(), 0), kept))
+            kept = Json::Value(Json::objectValue);
+        source = kept;
+    }
+
+    Json::Value::Members names = source.getMemberNames();
+    for (size_t m = 0; m < names.size(); ++m)
+    {
+        for (size_t i = 0; i < spec.excludes.size(); ++i)
+        {
+            if (fieldMatches(spec.excludes[i], names[m]))
+            {
+                source.removeMember(names[m]);
+                break;
+            }
+        }
+    }
+}
+
+/// trim the _source of a get, of the docs of an mget or of search hits
+static void projectSource(const SourceFilter& spec, std::string& body)
+{
+    Json::Value value;
+    if (!Json::Reader().parse(body, value) || !value.isObject())
+        return;
+
+    trimSource(spec, value);
+
+    if (value.isMember("docs") && value["docs"].isArray())
+    {
+        Json::Value& docs = value["docs"];
+        for (Json::UInt i = 0; i < docs.size(); ++i)
+            trimSource(spec, docs[i]);
+    }
+
+    if (value.isMember("hits") && value["hits"].isObject() && value["hits"].isMember("hits"))
+    {
+        Json::Value& hits = value["hits"]["hits"];
+        for (Json::UInt i = 0; hits.isArray() && i < hits.size(); ++i)
+            trimSource(spec, hits[i]);
+    }
+
+    body = toJson(value);
+}
+
+void MockServer::setPayloadSize(size_t bytes)
+{
+    std::string source = "{\"user\":\"kimchy\",\"message\":\"trying out Elasticsearch\"";
+    if (bytes > source.length() + 14)
+        source += ",\"payload\":\"" + std::string(bytes - source.length() - 14, 'x') + "\"";
+    source += "}";
+
+    cppes::MutexLockGuard lock(_store_mutex);
+    _synthetic_source = source;
+}
+
+void MockServer::reset()
+{
+    cppes::MutexLockGuard lock(_store_mutex);
+    _documents.clear();
+    _indices.clear();
+    _scrolls.clear();
+}
+
+void MockServer::handle(const Request& request, Response& response)
+{
+    __sync_fetch_and_add(&_requests, 1);
+
+    if (_latency_us > 0)
+        usleep(_latency_us);
+
+    std::vector<std::string> parts;
+    split(request.path, parts);
+
+    {
+        cppes::MutexLockGuard lock(_store_mutex);
+        route(request, parts, response);
+    }
+
+    SourceFilter source = sourceFilter(request);
+    if (!source.empty() && response.status < 300)
+        projectSource(source, response.body);
+
+    bool filtered = false;
+    std::string spec = param(request.query, "filter_path", &filtered);
+    if (filtered && !spec.empty())
+        filterPath(spec, response.body);
+}
+
+void MockServer::route(const Request& request, const std::vector<std::string>& parts, Response& response)
+{
+    const std::string& method = request.method;
+    const std::string last = parts.empty() ? "" : parts.back();
+
+    if (parts.empty())
+        response.body = "{\"name\":\"mock\",\"cluster_name\":\"mock\",\"version\":{\"number\":\"6.8.0\"},\"tagline\":\"You Know, for Search\"}";
+    else if ("_bulk" == last)
+        bulk(request, parts, response);
+    else if ("_mget" == last)
+        mget(request, parts, response);
+    else if ("_msearch" == last)
+        msearch(request, parts, response);
+    else if (2 == parts.size() && "_search" == parts[0] && "scroll" == parts[1])
+        scroll(request, response);
+    else if ("_search" == last)
+        search(request, parts, response);
+    else if ("_count" == last)
+        count(request, parts, response);
+    else if ("_refresh" == last)
+        response.body = "{" + std::string(s_shards) + "}";
+    else if (4 == parts.size() && "_update" == last && "POST" == method)
+        updateDocument(request, parts, response);
+    else if (1 == parts.size())
+        indexAdmin(request, parts[0], response);
+    else if (2 == parts.size() && "POST" == method)
+        indexDocument(request, parts, response);
+    else if (3 == parts.size() && ("GET" == method || "HEAD" == method))
+        getDocument(request, parts, response);
+    else if (3 == parts.size() && ("PUT" == method || "POST" == method))
+        indexDocument(request, parts, response);
+    else if (3 == parts.size() && "DELETE" == method)
+        deleteDocument(request, parts, response);
+    else
+        error(response, 400, "illegal_argument_exception", "no handler for " + method + " " + request.path);
+}
+
+bool MockServer::hasIndex(const std::string& index) const
+{
+    return _indices.count(index) > 0;
+}
+
+const MockServer::Document* MockServer::find(const std::string& index, const std::string& type, const std::string& id) const
+{
+    store_type::const_iterator it = _documents.find(key(index, type, id));
+    return _documents.end() == it ? NULL : &it->second;
+}
+
+/// Body of a get, doc is NULL for a synthesized document.
+std::string MockServer::docJson(const std::string& index, const std::string& type, const std::string& id, const Document* doc, bool withSource) const
+{
+    std::ostringstream oss;
+    oss << "{\"_index\":" << quote(index) << ",\"_type\":" << quote(type) << ",\"_id\":" << quote(id)
+        << ",\"_version\":" << (doc ? doc->version : 1)
+        << ",\"_seq_no\":" << (doc ? doc->seq_no : 0)
+        << ",\"_primary_term\":1,\"found\":true";
+    if (withSource)
+        oss << ",\"_source\":" << (doc ? doc->source : _synthetic_source);
+    oss << "}";
+    return oss.str();
+}
+
+void MockServer::getDocument(const Request& request, const std::vector<std::string>& parts, Response& response)
+{
+    const Document* doc = find(parts[0], parts[1], parts[2]);
+    if (NULL == doc && !_synthetic)
+    {
+        if (!hasIndex(parts[0]))
+        {
+            error(response, 404, "index_not_found_exception", "no such index");
+            return;
+        }
+
+        response.status = 404;
+        response.body = "{\"_index\":" + quote(parts[0]) + ",\"_type\":" + quote(parts[1]) + ",\"_id\":" + quote(parts[2]) + ",\"found\":false}";
+        return;
+    }
+
+    response.body = docJson(parts[0], parts[1], parts[2], doc, "false" != param(request.query, "_source"));
+}
+
+/// Store a document, false on a create conflict.
+bool MockServer::put(const std::string& index, const std::string& type, const std::string& id, const std::string& source, bool create, Document& result, bool& created)
+{
+    Document& doc = _documents[key(index, type, id)];
+    created = doc.id.empty();
+    if (!created && create)
+    {
+        result = doc;
+        return false;
+    }
+
+    doc.index = index;
+    doc.type = type;
+    doc.id = id;
+    doc.source = source;
+    doc.version = created ? 1 : doc.version + 1;
+    doc.seq_no = _seq_no++;
+    _indices.insert(index);
+
+    result = doc;
+    return true;
+}
+
+/// Answer 409 if the write has if_seq_no/if_primary_term and the document moved on.
+bool MockServer::conflicts(const Request& request, const std::vector<std::string>& parts, const std::string& id, Response& response) const
+{
+    bool conditional = false;
+    std::string seqNo = param(request.query, "if_seq_no", &conditional);
+    if (!conditional)
+        return false;
+
+    std::string primaryTerm = param(request.query, "if_primary_term");
+    const Document* doc = find(parts[0], parts[1], id);
+    if (NULL != doc && atol(seqNo.c_str()) == doc->seq_no && "1" == primaryTerm)
+        return false;
+
+    std::ostringstream reason;
+    reason << "[" << id << "]: version conflict, required seqNo [" << seqNo << "], primary term [" << primaryTerm << "]. ";
+    if (NULL == doc)
+        reason << "but no document was found";
+    else
+        reason << "current document has seqNo [" << doc->seq_no << "] and primary term [1]";
+
+    error(response, 409, "version_conflict_engine_exception", reason.str());
+    return true;
+}
+
+static std::string writeResult(const std::string& index, const std::string& type, const std::string& id,
+                               long version, long seqNo, const char* result, bool created)
+{
+    std::ostringstream oss;
+    oss << "{\"_index\":" << quote(index) << ",\"_type\":" << quote(type) << ",\"_id\":" << quote(id)
+        << ",\"_version\":" << version << ",\"result\":\"" << result << "\"," << s_shards
+        << ",\"_seq_no\":" << seqNo << ",\"_primary_term\":1";
+    if (created)
+        oss << ",\"created\":true";
+    oss << "}";
+    return oss.str();
+}
+
+void MockServer::indexDocument(const Request& request, const std::vector<std::string>& parts, Response& response)
+{
+    Json::Value source;
+    if (!Json::Reader().parse(request.body, source) || !source.isObject())
+    {
+        error(response, 400, "mapper_parsing_exception", "failed to parse");
+        return;
+    }
+
+    std::string id;
+    if (3 == parts.size())
+    {
+        id = parts[2];
+    }
+    else
+    {
+        std::ostringstream oss;
+        oss << "mock-" << ++_next_id;
+        id = oss.str();
+    }
+
+    if (conflicts(request, parts, id, response))
+        return;
+
+    bool create = "create" == param(request.query, "op_type");
+    bool created = false;
+    Document doc;
+    if (!put(parts[0], parts[1], id, toJson(source), create, doc, created))
+    {
+        error(response, 409, "version_conflict_engine_exception", "[" + parts[1] + "][" + id + "]: version conflict, document already exists");
+        return;
+    }
+
+    response.status = created ? 201 : 200;
+    response.body = writeResult(parts[0], parts[1], id, doc.version, doc.seq_no, created ? "created" : "updated", created);
+}
+
+void MockServer::updateDocument(const Request& request, const std::vector<std::string>& parts, Response& response)
+{
+    Json::Value body;
+    if (!Json::Reader().parse(request.body, body) || !body.isObject())
+    {
+        error(response, 400, "parse_exception", "failed to parse");
+        return;
+    }
+
+    if (conflicts(request, parts, parts[2], response))
+        return;
+
+    Json::Value source;
+    const Document* existing = find(parts[0], parts[1], parts[2]);
+    if (NULL != existing)
+    {
+        Json::Reader().parse(existing->source, source);
+    }
+    else if (body.isMember("upsert"))
+    {
+        source = body["upsert"];
+    }
+    else if (!body.get("doc_as_upsert", false).asBool())
+    {
+        error(response, 404, "document_missing_exception", "[" + parts[1] + "][" + parts[2] + "]: document missing");
+        return;
+    }
+
+    if (NULL != existing || !body.isMember("upsert"))
+    {
+        const Json::Value& doc = body["doc"];
+        Json::Value::Members names = doc.getMemberNames();
+        for (size_t i = 0; i < names.size(); ++i)
+            source[names[i]] = doc[names[i]];
+    }
+
+    bool created = false;
+    Document doc;
+    put(parts[0], parts[1], parts[2], toJson(source), false, doc, created);
+
+    response.status = created ? 201 : 200;
+    response.body = writeResult(parts[0], parts[1], parts[2], doc.version, doc.seq_no, created ? "created" : "updated", false);
+}
+
+void MockServer::deleteDocument(const Request& request, const std::vector<std::string>& parts, Response& response)
+{
+    store_type::iterator it = _documents.find(key(parts[0], parts[1], parts[2]));
+    if (_documents.end() == it)
+    {
+        response.status = 404;
+        response.body = "{\"_index\":" + quote(parts[0]) + ",\"_type\":" + quote(parts[1]) + ",\"_id\":" + quote(parts[2])
+            + ",\"_version\":1,\"result\":\"not_found\",\"found\":false," + s_shards + "}";
+        return;
+    }
+
+    long version = it->second.version + 1;
+    _documents.erase(it);
+
+    std::ostringstream oss;
+    oss << "{\"_index\":" << quote(parts[0]) << ",\"_type\":" << quote(parts[1]) << ",\"_id\":" << quote(parts[2])
+        << ",\"_version\":" << version << ",\"result\":\"deleted\",\"found\":true," << s_shards
+        << ",\"_seq_no\":" << _seq_no++ << ",\"_primary_term\":1}";
+    response.body = oss.str();
+}
+
+void MockServer::indexAdmin(const Request& request, const std::string& index, Response& response)
+{
+    if ("PUT" == request.method)
+    {
+        if (hasIndex(index))
+        {
+            error(response, 400, "resource_already_exists_exception", "index [" + index + "] already exists");
+            return;
+        }
+
+        _indices.insert(index);
+        response.body = "{\"acknowledged\":true,\"shards_acknowledged\":true,\"index\":" + quote(index) + "}";
+        return;
+    }
+
+    if (!hasIndex(index))
+    {
+        error(response, 404, "index_not_found_exception", "no such index");
+        return;
+    }
+
+    if ("DELETE" == request.method)
+    {
+        std::string prefix = index + '\n';
+        store_type::iterator it = _documents.lower_bound(prefix);
+        while (_documents.end() != it && 0 == it->first.compare(0, prefix.length(), prefix))
+            _documents.erase(it++);
+
+        _indices.erase(index);
+        response.body = "{\"acknowledged\":true}";
+        return;
+    }
+
+    response.body = "{" + quote(index) + ":{\"aliases\":{},\"mappings\":{},\"settings\":{\"index\":{\"number_of_shards\":\"1\",\"number_of_replicas\":\"0\"}}}}";
+}
+
+void MockServer::bulk(const Request& request, const std::vector<std::string>& parts, Response& response)
+{
+    std::string defaultIndex = parts.size() > 1 ? parts[0] : "";
+    std::string defaultType = parts.size() > 2 ? parts[1] : "";
+
+    std::vector<std::string> lines;
+    split(request.body, lines, '\n');
+
+    std::ostringstream items;
+    bool errors = false;
+    size_t count = 0;
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        Json::Value action;
+        if (!Json::Reader().parse(lines[i], action) || !action.isObject() || action.size() != 1)
+        {
+            error(response, 400, "illegal_argument_exception", "Malformed action/metadata line");
+            return;
+        }
+
+        std::string op = action.getMemberNames()[0];
+        const Json::Value& meta = action[op];
+        std::string index = meta.get("_index", defaultIndex).asString();
+        std::string type = meta.get("_type", defaultType).asString();
+        std::string id = meta.get("_id", "").asString();
+        if (id.empty())
+        {
+            std::ostringstream oss;
+            oss << "mock-" << ++_next_id;
+            id = oss.str();
+        }
+
+        std::string source;
+        if ("delete" != op)
+        {
+            if (++i == lines.size())
+            {
+                error(response, 400, "illegal_argument_exception", "The bulk request must be terminated by a newline");
+                return;
+            }
+            source = lines[i];
+        }
+
+        int status = 200;
+        const char* result = "updated";
+        const char* errorType = NULL;
+        long version = 1, seqNo = 0;
+        Document doc;
+        bool created = false;
+
+        if ("index" == op || "create" == op)
+        {
+            if (!put(index, type, id, source, "create" == op, doc, created))
+            {
+                status = 409;
+                errorType = "version_conflict_engine_exception";
+            }
+            else
+            {
+                status = created ? 201 : 200;
+                result = created ? "created" : "updated";
+            }
+            version = doc.version;
+            seqNo = doc.seq_no;
+        }
+        else if ("update" == op)
+        {
+            Request update;
+            update.method = "POST";
+            update.body = source;
+
+            std::vector<std::string> path;
+            path.push_back(index);
+            path.push_back(type);
+            path.push_back(id);
+            path.push_back("_update");
+
+            Response answer;
+            updateDocument(update, path, answer);
+            status = answer.status;
+            if (status >= 300)
+            {
+                errorType = 404 == status ? "document_missing_exception" : "parse_exception";
+            }
+            else
+            {
+                const Document* updated = find(index, type, id);
+                version = updated->version;
+                seqNo = updated->seq_no;
+            }
+        }
+        else if ("delete" == op)
+        {
+            store_type::iterator it = _documents.find(key(index, type, id));
+            if (_documents.end() == it)
+            {
+                status = 404;
+                result = "not_found";
+            }
+            else
+            {
+                version = it->second.version + 1;
+                _documents.erase(it);
+                result = "deleted";
+            }
+            seqNo = _seq_no++;
+        }
+        else
+        {
+            error(response, 400, "illegal_argument_exception", "Malformed action/metadata line, expected one of [create, delete, index, update] but found [" + op + "]");
+            return;
+        }
+
+        if (count++ > 0)
+            items << ",";
+        items << "{\"" << op << "\":{\"_index\":" << quote(index) << ",\"_type\":" << quote(type) << ",\"_id\":" << quote(id);
+        if (NULL != errorType)
+        {
+            errors = true;
+            items << ",\"status\":" << status << ",\"error\":{\"type\":\"" << errorType << "\",\"reason\":\"[" << type << "][" << id << "]: "
+                  << (409 == status ? "version conflict, document already exists" : "document missing") << "\"}}}";
+        }
+        else
+        {
+            items << ",\"_version\":" << version << ",\"result\":\"" << result << "\"," << s_shards
+                  << ",\"_seq_no\":" << seqNo << ",\"_primary_term\":1,\"status\":" << status << "}}";
+        }
+    }
+
+    std::ostringstream oss;
+    oss << "{\"took\":" << (_latency_us / 1000) << ",\"errors\":" << (errors ? "true" : "false") << ",\"items\":[" << items.str() << "]}";
+    response.body = oss.str();
+}
+
+void MockServer::mget(const Request& request, const std::vector<std::string>& parts, Response& response)
+{
+    std::string defaultIndex = parts.size() > 1 ? parts[0] : "";
+    std::string defaultType = parts.size() > 2 ? parts[1] : "";
+    bool withSource = "false" != param(request.query, "_source");
+
+    Json::Value body;
+    if (!Json::Reader().parse(request.body, body) || !body.isObject())
+    {
+        error(response, 400, "parse_exception", "failed to parse");
+        return;
+    }
+
+    Json::Value refs(Json::arrayValue);
+    if (body.isMember("ids"))
+    {
+        for (size_t i = 0; i < body["ids"].size(); ++i)
+        {
+            Json::Value ref;
+            ref["_id"] = body["ids"][(Json::UInt) i];
+            refs.append(ref);
+        }
+    }
+    else
+    {
+        refs = body["docs"];
+    }
+
+    std::ostringstream oss;
+    oss << "{\"docs\":[";
+    for (size_t i = 0; i < refs.size(); ++i)
+    {
+        const Json::Value& ref = refs[(Json::UInt) i];
+        std::string index = ref.get("_index", defaultIndex).asString();
+        std::string type = ref.get("_type", defaultType).asString();
+        std::string id = ref.get("_id", "").asString();
+
+        if (i > 0)
+            oss << ",";
+
+        const Document* doc = find(index, type, id);
+        if (NULL == doc && !_synthetic)
+            oss << "{\"_index\":" << quote(index) << ",\"_type\":" << quote(type) << ",\"_id\":" << quote(id) << ",\"found\":false}";
+        else
+            oss << docJson(index, type, id, doc, withSource);
+    }
+    oss << "]}";
+    response.body = oss.str();
+}
+
+/// Serialized hits of index/type, all documents match; synthesized if there are none.
+void MockServer::matchHits(const std::string& index, const std::string& type, size_t limit, std::vector<std::string>& hits, size_t& total) const
+{
+    std::string prefix = type.empty() ? index + '\n' : key(index, type, "");
+
+    total = 0;
+    store_type::const_iterator it = _documents.lower_bound(prefix);
+    for (; _documents.end() != it && 0 == it->first.compare(0, prefix.length(), prefix); ++it, ++total)
+    {
+        if (hits.size() >= limit)
+            continue;
+
+        const Document& doc = it->second;
+        hits.push_back("{\"_index\":" + quote(doc.index) + ",\"_type\":" + quote(doc.type) + ",\"_id\":" + quote(doc.id)
+                       + ",\"_score\":1.0,\"_source\":" + doc.source + "}");
+    }
+
+    if (total > 0 || !_synthetic)
+        return;
+
+    total = _synthetic_count;
+    for (size_t i = 0; i < total && hits.size() < limit; ++i)
+    {
+        std::ostringstream oss;
+        oss << "{\"_index\":" << quote(index) << ",\"_type\":" << quote(type.empty() ? "doc" : type) << ",\"_id\":\"" << i
+            << "\",\"_score\":1.0,\"_source\":" << _synthetic_source << "}";
+        hits.push_back(oss.str());
+    }
+}
+
+std::string MockServer::searchJson(const std::vector<std::string>& hits, size_t total, const std::string& scrollId) const
+{
+    std::ostringstream oss;
+    oss << "{";
+    if (!scrollId.empty())
+        oss << "\"_scroll_id\":" << quote(scrollId) << ",";
+    oss << "\"took\":" << (_latency_us / 1000) << ",\"timed_out\":false," << s_shards
+        << ",\"hits\":{\"total\":" << total << ",\"max_score\":1.0,\"hits\":[";
+    for (size_t i = 0; i < hits.size(); ++i)
+        oss << (i > 0 ? "," : "") << hits[i];
+    oss << "]}}";
+    return oss.str();
+}
+
+void MockServer::search(const Request& request, const std::vector<std::string>& parts, Response& response)
+{
+    std::string index = parts.size() > 1 ? parts[0] : "_all";
+    std::string type = parts.size() > 2 ? parts[1] : "";
+
+    Json::Value body;
+    if (!request.body.empty() && (!Json::Reader().parse(request.body, body) || !body.isObject()))
+    {
+        error(response, 400, "parsing_exception", "failed to parse search source");
+        return;
+    }
+
+    std::string sizeParam = param(request.query, "size");
+    size_t size = sizeParam.empty() ? body.get("size", 10).asUInt() : strtoul(sizeParam.c_str(), NULL, 10);
+
+    bool scrolling = false;
+    param(request.query, "scroll", &scrolling);
+    if (!scrolling)
+    {
+        std::vector<std::string> hits;
+        size_t total = 0;
+        matchHits(index, type, size, hits, total);
+        response.body = searchJson(hits, total, "");
+        return;
+    }
+
+    // a scroll keeps every hit, pages are cut by scrollNext
+    std::ostringstream id;
+    id << "mock-scroll-" << ++_next_id;
+
+    Scroll& scroll = _scrolls[id.str()];
+    size_t total = 0;
+    matchHits(index, type, (size_t) -1, scroll.hits, total);
+    scroll.size = size > 0 ? size : 10;
+
+    // later pages keep the source filtering of the search
+    SourceFilter source = sourceFilter(request);
+    for (size_t i = 0; !source.empty() && i < scroll.hits.size(); ++i)
+    {
+        Json::Value hit;
+        if (Json::Reader().parse(scroll.hits[i], hit))
+        {
+            trimSource(source, hit);
+            scroll.hits[i] = toJson(hit);
+        }
+    }
+
+    // sliced scroll: slice id of max takes every max-th hit
+    const Json::Value& slice = body["slice"];
+    if (slice.isObject() && slice.get("max", 0).asUInt() > 1)
+    {
+        size_t sliceId = slice.get("id", 0).asUInt();
+        size_t max = slice["max"].asUInt();
+
+        std::vector<std::string> mine;
+        for (size_t i = sliceId; i < scroll.hits.size(); i += max)
+            mine.push_back(scroll.hits[i]);
+        scroll.hits.swap(mine);
+        total = scroll.hits.size();
+    }
+    scroll.next = 0;
+
+    // search_type=scan (ES 1.x/2.x) returns no hit in the first answer
+    std::vector<std::string> page;
+    if ("scan" != param(request.query, "search_type"))
+    {
+        for (; scroll.next < scroll.hits.size() && page.size() < scroll.size; ++scroll.next)
+            page.push_back(scroll.hits[scroll.next]);
+    }
+
+    response.body = searchJson(page, total, id.str());
+}
+
+void MockServer::scroll(const Request& request, Response& response)
+{
+    std::string scrollId = request.body;
+    Json::Value body;
+    if (!request.body.empty() && '{' == request.body[0] && Json::Reader().parse(request.body, body))
+        scrollId = body["scroll_id"].isArray() ? body["scroll_id"][0u].asString() : body.get("scroll_id", "").asString();
+
+    if ("DELETE" == request.method)
+    {
+        size_t freed = scrollId.empty() ? _scrolls.size() : _scrolls.erase(scrollId);
+        if (scrollId.empty())
+            _scrolls.clear();
+
+        std::ostringstream oss;
+        oss << "{\"succeeded\":true,\"num_freed\":" << freed << "}";
+        response.body = oss.str();
+        return;
+    }
+
+    std::map<std::string, Scroll>::iterator it = _scrolls.find(scrollId);
+    if (_scrolls.end() == it)
+    {
+        error(response, 404, "search_context_missing_exception", "No search context found for id [" + scrollId + "]");
+        return;
+    }
+
+    Scroll& scroll = it->second;
+    std::vector<std::string> page;
+    for (; scroll.next < scroll.hits.size() && page.size() < scroll.size; ++scroll.next)
+        page.push_back(scroll.hits[scroll.next]);
+
+    response.body = searchJson(page, scroll.hits.size(), scrollId);
+}
+
+void MockServer::msearch(const Request& request, const std::vector<std::string>& parts, Response& response)
+{
+    std::vector<std::string> lines;
+    split(request.body, lines, '\n');
+
+    std::ostringstream oss;
+    oss << "{\"responses\":[";
+    for (size_t i = 0; i + 1 < lines.size(); i += 2)
+    {
+        Json::Value header;
+        Json::Reader().parse(lines[i], header);
+
+        std::vector<std::string> path;
+        path.push_back(header.get("index", parts.size() > 1 ? parts[0] : "_all").asString());
+        path.push_back(header.get("type", parts.size() > 2 ? parts[1] : "").asString());
+        if (path.back().empty())
+            path.pop_back();
+        path.push_back("_search");
+
+        Request one;
+        one.method = "POST";
+        one.body = lines[i + 1];
+
+        Response answer;
+        search(one, path, answer);
+        oss << (i > 0 ? "," : "") << answer.body;
+    }
+    oss << "]}";
+    response.body = oss.str();
+}
+
+void MockServer::count(const Request& request, const std::vector<std::string>& parts, Response& response)
+{
+    std::string index = parts.size() > 1 ? parts[0] : "_all";
+    std::string type = parts.size() > 2 ? parts[1] : "";
+
+    std::vector<std::string> hits;
+    size_t total = 0;
+    matchHits(index, type, 0, hits, total);
+
+    std::ostringstream oss;
+    oss << "{\"count\":" << total << "," << s_shards << "}";
+    response.body = oss.str();
+}
+
+} // end namespace
@@ -0,0 +1,164 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _MOCK_SERVER_HEADER_H_
+#define _MOCK_SERVER_HEADER_H_
+#include <string>
+#include <map>
+#include <set>
+#include <vector>
+#include <pthread.h>
+#include "Mutex.h"
+
+namespace mock {
+
+struct Request
+{
+    std::string method;
+    std::string path;                              // without query string
+    std::string query;                             // text after '?'
+    std::map<std::string, std::string> headers;    // names in lower case
+    std::string body;
+};
+
+struct Response
+{
+    Response ( ) : status(200), body() { }
+
+    int status;
+    std::string body;
+};
+
+/*
+ * @brief In-process HTTP server answering like an elasticsearch node,
+ *  so the client can be tested and benchmarked without a cluster.
+ *  Connections are kept alive, one thread serves each connection.
+ *
+ *  Documents are kept in memory: _doc GET/HEAD/PUT/POST/DELETE, _update,
+ *  _bulk, _mget, _search, _msearch, scroll, _count, _refresh and index
+ *  create/exist/delete behave like ES 6 with one shard. Searches ignore
+ *  the query and match every document of the index/type, split by the
+ *  slice of a sliced scroll; filter_path, _source_includes and
+ *  _source_excludes are honoured. Reads of documents
+ *  never indexed, and searches of an index without documents, are
+ *  answered with synthesized documents of a configurable size unless
+ *  setSynthetic(false).
+ */
+class MockServer
+{
+public:
+    MockServer ( );
+    virtual ~MockServer ( );
+
+    /// Listen on 127.0.0.1:port, 0 picks a free port.
+    bool start ( int port = 0 );
+    void stop ( );
+
+    int port ( ) const { return _port; }
+    std::string url ( ) const;
+
+    /// Sleep this long before every answer, to emulate network and server time.
+    void setLatency ( unsigned int micros )  { _latency_us = micros; }
+
+    /// Size in bytes of the _source of synthesized documents.
+    void setPayloadSize ( size_t bytes );
+
+    /// Answer missing documents and empty indices with synthesized ones, on by default.
+    void setSynthetic ( bool synthetic )     { _synthetic = synthetic; }
+
+    /// Number of synthesized documents of an index, for search, scroll and count.
+    void setSyntheticCount ( size_t count )  { _synthetic_count = count; }
+
+    /// Requests answered since construction.
+    unsigned long requestCount ( ) const     { return _requests; }
+
+    /// Drop every document, index and scroll.
+    void reset ( );
+
+protected:
+    /// Route one request, override to answer differently.
+    virtual void handle ( const Request& request, Response& response );
+
+private:
+    struct Document
+    {
+        std::string index;
+        std::string type;
+        std::string id;
+        std::string source;    // raw json
+        long version;
+        long seq_no;
+    };
+
+    struct Scroll
+    {
+        std::vector<std::string> hits;    // serialized hits
+        size_t next;
+        size_t size;
+    };
+
+    typedef std::map<std::string, Document> store_type;
+
+    // elasticsearch emulation, the store is locked by the caller
+    void route ( const Request& request, const std::vector<std::string>& parts, Response& response );
+    void getDocument ( const Request& request, const std::vector<std::string>& parts, Response& response );
+    void indexDocument ( const Request& request, const std::vector<std::string>& parts, Response& response );
+    void updateDocument ( const Request& request, const std::vector<std::string>& parts, Response& response );
+    void deleteDocument ( const Request& request, const std::vector<std::string>& parts, Response& response );
+    void bulk ( const Request& request, const std::vector<std::string>& parts, Response& response );
+    void mget ( const Request& request, const std::vector<std::string>& parts, Response& response );
+    void search ( const Request& request, const std::vector<std::string>& parts, Response& response );
+    void msearch ( const Request& request, const std::vector<std::string>& parts, Response& response );
+    void scroll ( const Request& request, Response& response );
+    void count ( const Request& request, const std::vector<std::string>& parts, Response& response );
+    void indexAdmin ( const Request& request, const std::string& index, Response& response );
+
+    const Document* find ( const std::string& index, const std::string& type, const std::string& id ) const;
+    std::string docJson ( const std::string& index, const std::string& type, const std::string& id, const Document* doc, bool withSource ) const;
+    void matchHits ( const std::string& index, const std::string& type, size_t limit, std::vector<std::string>& hits, size_t& total ) const;
+    std::string searchJson ( const std::vector<std::string>& hits, size_t total, const std::string& scrollId ) const;
+    bool put ( const std::string& index, const std::string& type, const std::string& id, const std::string& source, bool create, Document& result, bool& created );
+    bool hasIndex ( const std::string& index ) const;
+    bool conflicts ( const Request& request, const std::vector<std::string>& parts, const std::string& id, Response& response ) const;
+
+    static void* acceptThread ( void* arg );
+    static void* connectionThread ( void* arg );
+    void serve ( int fd );
+
+    MockServer ( const MockServer& );
+    MockServer& operator= ( const MockServer& );
+
+    int _listen_fd;
+    int _port;
+    volatile bool _running;
+    pthread_t _acceptor;
+
+    /// open connections, guarded by _mutex
+    std::set<int> _connections;
+    cppes::MutexLock _mutex;
+    cppes::Condition _idle;
+
+    /// settings, read without lock
+    volatile unsigned int _latency_us;
+    volatile bool _synthetic;
+    volatile size_t _synthetic_count;
+    volatile unsigned long _requests;
+
+    /// documents, indices and scrolls, guarded by _store_mutex
+    store_type _documents;
+    std::set<std::string> _indices;
+    std::map<std::string, Scroll> _scrolls;
+    std::string _synthetic_source;
+    long _seq_no;
+    long _next_id;
+    cppes::MutexLock _store_mutex;
+};
+
+} // end namespace
+#endif // _MOCK_SERVER_HEADER_H_
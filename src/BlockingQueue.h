@@ -0,0 +1,96 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _BLOCKING_QUEUE_HEADER_H_
+#define _BLOCKING_QUEUE_HEADER_H_
+#include <deque>
+#include <cstddef>
+#include "Mutex.h"
+
+namespace cppes {
+
+/*
+ * @brief Bounded FIFO between threads. put() blocks while the queue is
+ *  full, which is what slows a producer down to the pace of its consumers.
+ *  After close() puts are refused and takes drain what is left.
+ */
+template <typename T>
+class BlockingQueue
+{
+public:
+    explicit BlockingQueue ( size_t capacity )
+    : _capacity(capacity > 0 ? capacity : 1)
+    , _items()
+    , _closed(false)
+    , _mutex()
+    , _not_empty(_mutex)
+    , _not_full(_mutex)
+    {
+    }
+
+    /// false if the queue was closed, item is then dropped
+    bool put ( const T& item )
+    {
+        MutexLockGuard lock(_mutex);
+        while (_items.size() >= _capacity && !_closed)
+            _not_full.wait();
+
+        if (_closed)
+            return false;
+
+        _items.push_back(item);
+        _not_empty.notify();
+        return true;
+    }
+
+    /// false once the queue is closed and empty
+    bool take ( T& item )
+    {
+        MutexLockGuard lock(_mutex);
+        while (_items.empty() && !_closed)
+            _not_empty.wait();
+
+        if (_items.empty())
+            return false;
+
+        item = _items.front();
+        _items.pop_front();
+        _not_full.notify();
+        return true;
+    }
+
+    /// wake up every waiting thread, no more puts
+    void close ( )
+    {
+        MutexLockGuard lock(_mutex);
+        _closed = true;
+        _not_empty.notifyAll();
+        _not_full.notifyAll();
+    }
+
+    size_t size ( ) const
+    {
+        MutexLockGuard lock(_mutex);
+        return _items.size();
+    }
+
+private:
+    BlockingQueue ( const BlockingQueue& );
+    BlockingQueue& operator= ( const BlockingQueue& );
+
+    const size_t _capacity;
+    std::deque<T> _items;
+    bool _closed;
+    mutable MutexLock _mutex;
+    Condition _not_empty;
+    Condition _not_full;
+};
+
+} // end namespace
+#endif // _BLOCKING_QUEUE_HEADER_H_
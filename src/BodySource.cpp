@@ -0,0 +1,118 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "BodySource.h"
+#include <cstring>
+
+namespace cppes {
+
+BodySource::BodySource()
+: _data(NULL)
+, _iov(NULL)
+, _iovcnt(0)
+, _pull(NULL)
+, _userdata(NULL)
+, _length(0)
+{
+}
+
+BodySource::BodySource(const std::string& data)
+: _data(data.data())
+, _iov(NULL)
+, _iovcnt(0)
+, _pull(NULL)
+, _userdata(NULL)
+, _length(data.length())
+{
+}
+
+BodySource::BodySource(const char* data)
+: _data(data)
+, _iov(NULL)
+, _iovcnt(0)
+, _pull(NULL)
+, _userdata(NULL)
+, _length(NULL == data ? 0 : strlen(data))
+{
+}
+
+BodySource::BodySource(const char* data, size_t length)
+: _data(data)
+, _iov(NULL)
+, _iovcnt(0)
+, _pull(NULL)
+, _userdata(NULL)
+, _length(length)
+{
+}
+
+BodySource::BodySource(const struct iovec* iov, int iovcnt)
+: _data(NULL)
+, _iov(iov)
+, _iovcnt(iovcnt)
+, _pull(NULL)
+, _userdata(NULL)
+, _length(0)
+{
+    for (int i = 0; i < iovcnt; ++i)
+        _length += iov[i].iov_len;
+}
+
+BodySource::BodySource(pull_type pull, void* userdata, long long length)
+: _data(NULL)
+, _iov(NULL)
+, _iovcnt(0)
+, _pull(pull)
+, _userdata(userdata)
+, _length(length)
+{
+}
+
+BodySource::Reader::Reader(const BodySource& source)
+: _source(source)
+, _index(0)
+, _offset(0)
+{
+}
+
+size_t BodySource::Reader::read(char* buffer, size_t size)
+{
+    if (NULL != _source._pull)
+        return _source._pull(buffer, size, _source._userdata);
+
+    if (_source.contiguous())
+    {
+        size_t left = (size_t) _source._length - _offset;
+        size_t n = left < size ? left : size;
+        memcpy(buffer, _source._data + _offset, n);
+        _offset += n;
+        return n;
+    }
+
+    size_t copied = 0;
+    while (copied < size && _index < _source._iovcnt)
+    {
+        const struct iovec& iov = _source._iov[_index];
+        size_t left = iov.iov_len - _offset;
+        size_t n = left < size - copied ? left : size - copied;
+        memcpy(buffer + copied, (const char*) iov.iov_base + _offset, n);
+        copied += n;
+        _offset += n;
+
+        if (_offset == iov.iov_len)
+        {
+            ++_index;
+            _offset = 0;
+        }
+    }
+
+    return copied;
+}
+
+} // end namespace
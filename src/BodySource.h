@@ -0,0 +1,79 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _BODY_SOURCE_HEADER_H_
+#define _BODY_SOURCE_HEADER_H_
+#include <string>
+#include <cstddef>
+#include <sys/uio.h>
+
+namespace cppes {
+
+/*
+ * @brief Request body of HttpClient, referenced and never copied.
+ *  A body is one of:
+ *  (1) a pointer and length, passed to libcurl as is;
+ *  (2) a chain of buffers (iovec), streamed by CURLOPT_READFUNCTION;
+ *  (3) a pull callback which fills libcurl's buffer on demand.
+ *  Buffers must stay valid until the request returns.
+ */
+class BodySource
+{
+public:
+    /*
+     * @brief Pull callback, write at most size bytes into buffer.
+     * @return size_t, bytes written, 0 at the end of body, an exception aborts the request
+     */
+    typedef size_t ( *pull_type ) ( char* buffer, size_t size, void* userdata );
+
+    BodySource ( );
+    BodySource ( const std::string& data );
+    BodySource ( const char* data );
+    BodySource ( const char* data, size_t length );
+    BodySource ( const struct iovec* iov, int iovcnt );
+
+    /// length of -1 means unknown, the body is then sent chunked
+    BodySource ( pull_type pull, void* userdata, long long length = -1 );
+
+    bool empty ( ) const                { return 0 == _length; }
+    long long length ( ) const          { return _length;      }
+
+    /// true if the body is one buffer which data() points to
+    bool contiguous ( ) const           { return NULL == _iov && NULL == _pull; }
+    const char* data ( ) const          { return _data;        }
+
+    /// true if the body can be sent again, a pull callback is consumed once
+    bool replayable ( ) const           { return NULL == _pull; }
+
+    /*
+     * @brief Sequential reader over a body, feeding CURLOPT_READFUNCTION.
+     */
+    class Reader
+    {
+    public:
+        explicit Reader ( const BodySource& source );
+        size_t read ( char* buffer, size_t size );
+
+    private:
+        const BodySource& _source;
+        int _index;       // current iovec
+        size_t _offset;   // offset in the current buffer
+    };
+
+private:
+    const char* _data;
+    const struct iovec* _iov;
+    int _iovcnt;
+    pull_type _pull;
+    void* _userdata;
+    long long _length;
+};
+
+} // end namespace
+#endif // _BODY_SOURCE_HEADER_H_
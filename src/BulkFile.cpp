@@ -0,0 +1,237 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "BulkFile.h"
+#include "BodySource.h"
+#include "JsonScanner.h"
+#include "Exception.h"
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace cppes {
+
+// End of the line starting at p, the newline or end.
+
+static inline const char* lineEnd(const char* p, const char* end)
+{
+    const char* eol = (const char*) memchr(p, '\n', end - p);
+    return NULL == eol ? end : eol;
+}
+
+static bool isBlank(const char* p, const char* eol)
+{
+    for (; p < eol; ++p)
+    {
+        if (' ' != *p && '\t' != *p && '\r' != *p)
+            return false;
+    }
+    return true;
+}
+
+// A delete action is the only one without a document line.
+
+static bool isDelete(const char* p, const char* eol)
+{
+    JsonScanner scanner(p, eol);
+    std::string key;
+    return scanner.beginObject() && scanner.nextMember(key) && "delete" == key;
+}
+
+BulkFileLoader::BulkFileLoader(ElasticSearch& es, const BulkFileOptions& options)
+: _es(es)
+, _options(options)
+, _queue(NULL)
+, _result(NULL)
+, _mutex()
+{
+}
+
+bool BulkFileLoader::load(const std::string& path, BulkFileResult& result)
+{
+    result = BulkFileResult();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        result.failure = "cannot open " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    struct stat st;
+    if (0 != ::fstat(fd, &st))
+    {
+        result.failure = "cannot stat " + path + ": " + strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    if (0 == st.st_size)
+    {
+        ::close(fd);
+        return true;
+    }
+
+    void* data = ::mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (MAP_FAILED == data)
+    {
+        result.failure = "cannot map " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    ::madvise(data, st.st_size, MADV_SEQUENTIAL);
+    load((const char*) data, st.st_size, result);
+    ::munmap(data, st.st_size);
+    return true;
+}
+
+void BulkFileLoader::load(const char* data, size_t length, BulkFileResult& result)
+{
+    result = BulkFileResult();
+
+    int concurrency = _options.concurrency > 0 ? _options.concurrency : 1;
+    BlockingQueue<Slice> queue(_options.queue_depth > 0 ? _options.queue_depth : concurrency);
+    _queue = &queue;
+    _result = &result;
+
+    std::vector<pthread_t> threads;
+    for (int i = 0; i < concurrency; ++i)
+    {
+        pthread_t thread;
+        if (0 == pthread_create(&thread, NULL, senderThread, this))
+            threads.push_back(thread);
+    }
+
+    if (threads.empty())
+    {
+        result.failure = "cannot create sender threads";
+        _queue = NULL;
+        _result = NULL;
+        return;
+    }
+
+    const char* end = data + length;
+    const char* p = data;
+    Slice slice;
+    slice.data = data;
+    slice.first_action = 0;
+    size_t actions = 0;
+    uint64_t total = 0;
+
+    while (p < end)
+    {
+        const char* eol = lineEnd(p, end);
+        if (isBlank(p, eol))
+        {
+            p = eol < end ? eol + 1 : end;
+            continue;
+        }
+
+        // the action line, then its document unless it is a delete
+        const char* next = eol < end ? eol + 1 : end;
+        if (next < end && !isDelete(p, eol))
+        {
+            eol = lineEnd(next, end);
+            next = eol < end ? eol + 1 : end;
+        }
+
+        if (actions > 0 && ((size_t) (next - slice.data) > _options.max_bytes
+                            || (_options.max_actions > 0 && actions >= _options.max_actions)))
+        {
+            slice.length = p - slice.data;
+            slice.newline = false;
+            queue.put(slice);
+
+            slice.data = p;
+            slice.first_action = total;
+            actions = 0;
+        }
+
+        ++actions;
+        ++total;
+        p = next;
+    }
+
+    if (actions > 0)
+    {
+        slice.length = end - slice.data;
+        slice.newline = '\n' != end[-1];
+        queue.put(slice);
+    }
+
+    queue.close();
+    for (size_t i = 0; i < threads.size(); ++i)
+        pthread_join(threads[i], NULL);
+
+    result.actions = total;
+
+    _queue = NULL;
+    _result = NULL;
+}
+
+void* BulkFileLoader::senderThread(void* arg)
+{
+    BulkFileLoader* loader = (BulkFileLoader*) arg;
+
+    Slice slice;
+    while (loader->_queue->take(slice))
+        loader->send(slice);
+
+    return NULL;
+}
+
+void BulkFileLoader::send(const Slice& slice)
+{
+    // ES wants the body to end with a newline, add it without copying
+    struct iovec iov[2];
+    iov[0].iov_base = (void*) slice.data;
+    iov[0].iov_len = slice.length;
+    iov[1].iov_base = (void*) "\n";
+    iov[1].iov_len = 1;
+
+    std::vector<BulkItemError> errors;
+    std::string failure;
+    bool ok = false;
+    try
+    {
+        ok = _es.bulk(BodySource(iov, slice.newline ? 2 : 1), errors);
+        if (!ok && errors.empty())
+            failure = "bulk request failed";
+    }
+    catch (Exception& e)
+    {
+        failure = e.what();
+    }
+
+    MutexLockGuard lock(_mutex);
+    BulkFileResult& result = *_result;
+    ++result.requests;
+    result.bytes += slice.length + (slice.newline ? 1 : 0);
+
+    if (!failure.empty())
+    {
+        ++result.failed_requests;
+        if (result.failure.empty())
+            result.failure = failure;
+        return;
+    }
+
+    result.failed_actions += errors.size();
+    for (size_t i = 0; i < errors.size() && result.errors.size() < _options.max_errors; ++i)
+    {
+        result.errors.push_back(errors[i]);
+        result.errors.back().position += (int) slice.first_action;
+    }
+}
+
+} // end namespace
@@ -0,0 +1,109 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _BULK_FILE_HEADER_H_
+#define _BULK_FILE_HEADER_H_
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "ElasticSearch.h"
+#include "BlockingQueue.h"
+
+namespace cppes {
+
+/*
+ * @brief Configuration of BulkFileLoader.
+ */
+struct BulkFileOptions
+{
+    BulkFileOptions ( )
+    : max_bytes(5 * 1024 * 1024)
+    , max_actions(0)
+    , concurrency(4)
+    , queue_depth(0)
+    , max_errors(1000)
+    {
+    }
+
+    size_t max_bytes;      // body size of one request, an action bigger than it is sent alone
+    size_t max_actions;    // actions of one request, 0 for no limit
+    int concurrency;       // bulk requests in flight
+    size_t queue_depth;    // requests cut ahead of the senders, 0 for concurrency
+    size_t max_errors;     // item errors kept in BulkFileResult::errors
+};
+
+/*
+ * @brief Outcome of BulkFileLoader::load().
+ */
+struct BulkFileResult
+{
+    BulkFileResult ( )
+    : requests(0), actions(0), bytes(0), failed_requests(0), failed_actions(0)
+    , errors(), failure()
+    {
+    }
+
+    bool ok ( ) const { return 0 == failed_requests && 0 == failed_actions; }
+
+    uint64_t requests;          // bulk requests sent
+    uint64_t actions;           // actions of the file
+    uint64_t bytes;             // bytes sent
+    uint64_t failed_requests;   // requests with no usable answer, all their actions are lost
+    uint64_t failed_actions;    // actions the server refused
+    std::vector<BulkItemError> errors;   // refused actions, position counts from the start of the file
+    std::string failure;        // reason of the first failed request
+};
+
+/*
+ * @brief Send a NDJSON _bulk file as fast as disk and network allow.
+ *  The file is memory mapped and cut into requests of at most max_bytes
+ *  on action boundaries; only action lines are looked at, documents are
+ *  sent as they are on disk, without a copy. concurrency threads send
+ *  the requests through the shared ElasticSearch client, and a bounded
+ *  queue stops the cutting when they fall behind.
+ *  One loader runs one load() at a time.
+ */
+class BulkFileLoader
+{
+public:
+    explicit BulkFileLoader ( ElasticSearch& es, const BulkFileOptions& options = BulkFileOptions() );
+
+    /// send the file at path, false if it cannot be mapped, see result.failure
+    bool load ( const std::string& path, BulkFileResult& result );
+
+    /// send NDJSON in memory, which must stay valid during the call
+    void load ( const char* data, size_t length, BulkFileResult& result );
+
+private:
+    /// one bulk request, a range of the file
+    struct Slice
+    {
+        const char* data;
+        size_t length;
+        bool newline;            // the range misses the final newline
+        uint64_t first_action;   // position of its first action in the file
+    };
+
+    static void* senderThread ( void* arg );
+    void send ( const Slice& slice );
+
+    BulkFileLoader ( const BulkFileLoader& );
+    BulkFileLoader& operator= ( const BulkFileLoader& );
+
+    ElasticSearch& _es;
+    const BulkFileOptions _options;
+
+    /// state of the running load, the result is guarded by _mutex
+    BlockingQueue<Slice>* _queue;
+    BulkFileResult* _result;
+    MutexLock _mutex;
+};
+
+} // end namespace
+#endif // _BULK_FILE_HEADER_H_
@@ -8,25 +8,75 @@
 // Location: beijing , china
 /////////////////////////////////////////////////////////////
 #include "ElasticSearch.h"
+#include "JsonScanner.h"
+#include "curl/curl.h"
 #include <iostream>
 #include <sstream>
 #include <cstring>
 #include <cassert>
 #include <locale>
 #include <vector>
+#include <algorithm>
 #include <stdio.h>
+#include <sys/time.h>
 
 namespace cppes {
 
+// Slow log options, debug mode prints to stdout unless a sink is given.
+
+static SlowLogOptions slowLogOptions(const SlowLogOptions& options, bool debug)
+{
+    static StreamSlowLogSink s_stdout(std::cout);
+
+    SlowLogOptions result(options);
+    if (debug && NULL == result.sink)
+        result.sink = &s_stdout;
+
+    return result;
+}
+
+// Strip the trailing '/' of node url.
+
+static std::string urlPrefix(const std::string& node)
+{
+    if (!node.empty() && node[node.length() - 1] == '/')
+        return node.substr(0, node.length() - 1);
+
+    return node;
+}
+
 ElasticSearch::ElasticSearch(const std::string& node, bool readOnly, bool debug)
-: _url_prefix(node)
+: _url_prefix(urlPrefix(node))
 , _http()
 , _readOnly(readOnly)
 , _debug(debug)
+, _keep_metrics(true)
+, _metrics()
+, _tracer(NULL)
+, _slow_log(slowLogOptions(SlowLogOptions(), debug))
+, _filter_path(true)
+, _coalesce(false)
+, _flights()
+, _cache(CacheOptions())
 {
-    if (_url_prefix[_url_prefix.length() - 1] == '/')
-        _url_prefix = _url_prefix.substr(0, _url_prefix.length() - 1);
+    if (!isActive())
+        EXCEPTION("Cannot connect Elasticsearch Node, database is not active.");
+}
 
+ElasticSearch::ElasticSearch(const std::string& node, const ClientOptions& options)
+: _url_prefix(urlPrefix(node))
+, _http(options.http)
+, _readOnly(options.readOnly)
+, _debug(options.debug)
+, _keep_metrics(options.metrics)
+, _metrics(options.metrics)
+, _tracer(options.tracer)
+, _slow_log(slowLogOptions(options.slowLog, options.debug))
+, _filter_path(options.filterPath)
+, _coalesce(options.coalesce)
+, _flights()
+, _cache(options.cache)
+{
     if (!isActive())
         EXCEPTION("Cannot connect Elasticsearch Node, database is not active.");
 }
@@ -35,44 +85,437 @@ ElasticSearch::~ElasticSearch()
 {
 }
 
+// Microseconds since the epoch.
+
+static uint64_t nowMicros()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// Unique id of a traced request in the process.
+
+static uint64_t nextRequestId()
+{
+    static volatile uint64_t s_request_id = 0;
+    return __sync_add_and_fetch(&s_request_id, 1);
+}
+
+/*
+ * Pass the response to the caller's sink, and tell the
+ * tracer when its first bytes arrive.
+ */
+class TracingSink : public ResponseSink
+{
+public:
+    TracingSink ( ResponseSink& output, Tracer* tracer, TraceSpan& span )
+    : _output(output), _tracer(tracer), _span(span), _started(false) { }
+
+    virtual void expect ( size_t length )
+    {
+        firstByte();
+        _output.expect(length);
+    }
+
+    virtual bool write ( const char* data, size_t length )
+    {
+        firstByte();
+        return _output.write(data, length);
+    }
+
+private:
+    void firstByte ( )
+    {
+        if (_started)
+            return;
+
+        _started = true;
+        _span.first_byte_us = nowMicros() - _span.start_us;
+        _tracer->onFirstByte(_span);
+    }
+
+    ResponseSink& _output;
+    Tracer* _tracer;
+    TraceSpan& _span;
+    bool _started;
+};
+
+// Send one request of operation op, keep its metrics and trace it.
+
+int ElasticSearch::call(ApiOperation op, const char* method, const std::string& url, const BodySource& body, ResponseSink& output, CallContext& context)
+{
+    return call(op, method, url, body, output, NULL, context);
+}
+
+int ElasticSearch::call(ApiOperation op, const char* method, const std::string& url, const BodySource& body, std::string& output, CallContext& context)
+{
+    StringSink sink(output);
+    return call(op, method, url, body, sink, &output, context);
+}
+
+int ElasticSearch::call(ApiOperation op, const char* method, const std::string& url, const BodySource& body, ResponseSink& output, const std::string* response, CallContext& context)
+{
+    TraceSpan& span = context.span;
+    span.operation = apiName(op);
+    span.method = method;
+
+    if (NULL != _tracer)
+    {
+        span.url = url.c_str();
+        span.request_id = nextRequestId();
+        span.start_us = nowMicros();
+        _tracer->onStart(span);
+    }
+
+    int ret;
+    if (NULL != _tracer)
+    {
+        TracingSink sink(output, _tracer, span);
+        ret = _http.send(method, url, body, sink, &context);
+    }
+    else
+    {
+        ret = _http.send(method, url, body, output, &context);
+    }
+
+    if (_keep_metrics)
+        _metrics.record(op, context, 0 == ret && context.status_code < 500);
+
+    if (_slow_log.isSlow(context.total_time))
+        _slow_log.record(span.operation, method, url, body, context, response, false);
+
+    if (NULL != _tracer)
+    {
+        span.curl_code = ret;
+        span.status_code = (int) context.status_code;
+        span.total_us = nowMicros() - span.start_us;
+        span.bytes_sent = (uint64_t) context.size_upload;
+        span.bytes_received = (uint64_t) context.size_download;
+        _tracer->onComplete(span);
+    }
+
+    return ret;
+}
+
+int ElasticSearch::fetch(ApiOperation op, const char* method, const std::string& url, const std::string& body, std::string& output, CallContext& context)
+{
+    if (!_coalesce)
+        return call(op, method, url, body, output, context);
+
+    std::string key(method);
+    key += ' ';
+    key += url;
+    key += '\n';
+    key += body;
+
+    bool leader;
+    SingleFlight<Flight>::Call* flight = _flights.join(key, leader);
+    if (!leader)
+    {
+        // the request of the leader is the one traced and measured
+        Flight answer;
+        _flights.wait(flight, answer);
+        output.swap(answer.output);
+        context = answer.context;
+        if (NULL != context.span.url)
+            context.span.url = url.c_str();   // the one of the leader is gone
+        return answer.ret;
+    }
+
+    Flight answer;
+    try
+    {
+        answer.ret = call(op, method, url, body, answer.output, answer.context);
+    }
+    catch (...)
+    {
+        // e.g. from a tracer, the followers must not wait for an answer forever
+        answer.ret = CURLE_ABORTED_BY_CALLBACK;
+        _flights.finish(key, flight, answer);
+        throw;
+    }
+    _flights.finish(key, flight, answer);
+    output.swap(answer.output);
+    context = answer.context;
+    return answer.ret;
+}
+
+// Ask ES to send back only the fields a write checks, the
+// rest (shard info, _index, _type ...) never goes on the wire.
+
+void ElasticSearch::filterResponse(std::ostream& url, char sep, const char* fields) const
+{
+    if (_filter_path)
+        url << sep << "filter_path=" << fields;
+}
+
+// Keep a request whose response was not understood in the slow log.
+
+void ElasticSearch::logFailure(const std::string& url, const BodySource& body, const std::string& output, const CallContext& context)
+{
+    _slow_log.record(context.span.operation, context.span.method, url, body, context, &output, true);
+}
+
+std::vector<SlowRequest> ElasticSearch::slowRequests() const
+{
+    return _slow_log.entries();
+}
+
+CacheStats ElasticSearch::cacheStats() const
+{
+    return _cache.stats();
+}
+
+void ElasticSearch::clearCache()
+{
+    _cache.clear();
+}
+
+void ElasticSearch::forget(const std::string& index, const char* path)
+{
+    if (!_cache.enabled())
+        return;
+
+    _cache.invalidate(index, NULL == path ? std::string() : _url_prefix + "/" + index + "/" + path);
+}
+
+// Parse the response of a call, and trace it.
+
+bool ElasticSearch::parse(const std::string& output, Json::Value& msg, CallContext& context)
+{
+    bool ok = Json::Reader().parse(output, msg);
+    parsed(context);
+    return ok;
+}
+
+void ElasticSearch::parsed(CallContext& context)
+{
+    if (NULL == _tracer)
+        return;
+
+    TraceSpan& span = context.span;
+    span.parse_us = nowMicros() - span.start_us - span.total_us;
+    _tracer->onParsed(span);
+}
+
+MetricsSnapshot ElasticSearch::metrics() const
+{
+    return _metrics.snapshot();
+}
+
 // Test connection with node.
 
 bool ElasticSearch::isActive()
 {
     std::string output;
-    if (0 != _http.get(_url_prefix, output))
+    CallContext context;
+    if (0 != call(API_PING, "GET", _url_prefix, BodySource(), output, context))
         return false;
 
     Json::Value msg;
-    if (Json::Reader().parse(output, msg) && !msg.empty())
+    if (parse(output, msg, context) && !msg.empty())
         return true;
 
-    if (_http.http_status_code() == 200)
+    if (context.status_code == 200)
         return true;
 
     return false;
 }
 
+// Projection of the reads which do not give one.
+
+static const Projection s_full_projection;
+
+// Reason of an index answer with neither _version nor created.
+
+static const char s_index_not_ok[] = "The index returns ok: false.";
+
+// Status of a call which got no usable response, false if it got one.
+
+static bool transportError(int ret, const HttpContext& context, Status& status)
+{
+    status.http_status = context.status_code;
+    if (0 == ret)
+        return false;
+
+    status.kind = ERR_TRANSPORT;
+    status.curl_code = ret;
+    return true;
+}
+
+// Status of a response with an "error", a string before ES 2.0, an object since.
+
+static void serverError(const Json::Value& msg, Status& status)
+{
+    if (404 == status.http_status)
+        status.kind = ERR_NOT_FOUND;
+    else if (409 == status.http_status)
+        status.kind = ERR_CONFLICT;
+    else
+        status.kind = ERR_SERVER;
+
+    const Json::Value& error = msg["error"];
+    if (error.isObject())
+        status.reason = error.get("reason", "").asString();
+    else if (error.isString())
+        status.reason = error.asString();
+}
+
+// Status of a HEAD request, which has no body to explain a failure.
+
+static void headStatus(Status& status)
+{
+    if (200 == status.http_status)
+        return;
+
+    if (404 == status.http_status)
+    {
+        status.kind = ERR_NOT_FOUND;
+        return;
+    }
+
+    std::ostringstream oss;
+    oss << "Unexpected HTTP status " << status.http_status << " of HEAD request.";
+    status.kind = ERR_SERVER;
+    status.reason = oss.str();
+}
+
+// Status of a response which could not be understood.
+
+static void responseError(const std::string& output, Status& status)
+{
+    status.kind = ERR_RESPONSE;
+    status.reason = output;
+}
+
+// Integer member of a response, -1 if missing. jsoncpp keeps large
+// integers as double, exact up to 2^53.
+
+static long long numberMember(const Json::Value& msg, const char* name)
+{
+    const Json::Value& value = msg[name];
+    return value.isNumeric() ? (long long) value.asDouble() : -1;
+}
+
+DocVersion DocVersion::of(const Json::Value& msg)
+{
+    DocVersion version;
+    if (!msg.isObject())
+        return version;
+
+    version.seq_no = numberMember(msg, "_seq_no");
+    version.primary_term = numberMember(msg, "_primary_term");
+    version.version = numberMember(msg, "_version");
+    return version;
+}
+
+bool DocVersion::same(const DocVersion& other) const
+{
+    if (known() && other.known())
+        return seq_no == other.seq_no && primary_term == other.primary_term;
+
+    return version >= 0 && version == other.version;
+}
+
+char ElasticSearch::appendCondition(std::ostream& url, char sep, const DocVersion& expected)
+{
+    if (!expected.known())
+        return sep;
+
+    url << sep << "if_seq_no=" << expected.seq_no << "&if_primary_term=" << expected.primary_term;
+    return '&';
+}
+
 // Request the document by index/type/id.
 
 bool ElasticSearch::getDocument(const char* index, const char* type, const char* id, Json::Value& msg)
+{
+    return getDocument(index, type, id, s_full_projection, msg);
+}
+
+bool ElasticSearch::getDocument(const char* index, const char* type, const char* id, const Projection& projection, Json::Value& msg)
+{
+    std::string response;
+    Status status = readDocument(index, type, id, projection, msg, &response);
+    if (status.ok())
+        return true;
+
+    if (ERR_TRANSPORT == status.kind)
+        return false;
+
+    EXCEPTION(response);
+    return false;
+}
+
+Status ElasticSearch::tryGetDocument(const char* index, const char* type, const char* id, Json::Value& msg)
+{
+    return tryGetDocument(index, type, id, s_full_projection, msg);
+}
+
+Status ElasticSearch::tryGetDocument(const char* index, const char* type, const char* id, const Projection& projection, Json::Value& msg)
+{
+    return readDocument(index, type, id, projection, msg, NULL);
+}
+
+Status ElasticSearch::readDocument(const char* index, const char* type, const char* id, const Projection& projection, Json::Value& msg, std::string* response)
 {
     std::ostringstream oss;
     oss << _url_prefix << "/" << index << "/" << type << "/" << id;
+    projection.appendTo(oss, '?', "found,error");
+    std::string url = oss.str();
+
+    Status status;
+    uint64_t generation = 0;
+    if (_cache.enabled())
+    {
+        bool stale;
+        if (_cache.get(url, index, msg, &stale) && (!stale || unchanged(index, type, id, msg)))
+        {
+            if (stale)
+                _cache.renew(url);
+            return status;
+        }
+        generation = _cache.generation(index);
+    }
 
     std::string output;
-    int ret = _http.get(oss.str(), output);
-    if (0 != ret)
+    CallContext context;
+    int ret = fetch(API_GET, "GET", url, std::string(), output, context);
+    if (transportError(ret, context, status))
+        return status;
+
+    if (!parse(output, msg, context) || msg.empty())
+        responseError(output, status);
+    else if (msg.isMember("error"))
+        serverError(msg, status);
+    else if (!msg.isMember("found") || !msg["found"].asBool())
+        status.kind = ERR_NOT_FOUND;
+    else
+        _cache.put(url, ResponseCache::DOCUMENT, index, generation, msg, output.size());
+
+    if (!status.ok() && NULL != response)
+        response->swap(output);
+
+    return status;
+}
+
+bool ElasticSearch::unchanged(const char* index, const char* type, const char* id, const Json::Value& cached)
+{
+    std::ostringstream oss;
+    oss << _url_prefix << "/" << index << "/" << type << "/" << id << "?_source=false";
+    filterResponse(oss, '&', "found,_version,_seq_no,_primary_term");
+
+    std::string output;
+    CallContext context;
+    if (0 != fetch(API_GET, "GET", oss.str(), std::string(), output, context) || 200 != context.status_code)
         return false;
 
-    if (!Json::Reader().parse(output, msg) || msg.empty())
-        EXCEPTION(output);
+    Json::Value current;
+    if (!parse(output, current, context) || !current.get("found", false).asBool())
+        return false;
 
-    if( msg.isMember("found") && msg["found"].asBool())
-        return true;
-    
-    EXCEPTION(output);
-    return false;
+    return DocVersion::of(current).same(DocVersion::of(cached));
 }
 
 // Request the document by index/type/ query key:value.
@@ -82,46 +525,69 @@ bool ElasticSearch::getDocument(const std::string& index, const std::string& typ
     /*
      * 查询到的结果与ElasticSearch设置的field属性有关
      */
-    std::stringstream query;
-    query << "{\"query\":{\"match\":{\"" << key << "\":\"" << value << "\"}}}";
-
-    return search(index, type, query.str(), msg);
+    QueryBuilder query;
+    return search(index, type, query.query(matchQuery(key, value)).str(), msg);
 }
 
 /// Delete the document by index/type/id.
 
 bool ElasticSearch::deleteDocument(const char* index, const char* type, const char* id)
 {
+    Status status = tryDeleteDocument(index, type, id);
+    if (status.ok())
+        return true;
+
+    // an unreadable answer throws with it, as it always did
+    if (ERR_RESPONSE == status.kind || (_debug && ERR_TRANSPORT != status.kind && ERR_READ_ONLY != status.kind))
+        EXCEPTION(status.message());
+
+    return false;
+}
+
+Status ElasticSearch::tryDeleteDocument(const char* index, const char* type, const char* id)
+{
+    Status status;
     if (_readOnly)
-        return false;
+    {
+        status.kind = ERR_READ_ONLY;
+        return status;
+    }
 
     std::ostringstream oss;
     oss << _url_prefix << "/" << index << "/" << type << "/" << id;
+    filterResponse(oss, '?', "found,result,error");
     Json::Value msg;
 
     std::string output;
-    int ret = _http.remove(oss.str(), "", output);
-    if (0 != ret)
-        return false;
+    CallContext context;
+    int ret = call(API_DELETE, "DELETE", oss.str(), BodySource(), output, context);
+    forget(index, (std::string(type) + "/" + id).c_str());
+    if (transportError(ret, context, status))
+        return status;
 
-    if (!Json::Reader().parse(output, msg) || msg.empty())
-        EXCEPTION(output);
+    if (!parse(output, msg, context) || msg.empty())
+    {
+        responseError(output, status);
+        return status;
+    }
 
     if (msg.isMember("found") && msg["found"].asBool())
-        return true;
+        return status;
 
     if (msg.isMember("result") && msg["result"].isString() && msg["result"].asString() == "deleted")
-        return true;
+        return status;
 
-    if (_debug)
+    if (msg.isMember("error"))
     {
-        std::cout << "[Request]:(GET)" << oss.str() << std::endl;
-        std::cout << "[Response]:" << output << std::endl;
-        
-        EXCEPTION(output);
+        serverError(msg, status);
+        logFailure(oss.str(), BodySource(), output, context);
+    }
+    else
+    {
+        status.kind = ERR_NOT_FOUND;
     }
 
-    return false;
+    return status;
 }
 
 /// Delete the document by index/type.
@@ -143,11 +609,13 @@ bool ElasticSearch::deleteAll(const char* index, const char* type)
 
     Json::Value msg;
     std::string output;
-    int ret = _http.remove(oss.str(), data.str().c_str(), output);
+    CallContext context;
+    int ret = call(API_DELETE, "DELETE", oss.str(), data.str(), output, context);
+    forget(index, (std::string(type) + "/").c_str());
     if (0 != ret)
         return false;
 
-    if (!Json::Reader().parse(output, msg) || msg.empty())
+    if (!parse(output, msg, context) || msg.empty())
         EXCEPTION(output);
 
     if(msg.isMember("found") && msg["found"].asBool())
@@ -166,160 +634,220 @@ int ElasticSearch::getDocumentCount(const char* index, const char* type)
 
     Json::Value msg;
     std::string output;
-    int ret = _http.get(oss.str(), output);
+    CallContext context;
+    int ret = call(API_COUNT, "GET", oss.str(), BodySource(), output, context);
     if (0 != ret)
         return 0;
 
-    if (!Json::Reader().parse(output, msg) || msg.empty())
+    if (!parse(output, msg, context) || msg.empty())
         EXCEPTION(output);
 
-    size_t count = 0;
-    if (msg.isMember("count") && msg["count"].isInt())
-        count = msg["count"].asInt();
-
-    if (0 == count && _debug)
+    if (!msg.isMember("count") || !msg["count"].isInt())
     {
-        std::cout << "[Request]:(GET)" << oss.str() << std::endl;
-        std::cout << "[Response]:" << output << std::endl;
+        logFailure(oss.str(), BodySource(), output, context);
+        return 0;
     }
 
-    return count;
+    return msg["count"].asInt();
 }
 
 // Test if document exists
 
 bool ElasticSearch::exist(const std::string& index, const std::string& type, const std::string& id)
 {
-    std::stringstream oss;
-    oss << _url_prefix << "/" << index << "/" << type << "/" << id;
+    Status status = tryExist(index, type, id);
+    if (status.ok())
+        return true;
 
-    Json::Value result;
-    std::string output;
-    int ret = _http.get(oss.str(), output);
-    if (0 != ret)
+    if (ERR_NOT_FOUND == status.kind || ERR_TRANSPORT == status.kind)
         return false;
 
-    if (!Json::Reader().parse(output, result) || result.empty())
-        EXCEPTION(output);
+    EXCEPTION(status.message());
+    return false;
+}
 
-    if (!result.isMember("found"))
-    {
-        if (_debug)
-        {
-            std::cout << "[Request]:(GET)" << oss.str() << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+Status ElasticSearch::tryExist(const std::string& index, const std::string& type, const std::string& id)
+{
+    std::stringstream oss;
+    oss << _url_prefix << "/" << index << "/" << type << "/" << id;
 
-        EXCEPTION("Database exception, field \"found\" must exist.");
-    }
+    Status status;
+    DiscardSink output;
+    CallContext context;
+    int ret = call(API_EXIST, "HEAD", oss.str(), BodySource(), output, context);
+    if (transportError(ret, context, status))
+        return status;
 
-    if(result["found"].asBool())
-        return true;
-    
-    //EXCEPTION(output);
-    return false;
+    headStatus(status);
+    return status;
 }
 
 /// Index a document.
 
 bool ElasticSearch::index(const std::string& index, const std::string& type, const std::string& id, const Json::Value& jData)
 {
-    if (_readOnly)
+    bool fatal = false;
+    Status status = putDocument(index, type, id, jData, DocVersion(), NULL, &fatal);
+    if (status.ok())
+        return true;
+
+    if (ERR_TRANSPORT == status.kind || ERR_READ_ONLY == status.kind)
         return false;
 
+    // other failures, an ES 5 error object included, are only errors in debug mode
+    if (fatal || _debug)
+        EXCEPTION(status.message());
+
+    return false;
+}
+
+Status ElasticSearch::tryIndex(const std::string& index, const std::string& type, const std::string& id, const Json::Value& jData)
+{
+    return putDocument(index, type, id, jData, DocVersion(), NULL, NULL);
+}
+
+Status ElasticSearch::tryIndex(const std::string& index, const std::string& type, const std::string& id, const Json::Value& jData, const DocVersion& expected, DocVersion* written)
+{
+    return putDocument(index, type, id, jData, expected, written, NULL);
+}
+
+Status ElasticSearch::putDocument(const std::string& index, const std::string& type, const std::string& id, const Json::Value& jData,
+                                  const DocVersion& expected, DocVersion* written, bool* fatal)
+{
+    Status status;
+    if (_readOnly)
+    {
+        status.kind = ERR_READ_ONLY;
+        return status;
+    }
+
     std::stringstream oss;
     oss << _url_prefix << "/" << index << "/" << type << "/" << id;
+    char sep = appendCondition(oss, '?', expected);
+    filterResponse(oss, sep, "_version,_seq_no,_primary_term,created,error,reason");
 
     std::string data = Json::FastWriter().write(jData);
 
     std::string output;
-    int ret = _http.put(oss.str(), data.c_str(), output);
-    if (0 != ret)
-        return false;
+    CallContext context;
+    int ret = call(API_INDEX, "PUT", oss.str(), data, output, context);
+    forget(index, (type + "/" + id).c_str());
+    if (transportError(ret, context, status))
+        return status;
 
     Json::Value result;
-    if (!Json::Reader().parse(output, result) || result.empty())
-        EXCEPTION(output);
+    if (!parse(output, result, context) || result.empty())
+    {
+        if (NULL != fatal)
+            *fatal = true;
+        responseError(output, status);
+        return status;
+    }
 
     if (result.isMember("reason"))
-        EXCEPTION(result["reason"].asString());
+    {
+        if (NULL != fatal)
+            *fatal = true;
+        status.kind = ERR_SERVER;
+        status.reason = result["reason"].asString();
+        return status;
+    }
 
-    if (result.isMember("error") && result["error"].isString())
-        EXCEPTION(result["error"].asString());
+    if (result.isMember("error"))
+    {
+        if (NULL != fatal)
+            *fatal = !result["error"].isObject();
+        serverError(result, status);
+        return status;
+    }
 
     if (result.isMember("_version") || result.isMember("created"))
-        return true;
-
-    if (_debug)
     {
-        std::cout << "[Request]:(PUT)" << oss.str() << std::endl;
-        std::cout << "[Data]" << Json::FastWriter().write(jData) << std::endl;
-        std::cout << "[Response]:" << output << std::endl;
-
-        EXCEPTION("The index returns ok: false.");
+        if (NULL != written)
+            *written = DocVersion::of(result);
+        return status;
     }
 
-    return false;
+    logFailure(oss.str(), data, output, context);
+
+    status.kind = ERR_RESPONSE;
+    status.reason = s_index_not_ok;
+    return status;
 }
 
 /// Index a document with automatic id creation
 
 std::string ElasticSearch::index(const std::string& index, const std::string& type, const Json::Value& jData)
 {
-    if (_readOnly)
+    std::string id;
+    Status status = tryIndex(index, type, jData, id);
+    if (status.ok())
+        return id;
+
+    if (ERR_TRANSPORT == status.kind || ERR_READ_ONLY == status.kind)
         return "";
 
+    EXCEPTION(status.message());
+    return "";
+}
+
+Status ElasticSearch::tryIndex(const std::string& index, const std::string& type, const Json::Value& jData, std::string& id)
+{
+    Status status;
+    if (_readOnly)
+    {
+        status.kind = ERR_READ_ONLY;
+        return status;
+    }
+
     std::stringstream oss;
     oss << _url_prefix << "/" << index << "/" << type;
+    filterResponse(oss, '?', "_id,error,reason");
 
     std::string data = Json::FastWriter().write(jData);
 
     Json::Value result;
     std::string output;
-    int ret = _http.post(oss.str(), data, output);
-    if (0 != ret)
-        return "";
+    CallContext context;
+    int ret = call(API_INDEX, "POST", oss.str(), data, output, context);
+    forget(index, NULL);
+    if (transportError(ret, context, status))
+        return status;
 
-    if (!Json::Reader().parse(output, result) || result.empty())
-        EXCEPTION(output);
+    if (!parse(output, result, context) || result.empty())
+    {
+        responseError(output, status);
+        return status;
+    }
 
     if (result.isMember("reason"))
     {
-        if (_debug)
-        {
-            std::cout << "[Request]:(POST)" << oss.str() << std::endl;
-            std::cout << "[Data]" << Json::FastWriter().write(jData) << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+        logFailure(oss.str(), data, output, context);
 
-        EXCEPTION(result["reason"].asString());
+        status.kind = ERR_SERVER;
+        status.reason = result["reason"].asString();
+        return status;
     }
 
-    if (result.isMember("error") && result["error"].isString())
+    if (result.isMember("error"))
     {
-        if (_debug)
-        {
-            std::cout << "[Request]:(POST)" << oss.str() << std::endl;
-            std::cout << "[Data]" << Json::FastWriter().write(jData) << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+        logFailure(oss.str(), data, output, context);
 
-        EXCEPTION(result["error"].asString());
+        serverError(result, status);
+        return status;
     }
 
     if (!result.isMember("_id") || !result["_id"].isString())
     {
-        if (_debug)
-        {
-            std::cout << "[Request]:(POST)" << oss.str() << std::endl;
-            std::cout << "[Data]" << Json::FastWriter().write(jData) << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+        logFailure(oss.str(), data, output, context);
 
-        EXCEPTION("The index induces error.");
+        status.kind = ERR_RESPONSE;
+        status.reason = "The index induces error.";
+        return status;
     }
 
-    return result["_id"].asString();
+    id = result["_id"].asString();
+    return status;
 }
 
 // Update a document field.
@@ -331,27 +859,28 @@ bool ElasticSearch::update(const std::string& index, const std::string& type, co
 
     std::stringstream oss;
     oss << _url_prefix << "/" << index << "/" << type << "/" << id << "/_update";
+    filterResponse(oss, '?', "_version,error");
 
-    std::stringstream data;
-    data << "{\"doc\":{\"" << key << "\":\"" << value << "\"}}";
+    std::string data = "{\"doc\":{";
+    appendQuoted(data, key.data(), key.size());
+    data += ':';
+    appendQuoted(data, value.data(), value.size());
+    data += "}}";
 
     Json::Value result;
     std::string output;
-    int ret = _http.post(oss.str(), data.str().c_str(), output);
+    CallContext context;
+    int ret = call(API_UPDATE, "POST", oss.str(), data, output, context);
+    forget(index, (type + "/" + id).c_str());
     if (0 != ret)
         return false;
 
-    if (!Json::Reader().parse(output, result) || result.empty())
+    if (!parse(output, result, context) || result.empty())
         EXCEPTION(output);
 
     if (!result.isMember("_version"))
     {
-        if (_debug)
-        {
-            std::cout << "[Request]:(POST)" << oss.str() << std::endl;
-            std::cout << "[Data]" << data.str() << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+        logFailure(oss.str(), data, output, context);
 
         EXCEPTION("The update failed.");
     }
@@ -368,27 +897,25 @@ bool ElasticSearch::update(const std::string& index, const std::string& type, co
 
     std::stringstream oss;
     oss << _url_prefix << "/" << index << "/" << type << "/" << id << "/_update";
+    filterResponse(oss, '?', "_version,error");
 
     std::stringstream data;
     data << "{\"doc\":" << Json::FastWriter().write(jData) << "}";
 
     Json::Value result;
     std::string output;
-    int ret = _http.post(oss.str(), data.str().c_str(), output);
+    CallContext context;
+    int ret = call(API_UPDATE, "POST", oss.str(), data.str(), output, context);
+    forget(index, (type + "/" + id).c_str());
     if (0 != ret)
         return false;
 
-    if (!Json::Reader().parse(output, result) || result.empty())
+    if (!parse(output, result, context) || result.empty())
         EXCEPTION(output);
 
     if (result.isMember("error"))
     {
-        if (_debug)
-        {
-            std::cout << "[Request]:(POST)" << oss.str() << std::endl;
-            std::cout << "[Data]" << data.str() << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+        logFailure(oss.str(), data.str(), output, context);
 
         EXCEPTION("The update doccument fields failed.");
     }
@@ -396,6 +923,56 @@ bool ElasticSearch::update(const std::string& index, const std::string& type, co
     return true;
 }
 
+Status ElasticSearch::tryUpdate(const std::string& index, const std::string& type, const std::string& id, const Json::Value& jData, const DocVersion& expected, DocVersion* written)
+{
+    Status status;
+    if (_readOnly)
+    {
+        status.kind = ERR_READ_ONLY;
+        return status;
+    }
+
+    std::stringstream oss;
+    oss << _url_prefix << "/" << index << "/" << type << "/" << id << "/_update";
+    char sep = appendCondition(oss, '?', expected);
+    filterResponse(oss, sep, "_version,_seq_no,_primary_term,error");
+
+    std::string data = "{\"doc\":" + Json::FastWriter().write(jData) + "}";
+
+    std::string output;
+    CallContext context;
+    int ret = call(API_UPDATE, "POST", oss.str(), data, output, context);
+    forget(index, (type + "/" + id).c_str());
+    if (transportError(ret, context, status))
+        return status;
+
+    Json::Value result;
+    if (!parse(output, result, context) || result.empty())
+    {
+        responseError(output, status);
+        return status;
+    }
+
+    if (result.isMember("error"))
+    {
+        serverError(result, status);
+        return status;
+    }
+
+    if (!result.isMember("_version"))
+    {
+        logFailure(oss.str(), data, output, context);
+
+        status.kind = ERR_RESPONSE;
+        status.reason = "The update failed.";
+        return status;
+    }
+
+    if (NULL != written)
+        *written = DocVersion::of(result);
+    return status;
+}
+
 // Update or insert if the document does not already exists.
 
 bool ElasticSearch::upsert(const std::string& index, const std::string& type, const std::string& id, const Json::Value& jData)
@@ -405,6 +982,7 @@ bool ElasticSearch::upsert(const std::string& index, const std::string& type, co
 
     std::stringstream oss;
     oss << _url_prefix << "/" << index << "/" << type << "/" << id << "/_update";
+    filterResponse(oss, '?', "_version,error");
 
     std::stringstream data;
     data << "{\"doc\":" << Json::FastWriter().write(jData);
@@ -412,21 +990,18 @@ bool ElasticSearch::upsert(const std::string& index, const std::string& type, co
 
     Json::Value result;
     std::string output;
-    int ret = _http.post(oss.str(), data.str().c_str(), output);
+    CallContext context;
+    int ret = call(API_UPDATE, "POST", oss.str(), data.str(), output, context);
+    forget(index, (type + "/" + id).c_str());
     if (0 != ret)
         return false;
 
-    if (!Json::Reader().parse(output, result) || result.empty())
+    if (!parse(output, result, context) || result.empty())
         EXCEPTION(output);
 
     if (result.isMember("error"))
     {
-        if (_debug)
-        {
-            std::cout << "[Request]:(POST)" << oss.str() << std::endl;
-            std::cout << "[Data]" << data.str() << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+        logFailure(oss.str(), data.str(), output, context);
 
         EXCEPTION("The update doccument fields failed.");
     }
@@ -434,58 +1009,119 @@ bool ElasticSearch::upsert(const std::string& index, const std::string& type, co
     return true;
 }
 
+// Cache key of a search, the query is rewritten without blanks and with
+// sorted members so equal queries share an entry.
+
+static std::string queryKey(const std::string& url, const std::string& query)
+{
+    std::string key(url);
+    key += '\n';
+
+    Json::Value value;
+    if (Json::Reader().parse(query, value, false))
+        key += Json::FastWriter().write(value);
+    else
+        key += query;
+    return key;
+}
+
 /// Search API of ES.
 
 int ElasticSearch::search(const std::string& index, const std::string& type, const std::string& query, Json::Value& result)
+{
+    return search(index, type, query, s_full_projection, result);
+}
+
+int ElasticSearch::search(const std::string& index, const std::string& type, const std::string& query, const Projection& projection, Json::Value& result)
+{
+    Status status = trySearch(index, type, query, projection, result);
+    if (status.ok())
+        return int(result["hits"]["hits"].size());
+
+    if (ERR_TRANSPORT == status.kind)
+        return 0;
+
+    EXCEPTION(status.message());
+    return 0;
+}
+
+Status ElasticSearch::trySearch(const std::string& index, const std::string& type, const std::string& query, Json::Value& result)
+{
+    return trySearch(index, type, query, s_full_projection, result);
+}
+
+Status ElasticSearch::trySearch(const std::string& index, const std::string& type, const std::string& query, const Projection& projection, Json::Value& result)
 {
     std::stringstream oss;
     oss << _url_prefix << "/" << index << "/" << type << "/_search";
+    projection.appendTo(oss, '?', "timed_out,error");
+
+    Status status;
+    std::string key;
+    uint64_t generation = 0;
+    if (_cache.enabled())
+    {
+        key = queryKey(oss.str(), query);
+        if (_cache.get(key, index, result))
+            return status;
+        generation = _cache.generation(index);
+    }
 
     std::string output;
-    int ret = _http.post(oss.str(), query.c_str(), output);
-    if (0 != ret)
-        return 0;
+    CallContext context;
+    int ret = fetch(API_SEARCH, "POST", oss.str(), query, output, context);
+    if (transportError(ret, context, status))
+        return status;
 
-    if (!Json::Reader().parse(output, result) || result.empty())
-        EXCEPTION(output);
+    if (!parse(output, result, context) || result.empty())
+    {
+        responseError(output, status);
+        return status;
+    }
+
+    if (result.isMember("error"))
+    {
+        logFailure(oss.str(), query, output, context);
+
+        serverError(result, status);
+        return status;
+    }
 
     if (!result.isMember("timed_out"))
     {
-        if (_debug)
-        {
-            std::cout << "[Request]:(POST)" << oss.str() << std::endl;
-            std::cout << "[Data]" << query << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+        logFailure(oss.str(), query, output, context);
 
-        EXCEPTION("Search failed.");
+        status.kind = ERR_RESPONSE;
+        status.reason = "Search failed.";
+        return status;
     }
 
     if (result["timed_out"].asBool())
     {
-        if (_debug)
-        {
-            std::cout << "[Request]:(POST)" << oss.str() << std::endl;
-            std::cout << "[Data]" << query << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+        logFailure(oss.str(), query, output, context);
 
-        EXCEPTION("Search timed out.");
+        status.kind = ERR_TIMED_OUT;
+        status.reason = "Search timed out.";
+        return status;
     }
 
+    // filter_path drops "hits" when nothing matched
+    if (!projection.filter_path.empty() && (!result.isMember("hits") || !result["hits"].isMember("hits")))
+        result["hits"]["hits"] = Json::Value(Json::arrayValue);
+
     if (!result.isMember("hits") || !result["hits"].isMember("hits"))
     {
-        if (_debug)
-        {
-            std::cout << "[Request]:(POST)" << oss.str() << std::endl;
-            std::cout << "[Data]" << query << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+        logFailure(oss.str(), query, output, context);
 
-        EXCEPTION("Search reuslt wrong format.");
+        status.kind = ERR_RESPONSE;
+        status.reason = "Search reuslt wrong format.";
+        return status;
     }
 
-    return int(result["hits"]["hits"].size());
+    if (_cache.enabled())
+        _cache.put(key, ResponseCache::QUERY, index, generation, result, output.size());
+
+    return status;
 }
 
 // Test if index exists
@@ -495,26 +1131,47 @@ bool ElasticSearch::existIndex(const std::string& index, Json::Value& result)
     std::ostringstream oss;
     oss << _url_prefix << "/" << index;
 
-    std::string output;
-    int ret = _http.get(oss.str(), output);
-    if (0 != ret)
+    std::string output;
+    CallContext context;
+    int ret = call(API_INDICES, "GET", oss.str(), BodySource(), output, context);
+    if (0 != ret)
+        return false;
+
+    if (!parse(output, result, context) || result.empty())
+    {
+        logFailure(oss.str(), BodySource(), output, context);
+
+        if (_debug)
+            EXCEPTION(output);
+    }
+
+    if (200 == context.status_code)
+        return true;
+    
+    EXCEPTION(output);
+    return false;
+}
+
+bool ElasticSearch::existIndex(const std::string& index)
+{
+    std::ostringstream oss;
+    oss << _url_prefix << "/" << index;
+
+    Status status;
+    DiscardSink output;
+    CallContext context;
+    int ret = call(API_INDICES, "HEAD", oss.str(), BodySource(), output, context);
+    if (transportError(ret, context, status))
         return false;
 
-    if (!Json::Reader().parse(output, result) || result.empty())
-    {
-        if (_debug)
-        {
-            std::cout << "[Request]:(HEAD)" << oss.str() << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
+    headStatus(status);
+    if (status.ok())
+        return true;
 
-            EXCEPTION(output);
-        }
-    }
+    if (status.notFound())
+        return false;
 
-    if (200 == _http.http_status_code())
-        return true;
-    
-    EXCEPTION(output);
+    EXCEPTION(status.message());
     return false;
 }
 
@@ -526,15 +1183,17 @@ bool ElasticSearch::createIndex(const std::string& index, const char* data)
     oss << _url_prefix << "/" << index;
 
     std::string output;
-    int ret = _http.put(oss.str(), std::string(data), output);
+    CallContext context;
+    int ret = call(API_INDICES, "PUT", oss.str(), data, output, context);
+    forget(index, "");
     if (0 != ret)
         return false;
 
     Json::Value result;
-    if (!Json::Reader().parse(output, result) || result.empty())
+    if (!parse(output, result, context) || result.empty())
         EXCEPTION(output);
 
-    if( 200 == _http.http_status_code())
+    if( 200 == context.status_code)
         return true;
     
     EXCEPTION(output);
@@ -549,15 +1208,17 @@ bool ElasticSearch::deleteIndex(const std::string& index)
     oss << _url_prefix << "/" << index;
 
     std::string output;
-    int ret = _http.remove(oss.str(), "", output);
+    CallContext context;
+    int ret = call(API_INDICES, "DELETE", oss.str(), BodySource(), output, context);
+    forget(index, "");
     if (0 != ret)
         return false;
 
     Json::Value result;
-    if (!Json::Reader().parse(output, result) || result.empty())
+    if (!parse(output, result, context) || result.empty())
         EXCEPTION(output);
 
-    if( 200 == _http.http_status_code())
+    if( 200 == context.status_code)
         return true;
     
     EXCEPTION(output);
@@ -571,9 +1232,31 @@ void ElasticSearch::refresh(const std::string& index)
     std::ostringstream oss;
     oss << _url_prefix << "/" << index << "/_refresh";
 
-    Json::Value msg;
-    std::string output;
-    _http.get(oss.str(), output);
+    DiscardSink output;
+    CallContext context;
+    call(API_INDICES, "GET", oss.str(), BodySource(), output, context);
+}
+
+// Add a member to the top level object of a search body.
+
+static std::string addClause(const std::string& query, const std::string& clause)
+{
+    size_t open = query.find('{');
+    if (std::string::npos == open)
+        return "{" + clause + "}";
+
+    size_t next = query.find_first_not_of(" \t\r\n", open + 1);
+    bool empty = std::string::npos == next || '}' == query[next];
+    return query.substr(0, open + 1) + clause + (empty ? "" : ",") + query.substr(open + 1);
+}
+
+// Add a slice clause to a search body, sliced scroll of ES 5.0.
+
+static std::string sliceQuery(const std::string& query, int slice, int slices)
+{
+    std::ostringstream clause;
+    clause << "\"slice\":{\"id\":" << slice << ",\"max\":" << slices << "}";
+    return addClause(query, clause.str());
 }
 
 bool ElasticSearch::initScroll(std::string& scrollId, const std::string& index, const std::string& type, const std::string& query, int scrollSize)
@@ -581,34 +1264,55 @@ bool ElasticSearch::initScroll(std::string& scrollId, const std::string& index,
     std::ostringstream oss;
     oss << _url_prefix << "/" << index << "/" << type << "/_search?scroll=1m&search_type=scan&size=" << scrollSize;
 
+    return openScroll(oss.str(), query, s_full_projection, scrollId, NULL);
+}
+
+// Source filtering needs ES 6, which has no search_type=scan: the first
+// page comes with the scroll id.
+
+bool ElasticSearch::initScroll(std::string& scrollId, const std::string& index, const std::string& type, const std::string& query, const Projection& projection, Json::Value& resultArray, int scrollSize)
+{
+    std::ostringstream oss;
+    oss << _url_prefix << "/" << index << "/" << type << "/_search?scroll=1m&size=" << scrollSize;
+    projection.appendTo(oss, '&', "_scroll_id,error");
+
+    return openScroll(oss.str(), query, projection, scrollId, &resultArray);
+}
+
+bool ElasticSearch::initSlicedScroll(std::string& scrollId, const std::string& index, const std::string& type, const std::string& query, int slice, int slices, Json::Value& resultArray, int scrollSize)
+{
+    std::ostringstream oss;
+    oss << _url_prefix << "/" << index << "/" << type << "/_search?scroll=1m&size=" << scrollSize;
+
+    // _doc order is the cheapest to scroll, unless the query sorts itself
+    std::string body = std::string::npos == query.find("\"sort\"") ? addClause(query, "\"sort\":[\"_doc\"]") : query;
+    if (slices > 1)
+        body = sliceQuery(body, slice, slices);
+
+    return openScroll(oss.str(), body, s_full_projection, scrollId, &resultArray);
+}
+
+bool ElasticSearch::openScroll(const std::string& url, const std::string& query, const Projection& projection, std::string& scrollId, Json::Value* resultArray)
+{
     Json::Value msg;
     std::string output;
-    if (0 != _http.post(oss.str(), query, output))
+    CallContext context;
+    if (0 != call(API_SCROLL_INIT, "POST", url, query, output, context))
         return false;
 
-    if (!Json::Reader().parse(output, msg))
+    if (!parse(output, msg, context))
         EXCEPTION(output);
 
     if (msg.isMember("error") && msg["error"].isString())
     {
-        if (_debug)
-        {
-            std::cout << "[Request]:(POST)" << oss.str() << std::endl;
-            std::cout << "[Data]" << query << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+        logFailure(url, query, output, context);
 
         EXCEPTION(msg["error"].asString());
     }
 
     if (msg.isMember("error") && msg["error"].isObject() && msg["error"].isMember("reason") && msg["error"]["reason"].isString())
     {
-        if (_debug)
-        {
-            std::cout << "[Request]:(POST)" << oss.str() << std::endl;
-            std::cout << "[Data]" << query << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+        logFailure(url, query, output, context);
 
         EXCEPTION(msg["error"]["reason"].asString());
     }
@@ -619,52 +1323,48 @@ bool ElasticSearch::initScroll(std::string& scrollId, const std::string& index,
     }
     else
     {
-        if (_debug)
-        {
-            std::cout << "[Request]:(POST)" << oss.str() << std::endl;
-            std::cout << "[Data]" << query << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+        logFailure(url, query, output, context);
 
         EXCEPTION("scrool response json no filed [_scroll_id]!");
     }
 
+    // filter_path drops "hits" when nothing matched
+    if (NULL != resultArray && (projection.filter_path.empty() || msg.isMember("hits")))
+        appendHitsToArray(msg, *resultArray);
+
     return true;
 }
 
 bool ElasticSearch::scrollNext(std::string& scrollId, Json::Value& resultArray)
+{
+    return scrollNext(scrollId, s_full_projection, resultArray);
+}
+
+bool ElasticSearch::scrollNext(std::string& scrollId, const Projection& projection, Json::Value& resultArray)
 {
     std::ostringstream oss;
     oss << _url_prefix << "/_search/scroll?scroll=1m";
+    projection.appendFilterPath(oss, '&', "_scroll_id,error");
 
     std::string output;
-    if (0 != _http.post(oss.str(), scrollId.c_str(), output))
+    CallContext context;
+    if (0 != call(API_SCROLL_NEXT, "POST", oss.str(), scrollId, output, context))
         return false;
 
     Json::Value msg;
-    if (!Json::Reader().parse(output, msg))
+    if (!parse(output, msg, context))
         EXCEPTION(output);
 
     if (msg.isMember("error") && msg["error"].isString())
     {
-        if (_debug)
-        {
-            std::cout << "[Request]:(POST)" << oss.str() << std::endl;
-            std::cout << "[Data]" << scrollId << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+        logFailure(oss.str(), scrollId, output, context);
 
         EXCEPTION(msg["error"].asString());
     }
 
     if (msg.isMember("error") && msg["error"].isObject() && msg["error"].isMember("reason") && msg["error"]["reason"].isString())
     {
-        if (_debug)
-        {
-            std::cout << "[Request]:(POST)" << oss.str() << std::endl;
-            std::cout << "[Data]" << scrollId << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+        logFailure(oss.str(), scrollId, output, context);
 
         EXCEPTION(msg["error"]["reason"].asString());
     }
@@ -675,6 +1375,10 @@ bool ElasticSearch::scrollNext(std::string& scrollId, Json::Value& resultArray)
     else
         EXCEPTION("scrool response json no filed [_scroll_id]!");
 
+    // filter_path drops "hits" at the end of the scroll
+    if (!projection.filter_path.empty() && !msg.isMember("hits"))
+        return true;
+
     appendHitsToArray(msg, resultArray);
     return true;
 }
@@ -684,20 +1388,33 @@ void ElasticSearch::clearScroll(const std::string& scrollId)
     std::ostringstream oss;
     oss << _url_prefix << "/_search/scroll";
 
-    std::string output;
-    _http.remove(oss.str(), scrollId.c_str(), output);
+    DiscardSink output;
+    CallContext context;
+    call(API_SCROLL_CLEAR, "DELETE", oss.str(), scrollId, output, context);
 }
 
 int ElasticSearch::fullScan(const std::string& index, const std::string& type, const std::string& query, Json::Value& resultArray, int scrollSize)
+{
+    return fullScan(index, type, query, s_full_projection, resultArray, scrollSize);
+}
+
+int ElasticSearch::fullScan(const std::string& index, const std::string& type, const std::string& query, const Projection& projection, Json::Value& resultArray, int scrollSize)
 {
     resultArray.clear();
 
     std::string scrollId;
-    if (!initScroll(scrollId, index, type, query, scrollSize))
+    if (projection.empty())
+    {
+        if (!initScroll(scrollId, index, type, query, scrollSize))
+            return 0;
+    }
+    else if (!initScroll(scrollId, index, type, query, projection, resultArray, scrollSize))
+    {
         return 0;
+    }
 
-    size_t currentSize = 0, newSize;
-    while (scrollNext(scrollId, resultArray))
+    size_t currentSize = resultArray.size(), newSize;
+    while (scrollNext(scrollId, projection, resultArray))
     {
         newSize = resultArray.size();
         if (currentSize == newSize)
@@ -711,6 +1428,362 @@ int ElasticSearch::fullScan(const std::string& index, const std::string& type, c
     return currentSize;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// export
+
+// Append one hit to batch: its raw _source, after an index action in bulk format.
+
+static bool exportHit(JsonScanner& scanner, bool bulkFormat, std::string& batch)
+{
+    if (!scanner.beginObject())
+        return false;
+
+    std::string key, index, type, id;
+    const char* begin = NULL;
+    const char* end = NULL;
+    while (scanner.nextMember(key))
+    {
+        bool ok;
+        if ("_source" == key)
+            ok = scanner.skipValue(&begin, &end);
+        else if (bulkFormat && "_index" == key)
+            ok = scanner.readString(index);
+        else if (bulkFormat && "_type" == key)
+            ok = scanner.readString(type);
+        else if (bulkFormat && "_id" == key)
+            ok = scanner.readString(id);
+        else
+            ok = scanner.skipValue();
+
+        if (!ok)
+            return false;
+    }
+
+    // a hit has no _source if the mapping disabled it
+    if (NULL == begin)
+        return true;
+
+    if (bulkFormat)
+    {
+        batch += "{\"index\":{\"_index\":";
+        batch += Json::valueToQuotedString(index.c_str());
+        batch += ",\"_type\":";
+        batch += Json::valueToQuotedString(type.c_str());
+        batch += ",\"_id\":";
+        batch += Json::valueToQuotedString(id.c_str());
+        batch += "}}\n";
+    }
+
+    batch.append(begin, end);
+    batch += '\n';
+    return true;
+}
+
+// Append the hits of a scroll page to batch and take its scroll id.
+// Return the number of hits, -1 if output is not a page.
+
+static long exportPage(const std::string& output, bool bulkFormat, std::string& batch, std::string& scrollId)
+{
+    JsonScanner scanner(output.data(), output.data() + output.size());
+    if (!scanner.beginObject())
+        return -1;
+
+    long hits = 0;
+    std::string key;
+    while (scanner.nextMember(key))
+    {
+        if ("_scroll_id" == key)
+        {
+            if (!scanner.readString(scrollId))
+                return -1;
+        }
+        else if ("hits" == key)
+        {
+            if (!scanner.beginObject())
+                return -1;
+
+            while (scanner.nextMember(key))
+            {
+                if ("hits" != key)
+                {
+                    if (!scanner.skipValue())
+                        return -1;
+                    continue;
+                }
+
+                if (!scanner.beginArray())
+                    return -1;
+
+                for (; scanner.nextElement(); ++hits)
+                {
+                    if (!exportHit(scanner, bulkFormat, batch))
+                        return -1;
+                }
+            }
+        }
+        else if ("error" == key || !scanner.skipValue())
+        {
+            return -1;
+        }
+    }
+
+    return hits;
+}
+
+struct ElasticSearch::ExportJob
+{
+    ExportJob(const std::string& i, const std::string& t, const std::string& q, ResponseSink& output, const ExportOptions& o)
+    : index(i)
+    , type(t)
+    , query(q)
+    , options(o)
+    , writer(output, o.compress, o.level)
+    , es(NULL)
+    , slice(0)
+    , stop(false)
+    , transport_failed(false)
+    , error()
+    , result()
+    , mutex()
+    {
+    }
+
+    const std::string& index;
+    const std::string& type;
+    const std::string& query;
+    const ExportOptions& options;
+    ExportWriter writer;
+    ElasticSearch* es;
+    volatile int slice;            // next slice to start
+    volatile bool stop;            // a slice failed, the others give up
+
+    /// stop every slice, the export throws with reason
+    void fail(const std::string& reason)
+    {
+        MutexLockGuard lock(mutex);
+        if (error.empty())
+            error = reason;
+        stop = true;
+    }
+
+    // outcome, guarded by mutex
+    bool transport_failed;
+    std::string error;
+    ExportResult result;
+    MutexLock mutex;
+};
+
+bool ElasticSearch::exportDocuments(const std::string& index, const std::string& type, const std::string& query, ResponseSink& output, const ExportOptions& options, ExportResult* result)
+{
+    ExportJob job(index, type, query, output, options);
+    job.es = this;
+
+    int slices = options.slices > 1 ? options.slices : 1;
+    std::vector<pthread_t> threads;
+    for (int i = 1; i < slices; ++i)
+    {
+        pthread_t thread;
+        if (0 == pthread_create(&thread, NULL, exportThread, &job))
+            threads.push_back(thread);
+    }
+
+    // this thread takes its share of the slices too
+    exportThread(&job);
+    for (size_t i = 0; i < threads.size(); ++i)
+        pthread_join(threads[i], NULL);
+
+    job.result.bytes_written = job.writer.bytes();
+    if (NULL != result)
+        *result = job.result;
+
+    if (!job.error.empty())
+        EXCEPTION(job.error);
+
+    return !job.transport_failed && !job.writer.failed();
+}
+
+void* ElasticSearch::exportThread(void* arg)
+{
+    ExportJob* job = (ExportJob*) arg;
+    int slices = job->options.slices > 1 ? job->options.slices : 1;
+
+    // a throwing sink, or anything else, must neither end the process from
+    // a thread nor leave exportDocuments() before the threads are joined
+    int slice;
+    while (!job->stop && (slice = __sync_fetch_and_add(&job->slice, 1)) < slices)
+    {
+        try
+        {
+            job->es->exportSlice(*job, slice);
+        }
+        catch (std::exception& e)
+        {
+            job->fail(e.what());
+        }
+        catch (...)
+        {
+            job->fail("export slice failed");
+        }
+    }
+
+    return NULL;
+}
+
+void ElasticSearch::exportSlice(ExportJob& job, int slice)
+{
+    const ExportOptions& options = job.options;
+    const char* fields = options.bulk_format
+        ? "_scroll_id,error,hits.hits._index,hits.hits._type,hits.hits._id,hits.hits._source"
+        : "_scroll_id,error,hits.hits._source";
+
+    // filter_path of the projection would drop the fields read here
+    Projection projection(options.projection);
+    projection.filter_path.clear();
+
+    std::ostringstream oss;
+    oss << _url_prefix << "/" << job.index << "/" << job.type << "/_search?scroll=" << options.keep_alive
+        << "&size=" << options.scroll_size;
+    projection.appendTo(oss, '&', NULL);
+    filterResponse(oss, '&', fields);
+
+    std::string url = oss.str();
+    std::string body = options.slices > 1 ? sliceQuery(job.query, slice, options.slices) : job.query;
+    ApiOperation op = API_SCROLL_INIT;
+
+    std::string batch, scrollId;
+    while (!job.stop)
+    {
+        std::string output;
+        CallContext context;
+        if (0 != call(op, "POST", url, body, output, context))
+        {
+            MutexLockGuard lock(job.mutex);
+            job.transport_failed = true;
+            job.stop = true;
+            break;
+        }
+
+        size_t before = batch.size();
+        long hits = exportPage(output, options.bulk_format, batch, scrollId);
+        parsed(context);
+
+        if (hits < 0 || 200 != context.status_code)
+        {
+            logFailure(url, body, output, context);
+            batch.resize(before);
+
+            Status status;
+            Json::Value msg;
+            status.http_status = context.status_code;
+            if (Json::Reader().parse(output, msg) && msg.isObject() && msg.isMember("error"))
+                serverError(msg, status);
+            else
+                status.reason = output;
+
+            job.fail(status.message());
+            break;
+        }
+
+        {
+            MutexLockGuard lock(job.mutex);
+            job.result.documents += hits;
+            job.result.pages += 1;
+            job.result.bytes_read += output.size();
+        }
+
+        if (batch.size() >= options.batch_bytes)
+        {
+            if (!job.writer.write(batch))
+            {
+                job.stop = true;
+                break;
+            }
+            batch.clear();
+        }
+
+        if (0 == hits || scrollId.empty())
+            break;
+
+        if (API_SCROLL_INIT == op)
+        {
+            std::ostringstream next;
+            next << _url_prefix << "/_search/scroll?scroll=" << options.keep_alive;
+            filterResponse(next, '&', fields);
+            url = next.str();
+            op = API_SCROLL_NEXT;
+        }
+        body = scrollId;
+    }
+
+    if (!job.stop && !job.writer.write(batch))
+        job.stop = true;
+
+    if (!scrollId.empty())
+        clearScroll(scrollId);
+}
+
+// Request many documents of index/type by id in one round trip.
+
+int ElasticSearch::mget(const std::string& index, const std::string& type, const std::vector<std::string>& ids, Json::Value& docs)
+{
+    return mget(index, type, ids, s_full_projection, docs);
+}
+
+int ElasticSearch::mget(const std::string& index, const std::string& type, const std::vector<std::string>& ids, const Projection& projection, Json::Value& docs)
+{
+    docs = Json::Value(Json::arrayValue);
+    if (ids.empty())
+        return 0;
+
+    std::ostringstream oss;
+    oss << _url_prefix << "/" << index << "/" << type << "/_mget";
+    projection.appendTo(oss, '?', "docs._id,docs.found,docs.error,error");
+
+    Json::Value body;
+    Json::Value& array = body["ids"];
+    for (size_t i = 0; i < ids.size(); ++i)
+        array.append(ids[i]);
+
+    std::string data = Json::FastWriter().write(body);
+
+    std::string output;
+    CallContext context;
+    if (0 != call(API_MGET, "POST", oss.str(), data, output, context))
+        return 0;
+
+    Json::Value msg;
+    if (!parse(output, msg, context) || msg.empty())
+        EXCEPTION(output);
+
+    if (msg.isMember("error"))
+    {
+        logFailure(oss.str(), data, output, context);
+
+        Status status;
+        status.http_status = context.status_code;
+        serverError(msg, status);
+        EXCEPTION(status.message());
+    }
+
+    if (!msg.isMember("docs") || !msg["docs"].isArray())
+    {
+        logFailure(oss.str(), data, output, context);
+
+        EXCEPTION("Mget result wrong format.");
+    }
+
+    docs.swap(msg["docs"]);
+
+    int found = 0;
+    for (size_t i = 0; i < docs.size(); ++i)
+    {
+        if (docs[i].get("found", false).asBool())
+            ++found;
+    }
+
+    return found;
+}
+
 void ElasticSearch::appendHitsToArray(const Json::Value& msg, Json::Value& resultArray)
 {
     if (!msg.isMember("hits"))
@@ -736,30 +1809,150 @@ bool ElasticSearch::bulk(const char* data, Json::Value& jResult)
     std::ostringstream oss;
     oss << _url_prefix << "/_bulk";
 
-    Json::Value msg;
     std::string output;
-    if (0 != _http.post(oss.str(), std::string(data), output))
+    CallContext context;
+    int ret = call(API_BULK, "POST", oss.str(), data, output, context);
+
+    // any document may have changed
+    _cache.clear();
+
+    if (0 != ret)
         return false;
 
-    if (!Json::Reader().parse(output, jResult))
+    if (!parse(output, jResult, context))
     {
-        if (_debug)
-        {
-            std::cout << "[Request]:(POST)" << oss.str() << std::endl;
-            std::cout << "[Data]:" << data << std::endl;
-            std::cout << "[Response]:" << output << std::endl;
-        }
+        logFailure(oss.str(), data, output, context);
 
         EXCEPTION(output);
     }
 
-    if( 200 == _http.http_status_code())
+    if( 200 == context.status_code)
         return true;
     
     EXCEPTION(output);
     return false;    
 }
 
+// Collect the failed items of a bulk response.
+
+static bool parseBulkItems(JsonScanner& scanner, std::vector<BulkItemError>& errors)
+{
+    if (!scanner.beginArray())
+        return false;
+
+    static const char errorKey[] = "\"error\"";
+    for (int position = 0; scanner.nextElement(); ++position)
+    {
+        const char* begin;
+        const char* end;
+        if (!scanner.skipValue(&begin, &end))
+            return false;
+
+        // only the failed items are worth a DOM
+        if (end == std::search(begin, end, errorKey, errorKey + sizeof (errorKey) - 1))
+            continue;
+
+        Json::Value item;
+        if (!Json::Reader().parse(begin, end, item, false) || !item.isObject() || item.empty())
+            return false;
+
+        const Json::Value& result = item[item.getMemberNames()[0]];
+        if (!result.isMember("error"))
+            continue;
+
+        BulkItemError error;
+        error.position = position;
+        error.status = result.get("status", 0).asInt();
+
+        const Json::Value& reason = result["error"];
+        if (reason.isObject())
+        {
+            error.type = reason.get("type", "").asString();
+            error.reason = reason.get("reason", "").asString();
+        }
+        else
+        {
+            error.reason = reason.asString();
+        }
+
+        errors.push_back(error);
+    }
+
+    return true;
+}
+
+// Bulk API of ES, only the failed items are reported.
+
+bool ElasticSearch::bulk(const char* data, std::vector<BulkItemError>& errors)
+{
+    return bulk(BodySource(data), errors);
+}
+
+bool ElasticSearch::bulk(const BodySource& body, std::vector<BulkItemError>& errors)
+{
+    errors.clear();
+    if (_readOnly)
+        return false;
+
+    std::ostringstream oss;
+    oss << _url_prefix << "/_bulk";
+    filterResponse(oss, '?', "took,errors,items.*.status,items.*.error");
+
+    std::string output;
+    CallContext context;
+    int ret = call(API_BULK, "POST", oss.str(), body, output, context);
+
+    // any document may have changed
+    _cache.clear();
+
+    if (0 != ret)
+        return false;
+
+    if (200 != context.status_code)
+        EXCEPTION(output);
+
+    JsonScanner scanner(output.data(), output.data() + output.size());
+    if (!scanner.beginObject())
+        EXCEPTION(output);
+
+    /*
+     * ES writes "took" and "errors" ahead of "items", so the
+     * common all-success case returns before touching the items.
+     */
+    std::string key;
+    while (scanner.nextMember(key))
+    {
+        if ("errors" == key)
+        {
+            bool hasErrors = true;
+            if (!scanner.readBool(hasErrors))
+                EXCEPTION(output);
+
+            if (!hasErrors)
+            {
+                parsed(context);
+                return true;
+            }
+        }
+        else if ("items" == key)
+        {
+            if (!parseBulkItems(scanner, errors))
+                EXCEPTION(output);
+        }
+        else if (!scanner.skipValue())
+        {
+            EXCEPTION(output);
+        }
+    }
+
+    parsed(context);
+
+    if (!errors.empty())
+        logFailure(oss.str(), body, output, context);
+
+    return errors.empty();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 BulkBuilder::BulkBuilder()
@@ -16,19 +16,94 @@
 #include <iostream>
 #include "Exception.h"
 #include "HttpClient.h"
+#include "Metrics.h"
+#include "Tracer.h"
+#include "SlowLog.h"
+#include "Status.h"
+#include "Projection.h"
+#include "Export.h"
+#include "SingleFlight.h"
+#include "ResponseCache.h"
+#include "Query.h"
 #include "json/json.h"
 
 namespace cppes {
+
+/*
+ * @brief: Failed item of a bulk request, see ElasticSearch::bulk()
+ */
+struct BulkItemError
+{
+    int position;        // position of the action in the bulk request, from 0
+    int status;          // HTTP status code of the item
+    std::string type;    // error type, e.g. version_conflict_engine_exception
+    std::string reason;  // human readable reason of the failure
+};
+
+/*
+ * @brief: Configuration of ElasticSearch, fixed once the client is constructed.
+ */
+struct ClientOptions
+{
+    ClientOptions ( )
+    : http()
+    , readOnly(false)
+    , debug(false)
+    , metrics(true)
+    , tracer(NULL)
+    , slowLog()
+    , filterPath(true)
+    , coalesce(false)
+    , cache()
+    {
+    }
+
+    HttpOptions http;    // transport options
+    bool readOnly;       // all index functions return false
+    bool debug;          // throw on more unexpected responses, print them to stdout
+    bool metrics;        // keep latency and throughput metrics, see metrics(); about 450KB per client
+    Tracer* tracer;      // request lifecycle callbacks, not owned, NULL for none
+    SlowLogOptions slowLog;  // slow and failed requests, see slowRequests()
+    bool filterPath;     // trim write responses to the fields checked, needs ES 1.6 or later
+    bool coalesce;       // concurrent identical getDocument and search share one request
+    CacheOptions cache;  // read cache of getDocument and search, off by default; blind to aliases, see CacheOptions
+};
+
+/*
+ * @brief: Version of a document, as read or written, for optimistic
+ *  concurrency control: a write conditioned on it fails with ERR_CONFLICT
+ *  if the document was written since. seq_no and primary_term need ES 6.7.
+ */
+struct DocVersion
+{
+    DocVersion ( ) : seq_no(-1), primary_term(-1), version(-1) { }
+
+    /// version of a getDocument or write response, fields missing stay -1
+    static DocVersion of ( const Json::Value& msg );
+
+    /// true if a write can be conditioned on it
+    bool known ( ) const { return seq_no >= 0 && primary_term > 0; }
+
+    /// same write, by seq_no and primary_term if both have them, else by version
+    bool same ( const DocVersion& other ) const;
+
+    long long seq_no;
+    long long primary_term;
+    long long version;
+};
     
 /*
  * @brief: API class for elastic search server.
  * @Node: Instance of elastic search on server represented by:
  *    http://url:port
+ * @Thread: One instance can be shared by all threads, every call keeps
+ *    its status on its own stack and the configuration never changes.
  */
 class ElasticSearch
 {
 public:
     ElasticSearch ( const std::string& node, bool readOnly = false,bool debug=false );
+    ElasticSearch ( const std::string& node, const ClientOptions& options );
     ~ElasticSearch ( );
 
     /*
@@ -55,6 +130,14 @@ public:
      */
     bool getDocument ( const char* index, const char* type, const char* id, Json::Value& msg );
 
+    /*
+     * @brief:Request the fields of projection of the document by index/type/id.
+     * @param: projection, [in], Projection , fields the server sends back
+     * @param: msg, [out], Json::Value , projected content of document
+     * @return: true if find, other false
+     */
+    bool getDocument ( const char* index, const char* type, const char* id, const Projection& projection, Json::Value& msg );
+
     /*
      * @brief:Request the document by index/type/ query key:value.
      * @param: index, [in], string , index of document
@@ -153,6 +236,24 @@ public:
      */
     int search ( const std::string& index, const std::string& type, const std::string& query, Json::Value& result );
 
+    /*
+     * @brief: Search API of ElasticSearch, the hits carry only the fields of projection.
+     * @param: projection, [in], Projection , fields the server sends back
+     * @return: result count which find .
+     */
+    int search ( const std::string& index, const std::string& type, const std::string& query, const Projection& projection, Json::Value& result );
+
+    /*
+     * @brief: Request many documents by id in one round trip (_mget).
+     * @param: index, [in], string , index of documents
+     * @param: type, [in], string , type of documents
+     * @param: ids, [in], std::vector<std::string> , ids of documents
+     * @param: docs, [out], Json::Value , one entry per id in the same order, see "found"
+     * @return: number of documents found
+     */
+    int mget ( const std::string& index, const std::string& type, const std::vector<std::string>& ids, Json::Value& docs );
+    int mget ( const std::string& index, const std::string& type, const std::vector<std::string>& ids, const Projection& projection, Json::Value& docs );
+
     /*
      * @brief: Bulk API
      * @param: data, [in], string , content of data
@@ -161,6 +262,96 @@ public:
      */
     bool bulk ( const char* data, Json::Value& jResult );
 
+    /*
+     * @brief: Bulk API which only reports the failed items. The response is
+     *  scanned without building a Json::Value, and the items array is not
+     *  walked at all when the top level "errors" is false.
+     * @param: data, [in], string , content of data
+     * @param: errors, [out], vector , failed items, empty if all items success
+     * @return: true if all items success, other false
+     */
+    bool bulk ( const char* data, std::vector<BulkItemError>& errors );
+
+    /*
+     * @brief: Bulk API on a body which is referenced and never copied, such
+     *  as pointer+length, a chain of buffers or a pull callback.
+     * @param: body, [in], BodySource , content of data
+     * @param: errors, [out], vector , failed items, empty if all items success
+     * @return: true if all items success, other false
+     */
+    bool bulk ( const BodySource& body, std::vector<BulkItemError>& errors );
+
+public:
+    /*
+     * Non-throwing API for hot paths: failures, misses included, are
+     * reported in the returned Status without building an Exception.
+     * The functions above are thin wrappers which throw on the same Status,
+     * keeping their old contract: getDocument throws with the response,
+     * index throws on an unreadable answer, a top level reason or an error
+     * string, and returns false on an error object or an answer without
+     * _version unless debug; deleteDocument throws on an unreadable answer.
+     */
+
+    /*
+     * @brief: Request the document by index/type/id.
+     * @param: msg, [out], Json::Value , content of document
+     * @return: Status , ERR_NOT_FOUND if the document or index is missing
+     */
+    Status tryGetDocument ( const char* index, const char* type, const char* id, Json::Value& msg );
+    Status tryGetDocument ( const char* index, const char* type, const char* id, const Projection& projection, Json::Value& msg );
+
+    /*
+     * @brief: Test if document exists, with a HEAD request decided on the
+     *  status code alone, the document itself is not transferred.
+     * @return: Status , ok if it exists, ERR_NOT_FOUND if not
+     */
+    Status tryExist ( const std::string& index, const std::string& type, const std::string& id );
+
+    /*
+     * @brief: Index a document.
+     * @return: Status , ERR_SERVER with the reason if ES refused it
+     */
+    Status tryIndex ( const std::string& index, const std::string& type, const std::string& id, const Json::Value& jData );
+
+    /*
+     * @brief: Index a document if it was not written since expected, with
+     *  if_seq_no and if_primary_term.
+     * @param: expected, [in], DocVersion , e.g. DocVersion::of() the document read, unconditional if not known()
+     * @param: written, [out], DocVersion , version of the write, may be NULL
+     * @return: Status , ERR_CONFLICT if the document changed
+     */
+    Status tryIndex ( const std::string& index, const std::string& type, const std::string& id, const Json::Value& jData, const DocVersion& expected, DocVersion* written = NULL );
+
+    /*
+     * @brief: Update document fields if it was not written since expected.
+     * @param: jData, [in], Json::Value , fields to set
+     * @param: expected, [in], DocVersion , unconditional if not known()
+     * @param: written, [out], DocVersion , version of the write, may be NULL
+     * @return: Status , ERR_CONFLICT if the document changed, ERR_NOT_FOUND if it is missing
+     */
+    Status tryUpdate ( const std::string& index, const std::string& type, const std::string& id, const Json::Value& jData, const DocVersion& expected, DocVersion* written = NULL );
+
+    /*
+     * @brief: Index a document with automatic id creation.
+     * @param: id, [out], string , id given by ES
+     * @return: Status
+     */
+    Status tryIndex ( const std::string& index, const std::string& type, const Json::Value& jData, std::string& id );
+
+    /*
+     * @brief: Delete the document by index/type/id.
+     * @return: Status , ERR_NOT_FOUND if there was no such document
+     */
+    Status tryDeleteDocument ( const char* index, const char* type, const char* id );
+
+    /*
+     * @brief: Search API of ElasticSearch.
+     * @param: result, [out], Json::Value , response of ES, hits in result["hits"]["hits"]
+     * @return: Status , ERR_TIMED_OUT if the search timed out
+     */
+    Status trySearch ( const std::string& index, const std::string& type, const std::string& query, Json::Value& result );
+    Status trySearch ( const std::string& index, const std::string& type, const std::string& query, const Projection& projection, Json::Value& result );
+
 public:
 
     /*
@@ -171,6 +362,14 @@ public:
      */
     bool existIndex ( const std::string& index, Json::Value& result );
 
+    /*
+     * @brief: Test if index exists, with a HEAD request which transfers
+     *  nothing but the status.
+     * @param: index, [in], string , index name
+     * @return: true if exists, false if not or on transport failure
+     */
+    bool existIndex ( const std::string& index );
+
     /*
      * @brief: Create index, optionally with data (settings, mappings etc)
      * @param: index, [in], string , index of document
@@ -196,36 +395,182 @@ public:
     /// Initialize a scroll search. Use the returned scroll id when calling scrollNext. Size is based on shardSize. Returns false on error
     bool initScroll ( std::string& scrollId, const std::string& index, const std::string& type, const std::string& query, int scrollSize = 1000 );
 
+    /// Initialize a scroll search with source filtering (ES 6.0), without search_type=scan so the first hits are appended to resultArray. Continue with scrollNext.
+    bool initScroll ( std::string& scrollId, const std::string& index, const std::string& type, const std::string& query, const Projection& projection, Json::Value& resultArray, int scrollSize = 1000 );
+
+    /// Initialize one slice of a sliced scroll (ES 5.0), without search_type=scan so the first hits are appended to resultArray. Continue with scrollNext.
+    /// Hits come in _doc order unless query sorts, and with slices of 1 it is a plain scroll of every match.
+    bool initSlicedScroll ( std::string& scrollId, const std::string& index, const std::string& type, const std::string& query, int slice, int slices, Json::Value& resultArray, int scrollSize = 1000 );
+
     /// Scroll to next matches of an initialized scroll search. scroll_id may be updated. End is reached when resultArray.empty() is true (in which scroll is automatically cleared). Returns false on error.
     bool scrollNext ( std::string& scrollId, Json::Value& resultArray );
 
+    /// Scroll with the same projection as initScroll, its filter_path has to be sent on every page.
+    bool scrollNext ( std::string& scrollId, const Projection& projection, Json::Value& resultArray );
+
     /// Clear an initialized scroll search prior to its automatically 1 minute timeout
     void clearScroll ( const std::string& scrollId );
 
-    /// Perform a scan to get all results from a query.
+    /// Perform a scan to get all results from a query. A projection that is not empty scrolls as the initScroll taking it.
     int fullScan ( const std::string& index, const std::string& type, const std::string& query, Json::Value& resultArray, int scrollSize = 1000 );
+    int fullScan ( const std::string& index, const std::string& type, const std::string& query, const Projection& projection, Json::Value& resultArray, int scrollSize = 1000 );
+
+    /*
+     * @brief: Stream the _source of every document matching query to output
+     *  as NDJSON, one document per line. Sources are copied as they are in
+     *  the scroll responses, never parsed, so memory stays bounded by one
+     *  page and one batch per slice whatever the size of the index.
+     *  Use FdSink for a file descriptor or CallbackSink for a writer.
+     *  Sort the query on "_doc" for the cheapest scroll.
+     * @param: output, [in], ResponseSink , written by one slice at a time
+     * @param: options, [in], ExportOptions , slices, batching, compression
+     * @param: result, [out], ExportResult , counters, may be NULL
+     * @return: false on transport failure or if output refused a write,
+     *  throws if the server refuses the scroll or output throws
+     */
+    bool exportDocuments ( const std::string& index, const std::string& type, const std::string& query, ResponseSink& output, const ExportOptions& options = ExportOptions(), ExportResult* result = NULL );
+
+public:
+    /*
+     * @brief: Client side latency and throughput metrics per operation and
+     *  per node, taken from the timings of every request.
+     * @return: MetricsSnapshot , empty if metrics are disabled
+     */
+    MetricsSnapshot metrics ( ) const;
+
+    /*
+     * @brief: Requests slower than ClientOptions::slowLog.threshold_us, and
+     *  requests whose response was not understood, the oldest first.
+     * @return: std::vector<SlowRequest> , at most slowLog.capacity entries
+     */
+    std::vector<SlowRequest> slowRequests ( ) const;
+
+    /*
+     * @brief: Counters of the read cache set by ClientOptions::cache.
+     * @return: CacheStats , all 0 if the cache is disabled
+     */
+    CacheStats cacheStats ( ) const;
+
+    /*
+     * @brief: Forget every cached response, e.g. after other clients wrote
+     *  documents read through this one.
+     * @return: void
+     */
+    void clearCache ( );
+
+    /*
+     * @brief: Append the hits of a search or scroll response to resultArray.
+     * @param: msg, [in], Json::Value , parsed response
+     * @param: resultArray, [out], Json::Value , array the hits are appended to
+     * @return: void , throws if msg has no hits.hits
+     */
+    static void appendHitsToArray ( const Json::Value& msg, Json::Value& resultArray );
 
 private:
-    
-    ///append the result source content list into array var
-    void appendHitsToArray ( const Json::Value& msg, Json::Value& resultArray );
+
+    /// Status of one call, with its trace span.
+    struct CallContext : public HttpContext
+    {
+        TraceSpan span;
+    };
+
+    /// Send one request of operation op, keep its metrics and trace it.
+    int call ( ApiOperation op, const char* method, const std::string& url, const BodySource& body, ResponseSink& output, CallContext& context );
+    int call ( ApiOperation op, const char* method, const std::string& url, const BodySource& body, std::string& output, CallContext& context );
+    int call ( ApiOperation op, const char* method, const std::string& url, const BodySource& body, ResponseSink& output, const std::string* response, CallContext& context );
+
+    /// Answer of a call, handed by the leader of identical reads to its followers.
+    struct Flight
+    {
+        Flight ( ) : ret(0), context(), output() { }
+
+        int ret;
+        CallContext context;
+        std::string output;
+    };
+
+    /// call() a read, sharing the request of an identical one in flight if coalesce is on.
+    int fetch ( ApiOperation op, const char* method, const std::string& url, const std::string& body, std::string& output, CallContext& context );
+
+    /// Send the first request of a scroll, append its hits if resultArray is not NULL.
+    bool openScroll ( const std::string& url, const std::string& query, const Projection& projection, std::string& scrollId, Json::Value* resultArray );
+
+    /// tryIndex(), and whether index() throws on the failure even out of debug mode into fatal if not NULL.
+    Status putDocument ( const std::string& index, const std::string& type, const std::string& id, const Json::Value& jData,
+                         const DocVersion& expected, DocVersion* written, bool* fatal );
+
+    /// tryGetDocument(), and the response of a failure into response if not NULL.
+    Status readDocument ( const char* index, const char* type, const char* id, const Projection& projection, Json::Value& msg, std::string* response );
+
+    /// True if the document in cached was not written since, asked without its _source.
+    bool unchanged ( const char* index, const char* type, const char* id, const Json::Value& cached );
+
+    /// Append if_seq_no and if_primary_term of expected, return the next separator.
+    static char appendCondition ( std::ostream& url, char sep, const DocVersion& expected );
+
+    /// A write to index went through, path is type/id or type/ under it, "" for all of it, NULL for none.
+    void forget ( const std::string& index, const char* path );
+
+    /// Ask ES to send back only fields, if filterPath is on.
+    void filterResponse ( std::ostream& url, char sep, const char* fields ) const;
+
+    /// Keep a request whose response was not understood in the slow log.
+    void logFailure ( const std::string& url, const BodySource& body, const std::string& output, const CallContext& context );
+
+    /// Parse the response of a call, and trace it.
+    bool parse ( const std::string& output, Json::Value& msg, CallContext& context );
+
+    /// Tell the tracer the response of a call has been parsed.
+    void parsed ( CallContext& context );
+
+    /// State of one exportDocuments(), shared by its slices.
+    struct ExportJob;
+
+    static void* exportThread ( void* arg );
+    void exportSlice ( ExportJob& job, int slice );
 
 private:
     
     /// Private constructor.
     ElasticSearch ();
+    ElasticSearch ( const ElasticSearch& );
+    ElasticSearch& operator= ( const ElasticSearch& );
 
     /// URI withn format http://host:port
-    std::string _url_prefix;
+    const std::string _url_prefix;
     
     /// HTTP Connexion module which using libcurl.
     HttpClient _http;
 
     /// Read Only option, all index functions return false.
-    bool _readOnly;
+    const bool _readOnly;
     
     /// Debug semphore is using if true
-    bool _debug;
+    const bool _debug;
+
+    /// Keep metrics of requests if true
+    const bool _keep_metrics;
+
+    /// Metrics of requests
+    Metrics _metrics;
+
+    /// Tracer of requests, NULL for none
+    Tracer* const _tracer;
+
+    /// Slow and failed requests
+    SlowLog _slow_log;
+
+    /// Trim write responses with filter_path if true
+    const bool _filter_path;
+
+    /// Share the request of identical reads in flight if true
+    const bool _coalesce;
+
+    /// Reads in flight, by method, url and body
+    SingleFlight<Flight> _flights;
+
+    /// Responses of getDocument and search
+    ResponseCache _cache;
 };
 
 /*
@@ -18,22 +18,62 @@ namespace cppes {
     
 using namespace std;
 
+static volatile int s_stack_trace_depth = Exception::MAX_FRAMES;
+
 Exception::Exception( const char *file,const int line,const char* msg)
 : _message(msg)
+, _file(file)
+, _line(line)
+, _depth(0)
+, _stack(NULL)
 {
-    fillStackTrace(file,line);
+    fillStackTrace();
 }
 
 Exception::Exception( const char *file,const int line,const string& msg)
 : _message(msg)
+, _file(file)
+, _line(line)
+, _depth(0)
+, _stack(NULL)
+{
+    fillStackTrace();
+}
+
+// A copy keeps the frames, and symbolizes them again if asked.
+
+Exception::Exception(const Exception& other)
+: std::exception(other)
+, _message(other._message)
+, _file(other._file)
+, _line(other._line)
+, _depth(other._depth)
+, _stack(NULL)
+{
+    for (int i = 0; i < _depth; ++i)
+        _frames[i] = other._frames[i];
+}
+
+Exception& Exception::operator=(const Exception& other)
 {
-    fillStackTrace(file,line);
+    if (this == &other)
+        return *this;
+
+    _message = other._message;
+    _file = other._file;
+    _line = other._line;
+    _depth = other._depth;
+    for (int i = 0; i < _depth; ++i)
+        _frames[i] = other._frames[i];
+
+    delete _stack;
+    _stack = NULL;
+    return *this;
 }
 
 Exception::~Exception() throw ()
 {
-    _message.clear();
-    _stack.clear();
+    delete _stack;
 }
 
 const char* Exception::what() const throw ()
@@ -41,34 +81,62 @@ const char* Exception::what() const throw ()
     return _message.c_str();
 }
 
-const char* Exception::stackTrace() const throw ()
+void Exception::setStackTraceDepth(int depth)
+{
+    if (depth < 0)
+        depth = 0;
+    if (depth > MAX_FRAMES)
+        depth = MAX_FRAMES;
+
+    s_stack_trace_depth = depth;
+}
+
+int Exception::stackTraceDepth()
 {
-    return _stack.c_str();
+    return s_stack_trace_depth;
 }
 
-void Exception::fillStackTrace( const char *file,const int line)
+// Symbolize the captured frames on first use. Threads racing on the first
+// call each build the trace, the first one published is kept.
+
+const char* Exception::stackTrace() const throw ()
 {
-    const int len = 200;
-    void* buffer[len];
-    int nptrs = ::backtrace(buffer, len); 
-    char** strings = ::backtrace_symbols(buffer, nptrs);
+    if (NULL != _stack)
+        return _stack->c_str();
+
+    try
+    {
+        std::stringstream stream;
+        stream << "Exception in file[" << _file << ":" << _line << ":\n";
+
+        char** strings = _depth > 0 ? ::backtrace_symbols(_frames, _depth) : NULL;
+        if (strings)
+        {
+            for (int i = 0; i < _depth; ++i)
+                stream << "\n >>>[" << i << "] " << demangle(strings[i]);
 
-    std::stringstream stream;
-    stream << "Exception in file[" << file << ":" << line << ":\n";
-    _stack.append(stream.str());    
+            free(strings);
+        }
 
-    if (strings)
+        std::string* stack = new std::string(stream.str());
+        if (!__sync_bool_compare_and_swap(&_stack, (std::string*) NULL, stack))
+            delete stack;
+    }
+    catch (...)
     {
-	    for (int i = 0; i < nptrs; ++i)
-	    {
-		    std::stringstream ss;
-		    ss << "\n >>>[" << i << "] ";
-		    _stack.append(ss.str());
-		    _stack.append(demangle(strings[i]));
-	    }
-
-	    free(strings);
+        return "";
     }
+
+    return _stack->c_str();
+}
+
+// Keep the raw return addresses only, symbols are resolved by stackTrace().
+
+void Exception::fillStackTrace()
+{
+    int depth = s_stack_trace_depth;
+    if (depth > 0)
+        _depth = ::backtrace(_frames, depth);
 }
 
 string Exception::demangle(const char* symbol)
@@ -94,4 +162,4 @@ string Exception::demangle(const char* symbol)
     return symbol;
 }
 
-} // end namespace
\ No newline at end of file
+} // end namespace
@@ -14,21 +14,46 @@
 
 namespace cppes {
 
+/*
+ * @brief Exception of the client. Only the raw return addresses are
+ *  captured when it is thrown, they are turned into symbols the first
+ *  time stackTrace() is called, so a caught and ignored exception stays
+ *  cheap. stackTrace() may be called from several threads at once.
+ */
 class Exception : public std::exception
 {
 public:
+    /// frames captured at most, deeper ones are cut (200 when they were symbolized at the throw)
+    enum { MAX_FRAMES = 64 };
+
     explicit Exception ( const char *file,const int line,const char* what );
     explicit Exception (  const char *file,const int line,const std::string& what );
+    Exception ( const Exception& other );
+    Exception& operator= ( const Exception& other );
     virtual ~Exception ( ) throw ( );
     virtual const char* what ( ) const throw ( );
     const char* stackTrace ( ) const throw ( );
 
+    /*
+     * @brief Number of frames captured by every new Exception, from 0
+     *  (no capture, stackTrace() only names the file and line) to
+     *  MAX_FRAMES, the default.
+     */
+    static void setStackTraceDepth ( int depth );
+    static int stackTraceDepth ( );
+
 private:
-    void fillStackTrace ( const char *file,const int line ); //填充栈痕迹
-    std::string demangle ( const char* symbol );
+    void fillStackTrace ( ); //填充栈痕迹
+    static std::string demangle ( const char* symbol );
 
     std::string _message;
-    std::string _stack;
+    const char* _file;
+    int _line;
+    int _depth;
+    void* _frames[MAX_FRAMES];
+
+    /// symbolized trace, built once by the first stackTrace(), NULL before
+    mutable std::string* volatile _stack;
 };
 
 #define EXCEPTION(...) throw Exception(__FILE__, __LINE__, __VA_ARGS__)
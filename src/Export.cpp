@@ -0,0 +1,92 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "Export.h"
+#include "ResponseSink.h"
+#include <zlib.h>
+
+namespace cppes {
+
+// One complete gzip member of input.
+
+static bool gzip(const std::string& input, int level, std::string& output)
+{
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+
+    // 15 + 16: largest window, with gzip header and trailer
+    if (Z_OK != deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY))
+        return false;
+
+    output.resize(deflateBound(&stream, input.size()) + 32);
+    stream.next_in = (Bytef*) input.data();
+    stream.avail_in = input.size();
+    stream.next_out = (Bytef*) &output[0];
+    stream.avail_out = output.size();
+
+    int ret = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    return Z_STREAM_END == ret;
+}
+
+ExportWriter::ExportWriter(ResponseSink& output, bool compress, int level)
+: _output(output)
+, _compress(compress)
+, _level(level)
+, _failed(false)
+, _bytes(0)
+, _mutex()
+{
+}
+
+bool ExportWriter::write(const std::string& batch)
+{
+    if (batch.empty() || _failed)
+        return !_failed;
+
+    std::string compressed;
+    if (_compress && !gzip(batch, _level, compressed))
+    {
+        _failed = true;
+        return false;
+    }
+
+    const std::string& data = _compress ? compressed : batch;
+
+    MutexLockGuard lock(_mutex);
+    if (_failed)
+        return false;
+
+    bool written = false;
+    try
+    {
+        written = _output.write(data.data(), data.size());
+    }
+    catch (...)
+    {
+        // the export reports it, the other slices must not write after it
+        _failed = true;
+        throw;
+    }
+
+    if (!written)
+    {
+        _failed = true;
+        return false;
+    }
+
+    _bytes += data.size();
+    return true;
+}
+
+} // end namespace
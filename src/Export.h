@@ -0,0 +1,91 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _EXPORT_HEADER_H_
+#define _EXPORT_HEADER_H_
+#include <string>
+#include <stdint.h>
+#include "Mutex.h"
+#include "Projection.h"
+
+namespace cppes {
+
+class ResponseSink;
+
+/*
+ * @brief Configuration of ElasticSearch::exportDocuments().
+ */
+struct ExportOptions
+{
+    ExportOptions ( )
+    : scroll_size(1000)
+    , slices(1)
+    , batch_bytes(1024 * 1024)
+    , compress(false)
+    , level(6)
+    , bulk_format(false)
+    , keep_alive("1m")
+    , projection()
+    {
+    }
+
+    int scroll_size;          // hits per scroll page and slice
+    int slices;               // parallel sliced scrolls, more than 1 needs ES 5.0
+    size_t batch_bytes;       // output buffered per slice before a write
+    bool compress;            // write gzip, one member per batch
+    int level;                // zlib compression level
+    bool bulk_format;         // precede every _source with its index action line
+    std::string keep_alive;   // scroll parameter
+    Projection projection;    // _source includes/excludes, filter_path is ignored
+};
+
+/*
+ * @brief Counters of one export.
+ */
+struct ExportResult
+{
+    ExportResult ( ) : documents(0), pages(0), bytes_read(0), bytes_written(0) { }
+
+    uint64_t documents;
+    uint64_t pages;            // scroll responses
+    uint64_t bytes_read;       // response bytes
+    uint64_t bytes_written;    // bytes given to the output, after compression
+};
+
+/*
+ * @brief Serializes the batches of all slices of an export into one
+ *  output. Batches are compressed by the calling thread, as independent
+ *  gzip members which concatenate into a valid gzip file, and only the
+ *  write to the output holds the lock.
+ */
+class ExportWriter
+{
+public:
+    ExportWriter ( ResponseSink& output, bool compress, int level );
+
+    /// write one batch, false once the output refused a write; an exception of the output fails it too
+    bool write ( const std::string& batch );
+
+    bool failed ( ) const        { return _failed; }
+    uint64_t bytes ( ) const     { return _bytes;  }
+
+private:
+    ExportWriter ( const ExportWriter& );
+    ExportWriter& operator= ( const ExportWriter& );
+
+    ResponseSink& _output;
+    const bool _compress;
+    const int _level;
+    volatile bool _failed;
+    uint64_t _bytes;
+    MutexLock _mutex;
+};
+
+} // end namespace
+#endif // _EXPORT_HEADER_H_
@@ -0,0 +1,118 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "HandlePool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <new>
+
+namespace cppes {
+
+/// sequence of threads which have used any pool, gives each its home shard
+static volatile size_t s_thread_count = 0;
+static __thread size_t s_thread_index = (size_t) -1;
+
+HandlePool::HandlePool(size_t capacity, destroy_type destroy)
+: _slots(NULL)
+, _capacity(capacity)
+, _shard_mask(0)
+, _per_shard(0)
+, _extra(0)
+, _stride(0)
+, _destroy(destroy)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t shards = 1;
+    while (shards < (size_t) cpus && shards < MAX_SHARDS && shards < capacity)
+        shards <<= 1;
+
+    _shard_mask = shards - 1;
+    _per_shard = capacity / shards;
+    _extra = capacity % shards;
+
+    // round every shard up to whole cache lines
+    size_t largest = _per_shard + (_extra > 0 ? 1 : 0);
+    _stride = (largest + LINE_SLOTS - 1) / LINE_SLOTS * LINE_SLOTS;
+    if (0 == _stride)
+        _stride = LINE_SLOTS;
+
+    void* memory = NULL;
+    size_t bytes = shards * _stride * sizeof (void*);
+    if (0 != posix_memalign(&memory, 64, bytes))
+        throw std::bad_alloc();
+
+    memset(memory, 0, bytes);
+    _slots = (void* volatile*) memory;
+}
+
+HandlePool::~HandlePool()
+{
+    for (size_t i = 0; i <= _shard_mask; ++i)
+    {
+        void* volatile* slots = shard(i);
+        for (size_t j = 0; j < shardSlots(i); ++j)
+        {
+            if (NULL != slots[j] && NULL != _destroy)
+                _destroy(slots[j]);
+        }
+    }
+
+    free((void*) _slots);
+    _slots = NULL;
+}
+
+size_t HandlePool::homeShard() const
+{
+    if ((size_t) -1 == s_thread_index)
+        s_thread_index = __sync_fetch_and_add(&s_thread_count, 1);
+
+    return s_thread_index & _shard_mask;
+}
+
+void* HandlePool::acquire()
+{
+    size_t home = homeShard();
+
+    // own shard first, then steal from the others
+    for (size_t n = 0; n <= _shard_mask; ++n)
+    {
+        size_t i = (home + n) & _shard_mask;
+        void* volatile* slots = shard(i);
+        for (size_t j = 0; j < shardSlots(i); ++j)
+        {
+            void* handle = slots[j];
+            if (NULL != handle && __sync_bool_compare_and_swap(&slots[j], handle, (void*) NULL))
+                return handle;
+        }
+    }
+
+    return NULL;
+}
+
+bool HandlePool::release(void* handle)
+{
+    size_t home = homeShard();
+
+    // own shard first, then the free slots of the others
+    for (size_t n = 0; n <= _shard_mask; ++n)
+    {
+        size_t i = (home + n) & _shard_mask;
+        void* volatile* slots = shard(i);
+        for (size_t j = 0; j < shardSlots(i); ++j)
+        {
+            if (NULL == slots[j] && __sync_bool_compare_and_swap(&slots[j], (void*) NULL, handle))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+} // end namespace
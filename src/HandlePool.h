@@ -0,0 +1,68 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _HANDLE_POOL_HEADER_H_
+#define _HANDLE_POOL_HEADER_H_
+#include <cstddef>
+
+namespace cppes {
+
+/*
+ * @brief Lock-free pool of idle handles (curl easy handles for HttpClient).
+ *  Idle handles live in per-cpu shards, each starting on its own cache
+ *  line. Every thread is bound to a home shard on first use, so with no
+ *  more threads than cpus checkout and check-in are a single
+ *  compare-and-swap on a line no other thread touches. A thread only goes
+ *  to other shards when its own is empty, or full. The capacity is split
+ *  over the shards, the pool never keeps more idle handles than it; a
+ *  handle refused by every shard is handed back to the caller to destroy.
+ */
+class HandlePool
+{
+public:
+    typedef void ( *destroy_type ) ( void* handle );
+
+    /*
+     * @param capacity, [in], maximum idle handles kept in all shards
+     * @param destroy, [in], function to free handles left at destruction
+     */
+    HandlePool ( size_t capacity, destroy_type destroy );
+    ~HandlePool ( );
+
+    /// Take an idle handle, NULL if there is none.
+    void* acquire ( );
+
+    /// Give back a handle, false if the pool is full and the caller keeps it.
+    bool release ( void* handle );
+
+    size_t capacity ( ) const { return _capacity; }
+
+private:
+    enum { MAX_SHARDS = 64, LINE_SLOTS = 64 / sizeof (void*) };
+
+    size_t homeShard ( ) const;
+
+    /// first slot of shard i, and how many it has
+    void* volatile* shard ( size_t i ) const { return _slots + i * _stride; }
+    size_t shardSlots ( size_t i ) const     { return _per_shard + (i < _extra ? 1 : 0); }
+
+    HandlePool ( const HandlePool& );
+    HandlePool& operator= ( const HandlePool& );
+
+    void* volatile* _slots;
+    const size_t _capacity;
+    size_t _shard_mask;
+    size_t _per_shard;      // slots of every shard
+    size_t _extra;          // shards with one slot more, the remainder of the capacity
+    size_t _stride;         // slots between two shards, a whole number of cache lines
+    destroy_type _destroy;
+};
+
+} // end namespace
+#endif // _HANDLE_POOL_HEADER_H_
@@ -10,24 +10,110 @@
 #include "HttpClient.h"
 #include "curl/curl.h"
 #include <algorithm>
+#include <strings.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 namespace cppes {
 
-HttpClient::HttpClient() 
-:_debug(false)
-,_timeout(120)
-,_ca_path(NULL)
-,_header()
-,_user_passwd("")
-,_http_status_code(0)
+static pthread_once_t s_curl_once = PTHREAD_ONCE_INIT;
+
+static void InitCurlGlobal()
+{
+    // curl_easy_init() would do this lazily, but that is not thread safe
+    curl_global_init(CURL_GLOBAL_ALL);
+}
+
+typedef char curl_lock_data_fits[(int) CURL_LOCK_DATA_LAST <= (int) CurlShare::LOCKS ? 1 : -1];
+
+static void LockShare(CURL*, curl_lock_data data, curl_lock_access, void* userptr)
+{
+    ((MutexLock*) userptr)[data].lock();
+}
+
+static void UnlockShare(CURL*, curl_lock_data data, void* userptr)
 {
+    ((MutexLock*) userptr)[data].unlock();
+}
+
+CurlShare::CurlShare()
+: _share(NULL)
+{
+    pthread_once(&s_curl_once, InitCurlGlobal);
+
+    CURLSH* share = curl_share_init();
+    if (NULL == share)
+        return;
+
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, LockShare);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, UnlockShare);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, (void*) _locks);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+    // connection cache sharing needs libcurl 7.57, older ones refuse it here
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+    _share = share;
+}
+
+CurlShare::~CurlShare()
+{
+    if (NULL != _share)
+        curl_share_cleanup((CURLSH*) _share);
+
+    _share = NULL;
+}
+
+static void DestroyHandle(void* curl)
+{
+    curl_easy_cleanup((CURL*) curl);
+}
+
+HttpClient::HttpClient(const HttpOptions& options) 
+:_options(options)
+,_share()
+,_pool(options.max_idle_handles, DestroyHandle)
+,_multi(NULL)
+{
+    pthread_once(&s_curl_once, InitCurlGlobal);
+
+    // without HTTP/2 the multi handle would only add a thread hop to every
+    // request, keep to the plain easy handles then
+    if (_options.http2 && MultiTransport::multiplexing())
+    {
+        _multi = new MultiTransport();
+        if (!_multi->valid())
+        {
+            delete _multi;
+            _multi = NULL;
+        }
+    }
 }
 
 HttpClient::~HttpClient() 
 {
-    _ca_path = NULL;
-    _header.clear();
-    _user_passwd.clear();
+    delete _multi;
+    _multi = NULL;
+}
+
+void* HttpClient::acquireHandle()
+{
+    void* curl = _pool.acquire();
+    if (NULL != curl)
+        return curl;
+
+    return curl_easy_init();
+}
+
+void HttpClient::releaseHandle(void* curl)
+{
+    // reset options but keep the live connections and dns cache of the handle
+    curl_easy_reset((CURL*) curl);
+
+    if (!_pool.release(curl))
+        curl_easy_cleanup((CURL*) curl);
 }
 
 static int OnDebug(CURL *curl, curl_infotype itype, char * pData, size_t size, void *)
@@ -55,30 +141,71 @@ static int OnDebug(CURL *curl, curl_infotype itype, char * pData, size_t size, v
     return 0;
 }
 
+// The callbacks run inside libcurl, an exception of a sink or of a pull
+// callback must not unwind its C frames: it aborts the transfer instead.
+
 static size_t OnWriteData(void* buffer, size_t size, size_t nmemb, void* lpVoid)
 {
-    std::string* str = dynamic_cast<std::string*> ((std::string *)lpVoid);
-    if (NULL == str || NULL == buffer)
+    ResponseSink* sink = (ResponseSink*) lpVoid;
+    try
     {
-        return -1;
+        if (!sink->write((const char*) buffer, size * nmemb))
+            return 0;
+    }
+    catch (...)
+    {
+        return 0;
     }
 
-    char* pData = (char*) buffer;
-    str->append(pData, size * nmemb);
-    
-    return nmemb;
+    return size * nmemb;
 }
 
-int HttpClient::request(const std::string &method,const std::string &endurl,const std::string &data,std::string& output,const std::string &content_type)
+static size_t OnHeader(void* buffer, size_t size, size_t nmemb, void* lpVoid)
+{
+    static const char name[] = "content-length:";
+    const size_t length = size * nmemb;
+    const char* line = (const char*) buffer;
+
+    //tell the sink how much body follows, so it can reserve once
+    if (length > sizeof (name) - 1 && 0 == strncasecmp(line, name, sizeof (name) - 1))
+    {
+        try
+        {
+            std::string value(line + sizeof (name) - 1, length - (sizeof (name) - 1));
+            ((ResponseSink*) lpVoid)->expect(strtoul(value.c_str(), NULL, 10));
+        }
+        catch (...)
+        {
+            // only a hint
+        }
+    }
+
+    return length;
+}
+
+static size_t OnReadData(char* buffer, size_t size, size_t nmemb, void* lpVoid)
+{
+    BodySource::Reader* reader = (BodySource::Reader*) lpVoid;
+    try
+    {
+        return reader->read(buffer, size * nmemb);
+    }
+    catch (...)
+    {
+        return CURL_READFUNC_ABORT;
+    }
+}
+
+int HttpClient::request(const std::string &method,const std::string &endurl,const BodySource &data,ResponseSink& output,const std::string &content_type,HttpContext *context)
 {
     CURLcode res=CURLE_OK;
-    CURL* curl = curl_easy_init();
+    CURL* curl = (CURL*) acquireHandle();
     if (NULL == curl)
     {
         return CURLE_FAILED_INIT;
     }
     
-    if (_debug)
+    if (_options.debug)
     {
         curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
         curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, OnDebug);
@@ -91,52 +218,99 @@ int HttpClient::request(const std::string &method,const std::string &endurl,cons
     struct curl_slist *headers = NULL;
     std::string type_value=std::string("Content-Type: ")+content_type;
     headers = curl_slist_append(headers,type_value.c_str());
-    if (_header.size() > 0)
+    if (_options.headers.size() > 0)
     {
         header_type::const_iterator it;
-        for (it = _header.begin(); it != _header.end(); it++)
+        for (it = _options.headers.begin(); it != _options.headers.end(); it++)
             headers = curl_slist_append(headers, (it->first+":"+it->second).c_str());
     }
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
     
     //set http request method
+    bool withBody = false;
     if ("GET" == method) {
         curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
     } else if ("HEAD" == method) {
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "HEAD");
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
     } else if ("PUT" == method) {
         curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, data.length());
+        withBody = true;
     } else if ("POST" == method) {
-        curl_easy_setopt(curl, CURLOPT_POST, 1L);
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, data.length());
+        withBody = true;
     } else if ("DELETE" == method) {
         curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
-        if(!data.empty())
-        {
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, data.length());
-        }
+        withBody = !data.empty();
     } else {
         curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method.c_str());
     }
+
+    //set request body, a single buffer is posted in place, others are
+    //pulled by the read callback; unknown length is sent chunked
+    BodySource::Reader reader(data);
+    if (withBody)
+    {
+        curl_easy_setopt(curl, CURLOPT_POST, 1L);
+        if (data.contiguous())
+        {
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.length() > 0 ? data.data() : "");
+        }
+        else
+        {
+            curl_easy_setopt(curl, CURLOPT_READFUNCTION, OnReadData);
+            curl_easy_setopt(curl, CURLOPT_READDATA, (void *) &reader);
+        }
+
+        if (data.length() < 0)
+            headers = curl_slist_append(headers, "Transfer-Encoding: chunked");
+        else
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) data.length());
+
+        //do not wait a round trip for "100 Continue" before sending big bodies
+        headers = curl_slist_append(headers, "Expect:");
+    }
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
     
     //set recv data function callback
-    curl_easy_setopt(curl, CURLOPT_READFUNCTION, NULL);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, OnWriteData);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *) &output);
+
+    //a HEAD response has Content-Length but no body to reserve for
+    if ("HEAD" != method)
+    {
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, OnHeader);
+        curl_easy_setopt(curl, CURLOPT_WRITEHEADER, (void *) &output);
+    }
     
     //set no signal
     curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
+
+    //share dns cache, tls sessions and connections with the other handles,
+    //the multi handle of HTTP/2 mode already shares them by itself
+    //the shared connection cache is sized by the handle using it, libcurl
+    //keeps 5 connections by default and closes the others after each request
+    if (_options.share && NULL != _share.get() && NULL == _multi)
+    {
+        curl_easy_setopt(curl, CURLOPT_SHARE, (CURLSH*) _share.get());
+        if (_options.max_idle_handles > 0)
+            curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, (long) _options.max_idle_handles);
+    }
+
+    //speak HTTP/2 and wait for a stream on a live connection rather than open a new one
+    if (NULL != _multi)
+    {
+#if LIBCURL_VERSION_NUM >= 0x072100
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2_0);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072b00
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+    }
     
     //set CA file path if use https protocol
     std::string temp=endurl;
     std::transform(temp.begin(),temp.end(),temp.begin(),::tolower);
     if(temp.find("https://")!=std::string::npos) 
     {
-        if (NULL == _ca_path) 
+        if (_options.ca_path.empty()) 
         {
             curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, false);
             curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, false);
@@ -144,30 +318,52 @@ int HttpClient::request(const std::string &method,const std::string &endurl,cons
         else 
         {
             curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, true);
-            curl_easy_setopt(curl, CURLOPT_CAINFO, _ca_path);
+            curl_easy_setopt(curl, CURLOPT_CAINFO, _options.ca_path.c_str());
         }
     }
     
     //set connect and read timeout second
-    if (_timeout > 0) 
+    if (_options.timeout > 0) 
     {
         curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10);
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, _timeout);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, _options.timeout);
     }
     
     //set authority user and password if isset
-    if(!_user_passwd.empty())
+    if(!_options.user_passwd.empty())
     {
-        curl_easy_setopt(curl, CURLOPT_USERPWD, _user_passwd.c_str()); 
+        curl_easy_setopt(curl, CURLOPT_USERPWD, _options.user_passwd.c_str()); 
     }
     
     //real send request to http server
-    res = curl_easy_perform(curl);
+    if (NULL != _multi)
+        res = (CURLcode) _multi->perform(curl);
+    else
+        res = curl_easy_perform(curl);
     
     //get http status code if request success
-    if(CURLE_OK==res)
+    if(CURLE_OK==res && NULL!=context)
     {
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE , &_http_status_code); 
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE , &context->status_code); 
+    }
+
+    //get timings and sizes, also of failed requests
+    if(NULL!=context)
+    {
+        char* ip = NULL;
+        curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &context->namelookup_time);
+        curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &context->connect_time);
+        curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME, &context->appconnect_time);
+        curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &context->starttransfer_time);
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &context->total_time);
+        curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD, &context->size_upload);
+        curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &context->size_download);
+        curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &context->num_connects);
+        if (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_PRIMARY_IP, &ip) && NULL != ip)
+        {
+            strncpy(context->primary_ip, ip, sizeof (context->primary_ip) - 1);
+            context->primary_ip[sizeof (context->primary_ip) - 1] = '\0';
+        }
     }
     
     //release and cleanup
@@ -177,7 +373,7 @@ int HttpClient::request(const std::string &method,const std::string &endurl,cons
         headers=NULL;
     }
 
-    curl_easy_cleanup(curl);
+    releaseHandle(curl);
     
     return res;
 }
@@ -11,6 +11,12 @@
 #define __HTTP_CLIENT_HEADER_H__
 #include <string>
 #include <vector>
+#include <map>
+#include "HandlePool.h"
+#include "Mutex.h"
+#include "MultiTransport.h"
+#include "BodySource.h"
+#include "ResponseSink.h"
 #include "json/json.h"
 
 #define _TEXT_PLAIN "text/plain"
@@ -19,12 +25,106 @@
 
 namespace cppes {
 
+typedef std::map<std::string,std::string> header_type;
+
+/*
+ * @brief Configuration of HttpClient, fixed once the client is constructed.
+ */
+struct HttpOptions
+{
+    HttpOptions ( )
+    : timeout(120)
+    , debug(false)
+    , ca_path()
+    , headers()
+    , user_passwd()
+    , max_idle_handles(64)
+    , share(true)
+    , http2(false)
+    {
+    }
+
+    int timeout;                  // request timeout in seconds, <=0 means no timeout
+    bool debug;                   // dump headers and bodies of every request
+    std::string ca_path;          // CA file to verify https peers, empty to skip verification
+    header_type headers;          // extra headers sent with every request
+    std::string user_passwd;      // "user:password" for basic authority
+    size_t max_idle_handles;      // most curl handles kept idle for reuse, spread over per-cpu shards
+    bool share;                   // share dns cache, tls sessions and up to max_idle_handles connections between handles
+    bool http2;                   // multiplex requests as HTTP/2 streams if libcurl supports it, ignored otherwise, as with the bundled 7.19.7 headers
+};
+
+/*
+ * @brief Per-call status of a request. Every caller owns its own context,
+ *  so concurrent requests on one HttpClient never see each other's result.
+ */
+struct HttpContext
+{
+    HttpContext ( )
+    : status_code(0)
+    , namelookup_time(0)
+    , connect_time(0)
+    , appconnect_time(0)
+    , starttransfer_time(0)
+    , total_time(0)
+    , size_upload(0)
+    , size_download(0)
+    , num_connects(0)
+    {
+        primary_ip[0] = '\0';
+    }
+
+    long status_code;             // HTTP status code, 0 if no response received
+
+    // timings in seconds from the start of the request, see curl_easy_getinfo
+    double namelookup_time;       // dns resolved
+    double connect_time;          // tcp connected
+    double appconnect_time;       // tls handshake done, 0 for plain http
+    double starttransfer_time;    // first response byte
+    double total_time;            // whole request
+
+    double size_upload;           // body bytes sent
+    double size_download;         // body bytes received
+    long num_connects;            // new connections opened, 0 if one was reused
+    char primary_ip[48];          // address of the server that answered
+};
+
+/*
+ * @brief Wrapper of a libcurl share handle (CURLSH). The DNS cache, TLS
+ *  session tickets and connection cache put in it are visible to every curl
+ *  handle of one HttpClient, so a handle which meets a closed connection
+ *  resumes the TLS session of its siblings instead of a full handshake.
+ */
+class CurlShare
+{
+public:
+    CurlShare ( );
+    ~CurlShare ( );
+
+    void* get ( ) const { return _share; }
+
+    /// one lock per curl_lock_data
+    enum { LOCKS = 8 };
+
+private:
+    CurlShare ( const CurlShare& );
+    CurlShare& operator= ( const CurlShare& );
+
+    void* _share;
+    MutexLock _locks[LOCKS];
+};
+
+/*
+ * @brief HTTP client based on libcurl. All requests are safe to issue from
+ *  multiple threads on one instance; curl handles (and so their connections)
+ *  are kept in a lock-free HandlePool and reused across calls.
+ */
 class HttpClient
 {
 public:
-    typedef std::map<std::string,std::string> header_type;
-    
-    HttpClient ();
+    typedef cppes::header_type header_type;
+
+    explicit HttpClient ( const HttpOptions& options = HttpOptions() );
     virtual ~HttpClient ();
 
 public:
@@ -32,22 +132,38 @@ public:
      * @brief Generic get request to http server
      * @param url, 输入参数,请求的Url地址,如:http://www.sina.com.cn
      * @param output, 输出参数,HTTP响应的body,
+     * @param context, 输出参数,本次请求的状态,可为NULL
      * @return int,CURL状态码，成功为0
      */
-    inline int get ( const std::string &url, std::string &output )
+    inline int get ( const std::string &url, std::string &output, HttpContext *context = NULL )
+    {
+        StringSink sink ( output );
+        return request ( "GET", url, BodySource(), sink, _APPLICATION_JSON, context );
+    }
+
+    /// Same as above, the response body goes to a ResponseSink instead.
+    inline int get ( const std::string &url, ResponseSink &output, HttpContext *context = NULL )
     {
-        return request ( "GET", url, "", output, _APPLICATION_JSON);
+        return request ( "GET", url, BodySource(), output, _APPLICATION_JSON, context );
     }
    
     /* 
      * @brief Generic head request to http server
      * @param url, 输入参数,请求的Url地址,如:http://www.sina.com.cn
      * @param output, 输出参数,HTTP响应的body,
+     * @param context, 输出参数,本次请求的状态,可为NULL
      * @return int, CURL状态码，成功为0
      */
-    inline int head ( const std::string &url, std::string &output )
+    inline int head ( const std::string &url, std::string &output, HttpContext *context = NULL )
     {
-        return request ( "HEAD", url, "", output , _APPLICATION_JSON);
+        StringSink sink ( output );
+        return request ( "HEAD", url, BodySource(), sink , _APPLICATION_JSON, context );
+    }
+
+    /// Same as above, the response body goes to a ResponseSink instead.
+    inline int head ( const std::string &url, ResponseSink &output, HttpContext *context = NULL )
+    {
+        return request ( "HEAD", url, BodySource(), output, _APPLICATION_JSON, context );
     }
 
     /* 
@@ -57,14 +173,23 @@ public:
      *  (1)key1=value1&key2=value2&...;
      *  (2)JSON格式
      *  (3)XML格式
+     *  body只被引用不被拷贝,可为std::string,指针+长度,iovec或回调
      * @param output, 输出参数,HTTP响应的body,
+     * @param context, 输出参数,本次请求的状态,可为NULL
      * @return int, CURL状态码，成功为0
      */
-    inline int put ( const std::string &url, const std::string &data, std::string &output )
+    inline int put ( const std::string &url, const BodySource &data, std::string &output, HttpContext *context = NULL )
     {
-        return request ( "PUT", url, data, output , _APPLICATION_JSON );
+        StringSink sink ( output );
+        return request ( "PUT", url, data, sink , _APPLICATION_JSON, context );
     } 
 
+    /// Same as above, the response body goes to a ResponseSink instead.
+    inline int put ( const std::string &url, const BodySource &data, ResponseSink &output, HttpContext *context = NULL )
+    {
+        return request ( "PUT", url, data, output, _APPLICATION_JSON, context );
+    }
+
     /* 
      * @brief Generic post request to http server
      * @param url, 输入参数,请求的Url地址,如:http://www.sina.com.cn
@@ -72,12 +197,21 @@ public:
      *  (1)key1=value1&key2=value2&...;
      *  (2)JSON格式
      *  (3)XML格式
+     *  body只被引用不被拷贝,可为std::string,指针+长度,iovec或回调
      * @param output, 输出参数,HTTP响应的body,
+     * @param context, 输出参数,本次请求的状态,可为NULL
      * @return int, CURL状态码，成功为0
      */
-    inline int post ( const std::string &url, const std::string &data, std::string &output )
+    inline int post ( const std::string &url, const BodySource &data, std::string &output, HttpContext *context = NULL )
+    {
+        StringSink sink ( output );
+        return request ( "POST", url, data, sink, _APPLICATION_JSON, context );
+    }
+
+    /// Same as above, the response body goes to a ResponseSink instead.
+    inline int post ( const std::string &url, const BodySource &data, ResponseSink &output, HttpContext *context = NULL )
     {
-        return request ( "POST", url, data, output, _APPLICATION_JSON );
+        return request ( "POST", url, data, output, _APPLICATION_JSON, context );
     }
 
     /* 
@@ -87,12 +221,21 @@ public:
      *  (1)key1=value1&key2=value2&...;
      *  (2)JSON格式
      *  (3)XML格式
+     *  body只被引用不被拷贝,可为std::string,指针+长度,iovec或回调
      * @param output, 输出参数,HTTP响应的body,
+     * @param context, 输出参数,本次请求的状态,可为NULL
      * @return int, CURL状态码，成功为0
      */
-    inline int remove ( const std::string &url,const std::string &data, std::string &output )
+    inline int remove ( const std::string &url,const BodySource &data, std::string &output, HttpContext *context = NULL )
+    {
+        StringSink sink ( output );
+        return request ( "DELETE", url, data, sink ,_APPLICATION_JSON, context );
+    }
+
+    /// Same as above, the response body goes to a ResponseSink instead.
+    inline int remove ( const std::string &url,const BodySource &data, ResponseSink &output, HttpContext *context = NULL )
     {
-        return request ( "DELETE", url, data, output ,_APPLICATION_JSON );
+        return request ( "DELETE", url, data, output, _APPLICATION_JSON, context );
     }
 
     /* 
@@ -102,39 +245,59 @@ public:
      *  (1)key1=value1&key2=value2&...;
      *  (2)JSON格式
      *  (3)XML格式
+     *  body只被引用不被拷贝,可为std::string,指针+长度,iovec或回调
      * @param output, 输出参数,HTTP响应的body,
+     * @param context, 输出参数,本次请求的状态,可为NULL
+     * @return int, CURL状态码，成功为0
+     */
+    inline unsigned int rawpost ( const std::string &url, const BodySource &data, std::string &output, HttpContext *context = NULL )
+    {
+        StringSink sink ( output );
+        return request ( "POST", url, data, sink, _APPLICATION_URLENCODED, context );
+    }
+
+    /* 
+     * @brief Generic request with any method, body and response sink.
+     * @param method, 输入参数,HTTP方法,如:GET,POST
+     * @param url, 输入参数,请求的Url地址
+     * @param data, 输入参数,HTTP请求的body
+     * @param output, 输出参数,HTTP响应的body
+     * @param context, 输出参数,本次请求的状态,可为NULL
      * @return int, CURL状态码，成功为0
      */
-    inline unsigned int rawpost ( const std::string &url, const std::string &data, std::string &output )
+    inline int send ( const std::string &method, const std::string &url, const BodySource &data, ResponseSink &output, HttpContext *context = NULL )
     {
-        return request ( "POST", url, data, output, _APPLICATION_URLENCODED );
+        return request ( method, url, data, output, _APPLICATION_JSON, context );
     }
 
 public:
-    void timeout( int seconds)                          {    _timeout=seconds;      }
-    void debug ( bool use_debug )                       {    _debug=use_debug;      }
-    void set_ca_path(const char *path)                  {    _ca_path=(char *)path; }
-    void set_headers( const header_type &header)        {    _header=header;        }
-    void set_user_passwd( const std::string &userpass)  {    _user_passwd=userpass; }
-    
-    const long http_status_code()                        { return _http_status_code; }
-    const long http_status_code() const                  { return _http_status_code; }
-    
+    const HttpOptions& options ( ) const               {    return _options;       }
+
 protected:
     int request(const std::string &method,
             const std::string &endurl,
-            const std::string &data,
-            std::string& output,
-            const std::string &content_type);
+            const BodySource &data,
+            ResponseSink& output,
+            const std::string &content_type,
+            HttpContext *context);
 
 private:
-    bool _debug;
-    int _timeout;
-    char* _ca_path;
-    header_type _header;
-    std::string _user_passwd;
-    
-    long _http_status_code;
+    void* acquireHandle ( );
+    void releaseHandle ( void* curl );
+
+    HttpClient ( const HttpClient& );
+    HttpClient& operator= ( const HttpClient& );
+
+    const HttpOptions _options;
+
+    /// declared before _pool, the share must outlive every handle using it
+    CurlShare _share;
+
+    /// idle curl handles
+    HandlePool _pool;
+
+    /// event loop of the HTTP/2 mode, NULL in the default one request per connection mode
+    MultiTransport* _multi;
 };
 
 }//end namespace
@@ -0,0 +1,262 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "JsonScanner.h"
+#include <cstring>
+#include <stdlib.h>
+
+namespace cppes {
+
+JsonScanner::JsonScanner(const char* begin, const char* end)
+: _cur(begin)
+, _end(end)
+{
+}
+
+void JsonScanner::skipSpace()
+{
+    while (_cur < _end && (*_cur == ' ' || *_cur == '\t' || *_cur == '\n' || *_cur == '\r'))
+        ++_cur;
+}
+
+bool JsonScanner::skipString()
+{
+    // _cur is on the opening quote
+    for (++_cur; _cur < _end; ++_cur)
+    {
+        if (*_cur == '\\')
+            ++_cur;
+        else if (*_cur == '"')
+        {
+            ++_cur;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JsonScanner::beginObject()
+{
+    skipSpace();
+    if (_cur >= _end || *_cur != '{')
+        return false;
+
+    ++_cur;
+    return true;
+}
+
+bool JsonScanner::nextMember(std::string& key)
+{
+    skipSpace();
+    if (_cur >= _end)
+        return false;
+
+    if (*_cur == '}')
+    {
+        ++_cur;
+        return false;
+    }
+
+    if (*_cur == ',')
+    {
+        ++_cur;
+        skipSpace();
+    }
+
+    if (!readString(key))
+        return false;
+
+    skipSpace();
+    if (_cur >= _end || *_cur != ':')
+        return false;
+
+    ++_cur;
+    return true;
+}
+
+bool JsonScanner::beginArray()
+{
+    skipSpace();
+    if (_cur >= _end || *_cur != '[')
+        return false;
+
+    ++_cur;
+    return true;
+}
+
+bool JsonScanner::nextElement()
+{
+    skipSpace();
+    if (_cur >= _end)
+        return false;
+
+    if (*_cur == ']')
+    {
+        ++_cur;
+        return false;
+    }
+
+    if (*_cur == ',')
+        ++_cur;
+
+    return true;
+}
+
+bool JsonScanner::skipValue(const char** start, const char** stop)
+{
+    skipSpace();
+    if (_cur >= _end)
+        return false;
+
+    const char* begin = _cur;
+    if (*_cur == '"')
+    {
+        if (!skipString())
+            return false;
+    }
+    else if (*_cur == '{' || *_cur == '[')
+    {
+        int depth = 0;
+        while (_cur < _end)
+        {
+            char c = *_cur;
+            if (c == '"')
+            {
+                if (!skipString())
+                    return false;
+                continue;
+            }
+
+            ++_cur;
+            if (c == '{' || c == '[')
+                ++depth;
+            else if ((c == '}' || c == ']') && --depth == 0)
+                break;
+        }
+
+        if (depth != 0)
+            return false;
+    }
+    else
+    {
+        // number, true, false or null
+        while (_cur < _end && NULL == strchr(",}] \t\r\n", *_cur))
+            ++_cur;
+
+        if (_cur == begin)
+            return false;
+    }
+
+    if (start)
+        *start = begin;
+    if (stop)
+        *stop = _cur;
+
+    return true;
+}
+
+bool JsonScanner::readBool(bool& value)
+{
+    skipSpace();
+    if (_end - _cur >= 4 && 0 == strncmp(_cur, "true", 4))
+    {
+        value = true;
+        _cur += 4;
+        return true;
+    }
+
+    if (_end - _cur >= 5 && 0 == strncmp(_cur, "false", 5))
+    {
+        value = false;
+        _cur += 5;
+        return true;
+    }
+
+    return false;
+}
+
+bool JsonScanner::readInt(long& value)
+{
+    const char* begin;
+    const char* stop;
+    if (!skipValue(&begin, &stop) || *begin == '"' || *begin == '{' || *begin == '[')
+        return false;
+
+    std::string number(begin, stop);
+    char* last = NULL;
+    value = strtol(number.c_str(), &last, 10);
+    return last != number.c_str();
+}
+
+bool JsonScanner::readString(std::string& value)
+{
+    skipSpace();
+    if (_cur >= _end || *_cur != '"')
+        return false;
+
+    value.clear();
+    for (++_cur; _cur < _end; ++_cur)
+    {
+        char c = *_cur;
+        if (c == '"')
+        {
+            ++_cur;
+            return true;
+        }
+
+        if (c != '\\')
+        {
+            value += c;
+            continue;
+        }
+
+        if (++_cur >= _end)
+            return false;
+
+        switch (*_cur)
+        {
+            case 'b': value += '\b'; break;
+            case 'f': value += '\f'; break;
+            case 'n': value += '\n'; break;
+            case 'r': value += '\r'; break;
+            case 't': value += '\t'; break;
+            case 'u':
+            {
+                if (_end - _cur < 5)
+                    return false;
+
+                unsigned long code = strtoul(std::string(_cur + 1, 4).c_str(), NULL, 16);
+                _cur += 4;
+
+                // surrogate pairs are not combined, each half is encoded alone
+                if (code < 0x80)
+                {
+                    value += (char) code;
+                }
+                else if (code < 0x800)
+                {
+                    value += (char) (0xC0 | (code >> 6));
+                    value += (char) (0x80 | (code & 0x3F));
+                }
+                else
+                {
+                    value += (char) (0xE0 | (code >> 12));
+                    value += (char) (0x80 | ((code >> 6) & 0x3F));
+                    value += (char) (0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default: value += *_cur; break;
+        }
+    }
+
+    return false;
+}
+
+} // end namespace
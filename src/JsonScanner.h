@@ -0,0 +1,59 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _JSON_SCANNER_HEADER_H_
+#define _JSON_SCANNER_HEADER_H_
+#include <string>
+#include <cstddef>
+
+namespace cppes {
+
+/*
+ * @brief Forward-only cursor over raw JSON text.
+ *  It walks a response without building a Json::Value DOM, so that callers
+ *  can pick out a few members and skip (or slice) everything else.
+ *  All methods return false on malformed input; the cursor is then undefined.
+ */
+class JsonScanner
+{
+public:
+    JsonScanner ( const char* begin, const char* end );
+
+    /// Consume '{' of an object.
+    bool beginObject ( );
+
+    /// Read next member name and its ':', false when the closing '}' is consumed.
+    bool nextMember ( std::string& key );
+
+    /// Consume '[' of an array.
+    bool beginArray ( );
+
+    /// Move to next element, false when the closing ']' is consumed.
+    bool nextElement ( );
+
+    /// Skip over one value, optionally returning the raw span [start, stop).
+    bool skipValue ( const char** start = NULL, const char** stop = NULL );
+
+    bool readBool ( bool& value );
+    bool readInt ( long& value );
+    bool readString ( std::string& value );
+
+    /// Current position in the text.
+    const char* pos ( ) const { return _cur; }
+
+private:
+    void skipSpace ( );
+    bool skipString ( );
+
+    const char* _cur;
+    const char* _end;
+};
+
+} // end namespace
+#endif // _JSON_SCANNER_HEADER_H_
@@ -0,0 +1,304 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "Metrics.h"
+#include "HttpClient.h"
+#include <cstring>
+#include <sched.h>
+
+namespace cppes {
+
+static const char* s_api_names[API_MAX] = {
+    "isActive",
+    "getDocument",
+    "exist",
+    "index",
+    "update",
+    "deleteDocument",
+    "getDocumentCount",
+    "search",
+    "mget",
+    "bulk",
+    "initScroll",
+    "scrollNext",
+    "clearScroll",
+    "indices",
+};
+
+const char* apiName(ApiOperation op)
+{
+    return (op >= 0 && op < API_MAX) ? s_api_names[op] : "unknown";
+}
+
+static inline uint64_t toMicros(double seconds)
+{
+    return seconds > 0 ? (uint64_t) (seconds * 1000000.0) : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+LatencyHistogram::LatencyHistogram()
+: _count(0)
+, _sum(0)
+, _max(0)
+{
+    memset((void*) _buckets, 0, sizeof (_buckets));
+}
+
+int LatencyHistogram::bucketOf(uint64_t value)
+{
+    if (value < LINEAR)
+        return (int) value;
+
+    if (value > 0xFFFFFFFFULL)
+        value = 0xFFFFFFFFULL;
+
+    // keep the 6 top bits: bucket = shift * 32 + (value >> shift), top in [32, 63]
+    int shift = (63 - __builtin_clzll(value)) - 5;
+    return shift * SUB_BUCKETS + (int) (value >> shift);
+}
+
+uint64_t LatencyHistogram::valueOf(int bucket)
+{
+    if (bucket < LINEAR)
+        return bucket;
+
+    int shift = bucket / SUB_BUCKETS - 1;
+    uint64_t top = bucket % SUB_BUCKETS + SUB_BUCKETS;
+
+    // middle of the bucket
+    return (top << shift) + ((1ULL << shift) >> 1);
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+    __sync_fetch_and_add(&_buckets[bucketOf(value)], 1);
+    __sync_fetch_and_add(&_count, 1);
+    __sync_fetch_and_add(&_sum, value);
+
+    uint64_t max = _max;
+    while (value > max && !__sync_bool_compare_and_swap(&_max, max, value))
+        max = _max;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        if (other._buckets[i])
+            __sync_fetch_and_add(&_buckets[i], other._buckets[i]);
+    }
+
+    __sync_fetch_and_add(&_count, other._count);
+    __sync_fetch_and_add(&_sum, other._sum);
+
+    uint64_t max = _max;
+    while (other._max > max && !__sync_bool_compare_and_swap(&_max, max, other._max))
+        max = _max;
+}
+
+double LatencyHistogram::mean() const
+{
+    uint64_t count = _count;
+    return count ? (double) _sum / count : 0.0;
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const
+{
+    uint64_t count = _count;
+    if (0 == count)
+        return 0;
+
+    uint64_t rank = (uint64_t) (percent / 100.0 * count + 0.5);
+    if (rank < 1)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        seen += _buckets[i];
+        if (seen >= rank)
+        {
+            uint64_t value = valueOf(i);
+            return value < _max ? value : _max;
+        }
+    }
+
+    return _max;
+}
+
+static void summarize(const LatencyHistogram& histogram, LatencySummary& out)
+{
+    out.count = histogram.count();
+    out.mean = histogram.mean();
+    out.p50 = histogram.percentile(50);
+    out.p90 = histogram.percentile(90);
+    out.p99 = histogram.percentile(99);
+    out.p999 = histogram.percentile(99.9);
+    out.max = histogram.max();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Metrics::Stats::Stats()
+: requests(0)
+, errors(0)
+, bytes_sent(0)
+, bytes_received(0)
+, new_connections(0)
+, dns_us(0)
+, connect_us(0)
+, tls_us(0)
+, ttfb()
+, total()
+{
+}
+
+void Metrics::Stats::record(const HttpContext& context, bool ok)
+{
+    __sync_fetch_and_add(&requests, 1);
+    if (!ok)
+        __sync_fetch_and_add(&errors, 1);
+
+    __sync_fetch_and_add(&bytes_sent, (uint64_t) context.size_upload);
+    __sync_fetch_and_add(&bytes_received, (uint64_t) context.size_download);
+
+    if (context.num_connects > 0)
+    {
+        __sync_fetch_and_add(&new_connections, 1);
+
+        // curl times are cumulative from the start of the request
+        __sync_fetch_and_add(&dns_us, toMicros(context.namelookup_time));
+        __sync_fetch_and_add(&connect_us, toMicros(context.connect_time - context.namelookup_time));
+        if (context.appconnect_time > 0)
+            __sync_fetch_and_add(&tls_us, toMicros(context.appconnect_time - context.connect_time));
+    }
+
+    ttfb.record(toMicros(context.starttransfer_time));
+    total.record(toMicros(context.total_time));
+}
+
+void Metrics::Stats::snapshot(ApiSnapshot& out) const
+{
+    out.requests = requests;
+    out.errors = errors;
+    out.bytes_sent = bytes_sent;
+    out.bytes_received = bytes_received;
+    out.new_connections = new_connections;
+
+    if (out.requests > 0)
+        out.reuse_rate = 1.0 - (double) out.new_connections / out.requests;
+
+    if (out.new_connections > 0)
+    {
+        out.avg_dns_us = (double) dns_us / out.new_connections;
+        out.avg_connect_us = (double) connect_us / out.new_connections;
+        out.avg_tls_us = (double) tls_us / out.new_connections;
+    }
+
+    summarize(ttfb, out.ttfb);
+    summarize(total, out.total);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Metrics::Metrics(bool enabled)
+: _apis(NULL)
+, _nodes(NULL)
+{
+    if (enabled)
+    {
+        _apis = new Stats[API_MAX];
+        _nodes = new Node[NODE_SLOTS];
+    }
+}
+
+Metrics::~Metrics()
+{
+    delete [] _apis;
+    delete [] _nodes;
+}
+
+Metrics::Stats* Metrics::nodeStats(const char* address)
+{
+    for (int i = 0; i < NODE_SLOTS; ++i)
+    {
+        Node& node = _nodes[i];
+        if (SLOT_READY == node.state)
+        {
+            if (0 == strcmp(node.key, address))
+                return &node.stats;
+            continue;
+        }
+
+        if (SLOT_FREE == node.state && __sync_bool_compare_and_swap(&node.state, SLOT_FREE, SLOT_CLAIMED))
+        {
+            strncpy(node.key, address, NODE_KEY - 1);
+            node.key[NODE_KEY - 1] = '\0';
+            __sync_synchronize();
+            node.state = SLOT_READY;
+            return &node.stats;
+        }
+
+        // another thread is naming this slot, the node may be the same, count it there
+        while (SLOT_CLAIMED == node.state)
+            sched_yield();
+        if (0 == strcmp(node.key, address))
+            return &node.stats;
+    }
+
+    // more nodes than slots, they are only counted per operation
+    return NULL;
+}
+
+void Metrics::record(ApiOperation op, const HttpContext& context, bool ok)
+{
+    if (!enabled())
+        return;
+
+    if (op >= 0 && op < API_MAX)
+        _apis[op].record(context, ok);
+
+    Stats* node = nodeStats(context.primary_ip[0] ? context.primary_ip : "unknown");
+    if (NULL != node)
+        node->record(context, ok);
+}
+
+MetricsSnapshot Metrics::snapshot() const
+{
+    MetricsSnapshot snapshot;
+    if (!enabled())
+        return snapshot;
+
+    for (int i = 0; i < API_MAX; ++i)
+    {
+        if (0 == _apis[i].requests)
+            continue;
+
+        ApiSnapshot api;
+        api.name = apiName((ApiOperation) i);
+        _apis[i].snapshot(api);
+        snapshot.apis.push_back(api);
+    }
+
+    for (int i = 0; i < NODE_SLOTS; ++i)
+    {
+        if (SLOT_READY != _nodes[i].state)
+            continue;
+
+        ApiSnapshot node;
+        node.name = _nodes[i].key;
+        _nodes[i].stats.snapshot(node);
+        snapshot.nodes.push_back(node);
+    }
+
+    return snapshot;
+}
+
+} // end namespace
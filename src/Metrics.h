@@ -0,0 +1,189 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _METRICS_HEADER_H_
+#define _METRICS_HEADER_H_
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <cstddef>
+
+namespace cppes {
+
+struct HttpContext;
+
+/*
+ * @brief API operations of ElasticSearch which metrics are kept for.
+ */
+enum ApiOperation
+{
+    API_PING = 0,
+    API_GET,
+    API_EXIST,
+    API_INDEX,
+    API_UPDATE,
+    API_DELETE,
+    API_COUNT,
+    API_SEARCH,
+    API_MGET,
+    API_BULK,
+    API_SCROLL_INIT,
+    API_SCROLL_NEXT,
+    API_SCROLL_CLEAR,
+    API_INDICES,
+    API_MAX
+};
+
+/// name of operation, the ElasticSearch method, e.g. "getDocument"
+const char* apiName ( ApiOperation op );
+
+/*
+ * @brief Lock-free latency histogram with HDR style log-linear buckets.
+ *  Values below 64 are exact; above, every power of two is split into 32
+ *  buckets, so any recorded value is off by at most 1/32 (3%). Recording
+ *  is a few atomic adds; reading is a racy but consistent-enough scan.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram ( );
+
+    /// record a value, values above 2^32 are clamped
+    void record ( uint64_t value );
+
+    /// add all values of other into this one
+    void merge ( const LatencyHistogram& other );
+
+    uint64_t count ( ) const  { return _count; }
+    uint64_t max ( ) const    { return _max;   }
+    double mean ( ) const;
+
+    /// value at percentile, in [0, 100]
+    uint64_t percentile ( double percent ) const;
+
+    enum { LINEAR = 64, SUB_BUCKETS = 32, MAX_SHIFT = 27, BUCKETS = MAX_SHIFT * SUB_BUCKETS + LINEAR };
+
+    /// bucket a value is counted in, and the value, middle of its range, a bucket stands for
+    static int bucketOf ( uint64_t value );
+    static uint64_t valueOf ( int bucket );
+
+private:
+    volatile uint64_t _buckets[BUCKETS];
+    volatile uint64_t _count;
+    volatile uint64_t _sum;
+    volatile uint64_t _max;
+};
+
+/*
+ * @brief Summary of one LatencyHistogram, in microseconds.
+ */
+struct LatencySummary
+{
+    LatencySummary ( ) : count(0), mean(0), p50(0), p90(0), p99(0), p999(0), max(0) { }
+
+    uint64_t count;
+    double mean;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+};
+
+/*
+ * @brief Client side statistics of one operation or one node.
+ */
+struct ApiSnapshot
+{
+    ApiSnapshot ( )
+    : name(), requests(0), errors(0), bytes_sent(0), bytes_received(0)
+    , new_connections(0), reuse_rate(0), avg_dns_us(0), avg_connect_us(0), avg_tls_us(0)
+    , ttfb(), total()
+    {
+    }
+
+    std::string name;            // operation name, or node address
+    uint64_t requests;
+    uint64_t errors;             // transport failures and 5xx answers
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t new_connections;    // requests which had to open a connection
+    double reuse_rate;           // share of requests on a reused connection
+    double avg_dns_us;
+    double avg_connect_us;
+    double avg_tls_us;
+    LatencySummary ttfb;         // time to first byte
+    LatencySummary total;        // whole request
+};
+
+struct MetricsSnapshot
+{
+    std::vector<ApiSnapshot> apis;     // operations which have requests
+    std::vector<ApiSnapshot> nodes;    // per server address
+};
+
+/*
+ * @brief Per operation and per node request metrics of one client.
+ *  Everything is allocated up front, about 450KB, and updated with atomic
+ *  instructions only; nodes claim one of a fixed number of slots on first
+ *  sight. A disabled Metrics allocates nothing and records nothing.
+ */
+class Metrics
+{
+public:
+    explicit Metrics ( bool enabled = true );
+    ~Metrics ( );
+
+    bool enabled ( ) const { return NULL != _apis; }
+
+    void record ( ApiOperation op, const HttpContext& context, bool ok );
+    MetricsSnapshot snapshot ( ) const;
+
+private:
+    struct Stats
+    {
+        Stats ( );
+        void record ( const HttpContext& context, bool ok );
+        void snapshot ( ApiSnapshot& out ) const;
+
+        volatile uint64_t requests;
+        volatile uint64_t errors;
+        volatile uint64_t bytes_sent;
+        volatile uint64_t bytes_received;
+        volatile uint64_t new_connections;
+        volatile uint64_t dns_us;
+        volatile uint64_t connect_us;
+        volatile uint64_t tls_us;
+        LatencyHistogram ttfb;
+        LatencyHistogram total;
+    };
+
+    enum { NODE_SLOTS = 16, NODE_KEY = 48 };
+    enum { SLOT_FREE = 0, SLOT_CLAIMED, SLOT_READY };
+
+    struct Node
+    {
+        Node ( ) : state(SLOT_FREE) { key[0] = '\0'; }
+
+        volatile int state;
+        char key[NODE_KEY];
+        Stats stats;
+    };
+
+    Stats* nodeStats ( const char* address );
+
+    Metrics ( const Metrics& );
+    Metrics& operator= ( const Metrics& );
+
+    Stats* _apis;     // API_MAX of them, NULL if disabled
+    Node* _nodes;     // NODE_SLOTS of them, NULL if disabled
+};
+
+} // end namespace
+#endif // _METRICS_HEADER_H_
@@ -0,0 +1,245 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "MultiTransport.h"
+#include "curl/curl.h"
+#include <unistd.h>
+#include <fcntl.h>
+
+// The transport needs HTTP/2 multiplexing (7.43.0), which comes after
+// curl_multi_wait() (7.28.0); curl_multi_poll() and curl_multi_wakeup()
+// (7.68.0) replace its self-pipe. With older headers, as the bundled
+// 7.19.7 ones, it is never started, see multiplexing().
+#if defined(CURLPIPE_MULTIPLEX) && LIBCURL_VERSION_NUM >= 0x074400
+#define MULTI_WAKEUP 1
+#endif
+
+namespace cppes {
+
+MultiTransport::MultiTransport()
+: _multi(NULL)
+, _thread()
+, _running(false)
+, _pending()
+, _mutex()
+, _active()
+, _callers(0)
+, _idle(_mutex)
+{
+    _wakeup_fds[0] = _wakeup_fds[1] = -1;
+
+#ifdef CURLPIPE_MULTIPLEX
+    CURLM* multi = curl_multi_init();
+    if (NULL == multi)
+        return;
+
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+#ifndef MULTI_WAKEUP
+    if (0 != ::pipe(_wakeup_fds))
+    {
+        curl_multi_cleanup(multi);
+        return;
+    }
+
+    for (int i = 0; i < 2; ++i)
+        ::fcntl(_wakeup_fds[i], F_SETFL, ::fcntl(_wakeup_fds[i], F_GETFL) | O_NONBLOCK);
+#endif
+
+    _multi = multi;
+    _running = true;
+    if (0 != pthread_create(&_thread, NULL, loopThread, this))
+        _running = false;
+#endif
+}
+
+MultiTransport::~MultiTransport()
+{
+    if (_running)
+    {
+        {
+            MutexLockGuard lock(_mutex);
+            _running = false;
+        }
+        wakeup();
+        pthread_join(_thread, NULL);
+
+        // callers woken by the loop still use the lock on their way out
+        MutexLockGuard lock(_mutex);
+        while (_callers > 0)
+            _idle.wait();
+    }
+
+    if (NULL != _multi)
+        curl_multi_cleanup((CURLM*) _multi);
+
+    for (int i = 0; i < 2; ++i)
+    {
+        if (_wakeup_fds[i] >= 0)
+            ::close(_wakeup_fds[i]);
+    }
+}
+
+bool MultiTransport::multiplexing()
+{
+#ifdef CURLPIPE_MULTIPLEX
+    curl_version_info_data* info = curl_version_info(CURLVERSION_NOW);
+    return NULL != info && 0 != (info->features & CURL_VERSION_HTTP2);
+#else
+    return false;
+#endif
+}
+
+int MultiTransport::perform(void* curl)
+{
+    Transfer transfer(_mutex);
+    transfer.curl = curl;
+    curl_easy_setopt((CURL*) curl, CURLOPT_PRIVATE, (char*) &transfer);
+
+    {
+        MutexLockGuard lock(_mutex);
+        if (!_running)
+            return CURLE_ABORTED_BY_CALLBACK;
+
+        ++_callers;
+        _pending.push_back(&transfer);
+        wakeup();
+
+        while (!transfer.done)
+            transfer.finished.wait();
+
+        if (0 == --_callers && !_running)
+            _idle.notifyAll();
+    }
+
+    return transfer.result;
+}
+
+void* MultiTransport::loopThread(void* arg)
+{
+    ((MultiTransport*) arg)->loop();
+    return NULL;
+}
+
+void MultiTransport::loop()
+{
+    while (_running)
+    {
+        addPending();
+
+        int running = 0;
+        while (CURLM_CALL_MULTI_PERFORM == curl_multi_perform((CURLM*) _multi, &running))
+            ;
+
+        finishDone();
+        wait();
+    }
+
+    failAll();
+}
+
+void MultiTransport::addPending()
+{
+    MutexLockGuard lock(_mutex);
+    for (size_t i = 0; i < _pending.size(); ++i)
+    {
+        CURLMcode code = curl_multi_add_handle((CURLM*) _multi, (CURL*) _pending[i]->curl);
+        if (CURLM_OK == code)
+            _active.insert(_pending[i]);
+        else
+            complete(_pending[i], CURLE_FAILED_INIT);
+    }
+
+    _pending.clear();
+}
+
+void MultiTransport::finishDone()
+{
+    int left = 0;
+    CURLMsg* msg = NULL;
+    while (NULL != (msg = curl_multi_info_read((CURLM*) _multi, &left)))
+    {
+        if (CURLMSG_DONE != msg->msg)
+            continue;
+
+        char* data = NULL;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &data);
+        CURLcode result = msg->data.result;
+        curl_multi_remove_handle((CURLM*) _multi, msg->easy_handle);
+
+        Transfer* transfer = (Transfer*) data;
+        _active.erase(transfer);
+
+        MutexLockGuard lock(_mutex);
+        complete(transfer, result);
+    }
+}
+
+// Fail the transfers left, on the multi handle or waiting for it, so no
+// caller blocks forever.
+
+void MultiTransport::failAll()
+{
+    std::set<Transfer*>::iterator it = _active.begin();
+    for (; it != _active.end(); ++it)
+        curl_multi_remove_handle((CURLM*) _multi, (CURL*) (*it)->curl);
+
+    MutexLockGuard lock(_mutex);
+    for (it = _active.begin(); it != _active.end(); ++it)
+        complete(*it, CURLE_ABORTED_BY_CALLBACK);
+
+    for (size_t i = 0; i < _pending.size(); ++i)
+        complete(_pending[i], CURLE_ABORTED_BY_CALLBACK);
+
+    _active.clear();
+    _pending.clear();
+}
+
+void MultiTransport::complete(Transfer* transfer, int result)
+{
+    transfer->result = result;
+    transfer->done = true;
+    transfer->finished.notify();
+}
+
+// Sleep until a socket of a transfer is ready, curl has a timeout due or
+// wakeup() is called. Both calls poll(), any descriptor number is fine.
+
+void MultiTransport::wait()
+{
+#if defined(MULTI_WAKEUP)
+    curl_multi_poll((CURLM*) _multi, NULL, 0, 1000, NULL);
+#elif defined(CURLPIPE_MULTIPLEX)
+    struct curl_waitfd extra;
+    extra.fd = _wakeup_fds[0];
+    extra.events = CURL_WAIT_POLLIN;
+    extra.revents = 0;
+    curl_multi_wait((CURLM*) _multi, &extra, 1, 1000, NULL);
+
+    if (0 != extra.revents)
+    {
+        char drain[256];
+        while (::read(_wakeup_fds[0], drain, sizeof (drain)) > 0)
+            ;
+    }
+#endif
+}
+
+void MultiTransport::wakeup()
+{
+#if defined(MULTI_WAKEUP)
+    curl_multi_wakeup((CURLM*) _multi);
+#else
+    char c = 0;
+    ssize_t n = ::write(_wakeup_fds[1], &c, 1);
+    (void) n;
+#endif
+}
+
+} // end namespace
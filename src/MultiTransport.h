@@ -0,0 +1,92 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _MULTI_TRANSPORT_HEADER_H_
+#define _MULTI_TRANSPORT_HEADER_H_
+#include <vector>
+#include <set>
+#include <pthread.h>
+#include "Mutex.h"
+
+namespace cppes {
+
+/*
+ * @brief Runs the requests of all threads on one curl_multi handle, driven
+ *  by a private event loop thread. When multiplexing() the transfers are
+ *  HTTP/2 streams over a few connections instead of taking one connection
+ *  each, otherwise they run side by side on connections of their own.
+ *  Callers block in perform() until their own transfer is done, so the
+ *  synchronous HttpClient API is unchanged.
+ */
+class MultiTransport
+{
+public:
+    MultiTransport ( );
+    ~MultiTransport ( );
+
+    /// false if the multi handle or its loop thread could not be created, always without multiplexing at build time
+    bool valid ( ) const { return _running; }
+
+    /// true if libcurl, at build and at run time, can multiplex HTTP/2 streams
+    static bool multiplexing ( );
+
+    /*
+     * @brief Run one configured curl easy handle and wait for it. Transfers
+     *  still running when the transport is destroyed fail with
+     *  CURLE_ABORTED_BY_CALLBACK.
+     * @return int, CURL状态码，成功为0
+     */
+    int perform ( void* curl );
+
+private:
+    struct Transfer
+    {
+        explicit Transfer ( MutexLock& mutex ) : curl(NULL), result(0), done(false), finished(mutex) { }
+
+        void* curl;
+        int result;
+        bool done;
+        Condition finished;
+    };
+
+    static void* loopThread ( void* arg );
+    void loop ( );
+    void addPending ( );
+    void finishDone ( );
+    void failAll ( );
+    void wait ( );
+    void wakeup ( );
+
+    /// called with the lock held
+    static void complete ( Transfer* transfer, int result );
+
+    MultiTransport ( const MultiTransport& );
+    MultiTransport& operator= ( const MultiTransport& );
+
+    void* _multi;
+    pthread_t _thread;
+    volatile bool _running;
+
+    /// self-pipe to break the loop out of curl_multi_wait(), unused with curl_multi_wakeup()
+    int _wakeup_fds[2];
+
+    /// transfers waiting to join the multi handle, guarded by _mutex
+    std::vector<Transfer*> _pending;
+    MutexLock _mutex;
+
+    /// transfers on the multi handle, used by the loop thread only
+    std::set<Transfer*> _active;
+
+    /// callers inside perform(), the destructor waits for them to leave
+    int _callers;
+    Condition _idle;
+};
+
+} // end namespace
+#endif // _MULTI_TRANSPORT_HEADER_H_
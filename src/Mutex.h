@@ -0,0 +1,90 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _MUTEX_HEADER_H_
+#define _MUTEX_HEADER_H_
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+
+namespace cppes {
+
+/*
+ * @brief Thin wrapper of pthread mutex.
+ */
+class MutexLock
+{
+public:
+    MutexLock ( )                { pthread_mutex_init(&_mutex, NULL); }
+    ~MutexLock ( )               { pthread_mutex_destroy(&_mutex);    }
+
+    void lock ( )                { pthread_mutex_lock(&_mutex);       }
+    void unlock ( )              { pthread_mutex_unlock(&_mutex);     }
+    pthread_mutex_t* get ( )     { return &_mutex;                    }
+
+private:
+    MutexLock ( const MutexLock& );
+    MutexLock& operator= ( const MutexLock& );
+
+    pthread_mutex_t _mutex;
+};
+
+/*
+ * @brief Lock the mutex in scope.
+ */
+class MutexLockGuard
+{
+public:
+    explicit MutexLockGuard ( MutexLock& mutex ) : _mutex(mutex) { _mutex.lock();   }
+    ~MutexLockGuard ( )                                         { _mutex.unlock(); }
+
+private:
+    MutexLockGuard ( const MutexLockGuard& );
+    MutexLockGuard& operator= ( const MutexLockGuard& );
+
+    MutexLock& _mutex;
+};
+
+/*
+ * @brief Condition variable bound to a MutexLock, which must be
+ *  locked by the caller of wait().
+ */
+class Condition
+{
+public:
+    explicit Condition ( MutexLock& mutex ) : _mutex(mutex) { pthread_cond_init(&_cond, NULL); }
+    ~Condition ( )                                          { pthread_cond_destroy(&_cond);    }
+
+    void wait ( )                { pthread_cond_wait(&_cond, _mutex.get()); }
+    void notify ( )              { pthread_cond_signal(&_cond);             }
+    void notifyAll ( )           { pthread_cond_broadcast(&_cond);          }
+
+    /// return true if timeout
+    bool waitForSeconds ( double seconds )
+    {
+        struct timespec abstime;
+        clock_gettime(CLOCK_REALTIME, &abstime);
+
+        long long nanoseconds = (long long) (seconds * 1000000000LL) + abstime.tv_nsec;
+        abstime.tv_sec += (time_t) (nanoseconds / 1000000000LL);
+        abstime.tv_nsec = (long) (nanoseconds % 1000000000LL);
+
+        return ETIMEDOUT == pthread_cond_timedwait(&_cond, _mutex.get(), &abstime);
+    }
+
+private:
+    Condition ( const Condition& );
+    Condition& operator= ( const Condition& );
+
+    MutexLock& _mutex;
+    pthread_cond_t _cond;
+};
+
+} // end namespace
+#endif // _MUTEX_HEADER_H_
@@ -0,0 +1,77 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "Projection.h"
+#include <cctype>
+#include <cstdio>
+
+namespace cppes {
+
+// Percent-encode a field name, keeping the characters of ES paths readable.
+
+static void urlEncode(std::ostream& url, const std::string& value)
+{
+    for (size_t i = 0; i < value.length(); ++i)
+    {
+        unsigned char c = value[i];
+        if (isalnum(c) || '.' == c || '*' == c || '_' == c || '-' == c)
+        {
+            url << (char) c;
+        }
+        else
+        {
+            char hex[4];
+            snprintf(hex, sizeof (hex), "%%%02X", c);
+            url << hex;
+        }
+    }
+}
+
+static void appendList(std::ostream& url, char& sep, const char* name, const std::vector<std::string>& values, const char* extra)
+{
+    if (values.empty())
+        return;
+
+    url << sep << name << '=';
+    sep = '&';
+
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        if (i > 0)
+            url << ',';
+        urlEncode(url, values[i]);
+    }
+
+    if (NULL != extra && '\0' != *extra)
+        url << ',' << extra;
+}
+
+void Projection::appendTo(std::ostream& url, char sep, const char* required) const
+{
+    if (!source)
+    {
+        url << sep << "_source=false";
+        sep = '&';
+    }
+    else
+    {
+        appendList(url, sep, "_source_includes", includes, NULL);
+        appendList(url, sep, "_source_excludes", excludes, NULL);
+    }
+
+    appendList(url, sep, "stored_fields", stored_fields, NULL);
+    appendList(url, sep, "filter_path", filter_path, required);
+}
+
+void Projection::appendFilterPath(std::ostream& url, char sep, const char* required) const
+{
+    appendList(url, sep, "filter_path", filter_path, required);
+}
+
+} // end namespace
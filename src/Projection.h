@@ -0,0 +1,63 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _PROJECTION_HEADER_H_
+#define _PROJECTION_HEADER_H_
+#include <string>
+#include <vector>
+#include <ostream>
+
+namespace cppes {
+
+/*
+ * @brief Fields the server should send back for a read, so unneeded parts
+ *  of wide documents are stripped before the wire and the client parser.
+ *  Every list is sent as an url parameter when it is not empty:
+ *    includes      -> _source_includes
+ *    excludes      -> _source_excludes
+ *    stored_fields -> stored_fields
+ *    filter_path   -> filter_path, plus the fields the client itself checks
+ *  Wildcards are allowed as in ES, e.g. "user.*".
+ */
+struct Projection
+{
+    Projection ( ) : source(true) { }
+
+    /// builder style, e.g. Projection().include("name").include("age")
+    Projection& include ( const std::string& field )  { includes.push_back(field);      return *this; }
+    Projection& exclude ( const std::string& field )  { excludes.push_back(field);      return *this; }
+    Projection& stored ( const std::string& field )   { stored_fields.push_back(field); return *this; }
+    Projection& filter ( const std::string& path )    { filter_path.push_back(path);    return *this; }
+    Projection& noSource ( )                          { source = false;                 return *this; }
+
+    bool empty ( ) const
+    {
+        return source && includes.empty() && excludes.empty() && stored_fields.empty() && filter_path.empty();
+    }
+
+    /*
+     * @brief Append all parameters to an url.
+     * @param url, [out], the url
+     * @param sep, [in], '?' if the url has no parameter yet, other '&'
+     * @param required, [in], comma separated paths kept in any filter_path
+     */
+    void appendTo ( std::ostream& url, char sep, const char* required ) const;
+
+    /// Append filter_path only, for endpoints without source filtering like scroll.
+    void appendFilterPath ( std::ostream& url, char sep, const char* required ) const;
+
+    bool source;                              // false sends _source=false
+    std::vector<std::string> includes;
+    std::vector<std::string> excludes;
+    std::vector<std::string> stored_fields;
+    std::vector<std::string> filter_path;
+};
+
+} // end namespace
+#endif // _PROJECTION_HEADER_H_
@@ -0,0 +1,202 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "Query.h"
+#include <stdio.h>
+#include <math.h>
+
+namespace cppes {
+
+void appendQuoted(std::string& out, const char* data, size_t length)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    out += '"';
+    const char* end = data + length;
+    const char* run = data;
+    for (const char* p = data; p < end; ++p)
+    {
+        unsigned char c = (unsigned char) *p;
+        if (c >= 0x20 && '"' != c && '\\' != c)
+            continue;
+
+        // copy the plain characters before c in one go
+        out.append(run, p - run);
+        run = p + 1;
+
+        switch (c)
+        {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b";  break;
+            case '\f': out += "\\f";  break;
+            case '\n': out += "\\n";  break;
+            case '\r': out += "\\r";  break;
+            case '\t': out += "\\t";  break;
+            default:
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xf];
+                break;
+        }
+    }
+    out.append(run, end - run);
+    out += '"';
+}
+
+void QueryValue::appendTo(std::string& out) const
+{
+    char buffer[32];
+    switch (_kind)
+    {
+        case STRING:
+            _string.appendTo(out);
+            break;
+
+        case INTEGER:
+            snprintf(buffer, sizeof (buffer), "%lld", _integer);
+            out += buffer;
+            break;
+
+        case NUMBER:
+            // JSON has no NaN or infinity
+            if (isnan(_number) || isinf(_number))
+            {
+                out += "null";
+                break;
+            }
+            snprintf(buffer, sizeof (buffer), "%.17g", _number);
+            out += buffer;
+            break;
+
+        case BOOLEAN:
+            out += _integer ? "true" : "false";
+            break;
+    }
+}
+
+RangeQuery RangeQuery::with(Bound bound, QueryValue value) const
+{
+    RangeQuery range(*this);
+    range._set |= bound;
+    switch (bound)
+    {
+        case GT:  range._gt = value;  break;
+        case GTE: range._gte = value; break;
+        case LT:  range._lt = value;  break;
+        case LTE: range._lte = value; break;
+    }
+    return range;
+}
+
+void RangeQuery::appendTo(std::string& out) const
+{
+    out += "{\"range\":{";
+    _field.appendTo(out);
+    out += ":{";
+
+    bool first = true;
+    const char* names[] = { "\"gt\":", "\"gte\":", "\"lt\":", "\"lte\":" };
+    const QueryValue* values[] = { &_gt, &_gte, &_lt, &_lte };
+    for (int i = 0; i < 4; ++i)
+    {
+        if (0 == (_set & (1 << i)))
+            continue;
+
+        if (!first)
+            out += ',';
+        first = false;
+
+        out += names[i];
+        values[i]->appendTo(out);
+    }
+    out += "}}}";
+}
+
+QueryBuilder::QueryBuilder()
+: _query()
+, _size(-1)
+, _from(-1)
+, _sort()
+, _aggs()
+, _body()
+{
+}
+
+QueryBuilder& QueryBuilder::clear()
+{
+    _query.clear();
+    _size = -1;
+    _from = -1;
+    _sort.clear();
+    _aggs.clear();
+    _body.clear();
+    return *this;
+}
+
+QueryBuilder& QueryBuilder::sort(StringRef field, bool ascending)
+{
+    if (!_sort.empty())
+        _sort += ',';
+    _sort += '{';
+    field.appendTo(_sort);
+    _sort += ascending ? ":{\"order\":\"asc\"}}" : ":{\"order\":\"desc\"}}";
+    return *this;
+}
+
+const std::string& QueryBuilder::str()
+{
+    _body.clear();
+    _body += '{';
+
+    if (!_query.empty())
+    {
+        _body += "\"query\":";
+        _body += _query;
+    }
+
+    if (_size >= 0)
+    {
+        if (_body.size() > 1)
+            _body += ',';
+        _body += "\"size\":";
+        QueryValue(_size).appendTo(_body);
+    }
+
+    if (_from >= 0)
+    {
+        if (_body.size() > 1)
+            _body += ',';
+        _body += "\"from\":";
+        QueryValue(_from).appendTo(_body);
+    }
+
+    if (!_sort.empty())
+    {
+        if (_body.size() > 1)
+            _body += ',';
+        _body += "\"sort\":[";
+        _body += _sort;
+        _body += ']';
+    }
+
+    if (!_aggs.empty())
+    {
+        if (_body.size() > 1)
+            _body += ',';
+        _body += "\"aggs\":{";
+        _body += _aggs;
+        _body += '}';
+    }
+
+    _body += '}';
+    return _body;
+}
+
+} // end namespace
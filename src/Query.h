@@ -0,0 +1,421 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _QUERY_HEADER_H_
+#define _QUERY_HEADER_H_
+#include <string>
+#include <vector>
+#include <cstring>
+
+namespace cppes {
+
+/*
+ * Typed search bodies written straight to a string, without a Json::Value.
+ *
+ *   QueryBuilder builder;
+ *   builder.query(boolQuery()
+ *                     .must(matchQuery("title", text))
+ *                     .filter(termQuery("status", "published"))
+ *                     .filter(rangeQuery("age").gte(18).lt(65)))
+ *          .size(20)
+ *          .sort("date", false)
+ *          .aggregation("by_tag", termsAgg("tag", 10));
+ *   es.search(index, type, builder.str(), result);
+ *
+ * The shape of a query is its type, e.g. BoolQuery<ClauseList<NoClause,
+ * MatchQuery>, ...>, so writing it is a chain of appends decided at
+ * compile time. Clauses only refer to their strings: build them in the
+ * expression which writes them, or keep the strings alive as long as the
+ * query. The values of a terms query are copied, so a query may be kept
+ * and written later. Strings are escaped; besides those copies the only
+ * allocation is the growth of the output, kept by a reused builder.
+ */
+
+/// Append data as a quoted JSON string, escaped.
+void appendQuoted ( std::string& out, const char* data, size_t length );
+
+/// Non-owning string: a field name or text of a query.
+class StringRef
+{
+public:
+    StringRef ( const char* data ) : _data(data), _length(strlen(data)) { }
+    StringRef ( const std::string& data ) : _data(data.data()), _length(data.size()) { }
+
+    void appendTo ( std::string& out ) const { appendQuoted(out, _data, _length); }
+
+private:
+    const char* _data;
+    size_t _length;
+};
+
+/// Scalar of a query, a string, number or boolean.
+class QueryValue
+{
+public:
+    QueryValue ( const char* value )         : _kind(STRING), _string(value), _integer(0), _number(0) { }
+    QueryValue ( const std::string& value )  : _kind(STRING), _string(value), _integer(0), _number(0) { }
+    QueryValue ( int value )                 : _kind(INTEGER), _string(""), _integer(value), _number(0) { }
+    QueryValue ( unsigned int value )        : _kind(INTEGER), _string(""), _integer(value), _number(0) { }
+    QueryValue ( long value )                : _kind(INTEGER), _string(""), _integer(value), _number(0) { }
+    QueryValue ( unsigned long value )       : _kind(INTEGER), _string(""), _integer((long long) value), _number(0) { }
+    QueryValue ( long long value )           : _kind(INTEGER), _string(""), _integer(value), _number(0) { }
+    QueryValue ( double value )              : _kind(NUMBER), _string(""), _integer(0), _number(value) { }
+    QueryValue ( bool value )                : _kind(BOOLEAN), _string(""), _integer(value ? 1 : 0), _number(0) { }
+
+    void appendTo ( std::string& out ) const;
+
+private:
+    enum Kind { STRING, INTEGER, NUMBER, BOOLEAN };
+
+    Kind _kind;
+    StringRef _string;
+    long long _integer;
+    double _number;
+};
+
+/// Empty clause list, writes nothing.
+struct NoClause
+{
+    static const bool empty = true;
+    void appendTo ( std::string& ) const { }
+};
+
+/// Clauses of a bool query slot, Head holds the ones given before.
+template <typename Head, typename Tail>
+struct ClauseList
+{
+    static const bool empty = false;
+
+    ClauseList ( const Head& head, const Tail& tail ) : _head(head), _tail(tail) { }
+
+    void appendTo ( std::string& out ) const
+    {
+        _head.appendTo(out);
+        if (!Head::empty)
+            out += ',';
+        _tail.appendTo(out);
+    }
+
+private:
+    Head _head;
+    Tail _tail;
+};
+
+/// {"match_all":{}}
+struct MatchAllQuery
+{
+    void appendTo ( std::string& out ) const { out += "{\"match_all\":{}}"; }
+};
+
+/// {"match":{field:text}}, analyzed full text search.
+class MatchQuery
+{
+public:
+    MatchQuery ( StringRef field, QueryValue text ) : _field(field), _text(text) { }
+
+    void appendTo ( std::string& out ) const
+    {
+        out += "{\"match\":{";
+        _field.appendTo(out);
+        out += ':';
+        _text.appendTo(out);
+        out += "}}";
+    }
+
+private:
+    StringRef _field;
+    QueryValue _text;
+};
+
+/// {"term":{field:value}}, exact value.
+class TermQuery
+{
+public:
+    TermQuery ( StringRef field, QueryValue value ) : _field(field), _value(value) { }
+
+    void appendTo ( std::string& out ) const
+    {
+        out += "{\"term\":{";
+        _field.appendTo(out);
+        out += ':';
+        _value.appendTo(out);
+        out += "}}";
+    }
+
+private:
+    StringRef _field;
+    QueryValue _value;
+};
+
+/// {"terms":{field:[values]}}, any of the exact values, kept by copy.
+template <typename T>
+class TermsQuery
+{
+public:
+    TermsQuery ( StringRef field, const std::vector<T>& values ) : _field(field), _values(values) { }
+
+    void appendTo ( std::string& out ) const
+    {
+        out += "{\"terms\":{";
+        _field.appendTo(out);
+        out += ":[";
+        for (size_t i = 0; i < _values.size(); ++i)
+        {
+            if (i > 0)
+                out += ',';
+            QueryValue(_values[i]).appendTo(out);
+        }
+        out += "]}}";
+    }
+
+private:
+    StringRef _field;
+    std::vector<T> _values;
+};
+
+/// {"range":{field:{"gte":..,"lt":..}}}, the bounds set.
+class RangeQuery
+{
+public:
+    explicit RangeQuery ( StringRef field )
+    : _field(field), _set(0)
+    , _gt(false), _gte(false), _lt(false), _lte(false)
+    {
+    }
+
+    RangeQuery gt ( QueryValue value ) const   { return with(GT, value);  }
+    RangeQuery gte ( QueryValue value ) const  { return with(GTE, value); }
+    RangeQuery lt ( QueryValue value ) const   { return with(LT, value);  }
+    RangeQuery lte ( QueryValue value ) const  { return with(LTE, value); }
+
+    void appendTo ( std::string& out ) const;
+
+private:
+    enum Bound { GT = 1, GTE = 2, LT = 4, LTE = 8 };
+
+    RangeQuery with ( Bound bound, QueryValue value ) const;
+
+    StringRef _field;
+    int _set;                  // bounds given, see Bound
+    QueryValue _gt, _gte, _lt, _lte;
+};
+
+/// {"bool":{"must":[..],"filter":[..],"should":[..],"must_not":[..]}}, empty slots left out.
+template <typename Must, typename Filter, typename Should, typename MustNot>
+class BoolQuery
+{
+public:
+    BoolQuery ( const Must& must, const Filter& filter, const Should& should, const MustNot& mustNot )
+    : _must(must), _filter(filter), _should(should), _must_not(mustNot)
+    {
+    }
+
+    /// add a clause which must match and scores
+    template <typename Q>
+    BoolQuery<ClauseList<Must, Q>, Filter, Should, MustNot> must ( const Q& clause ) const
+    {
+        return BoolQuery<ClauseList<Must, Q>, Filter, Should, MustNot>(ClauseList<Must, Q>(_must, clause), _filter, _should, _must_not);
+    }
+
+    /// add a clause which must match, without scoring
+    template <typename Q>
+    BoolQuery<Must, ClauseList<Filter, Q>, Should, MustNot> filter ( const Q& clause ) const
+    {
+        return BoolQuery<Must, ClauseList<Filter, Q>, Should, MustNot>(_must, ClauseList<Filter, Q>(_filter, clause), _should, _must_not);
+    }
+
+    /// add a clause which should match
+    template <typename Q>
+    BoolQuery<Must, Filter, ClauseList<Should, Q>, MustNot> should ( const Q& clause ) const
+    {
+        return BoolQuery<Must, Filter, ClauseList<Should, Q>, MustNot>(_must, _filter, ClauseList<Should, Q>(_should, clause), _must_not);
+    }
+
+    /// add a clause which must not match
+    template <typename Q>
+    BoolQuery<Must, Filter, Should, ClauseList<MustNot, Q> > mustNot ( const Q& clause ) const
+    {
+        return BoolQuery<Must, Filter, Should, ClauseList<MustNot, Q> >(_must, _filter, _should, ClauseList<MustNot, Q>(_must_not, clause));
+    }
+
+    void appendTo ( std::string& out ) const
+    {
+        out += "{\"bool\":{";
+        bool first = true;
+        appendSlot(out, "\"must\":[", Must::empty, _must, first);
+        appendSlot(out, "\"filter\":[", Filter::empty, _filter, first);
+        appendSlot(out, "\"should\":[", Should::empty, _should, first);
+        appendSlot(out, "\"must_not\":[", MustNot::empty, _must_not, first);
+        out += "}}";
+    }
+
+private:
+    template <typename Slot>
+    static void appendSlot ( std::string& out, const char* name, bool empty, const Slot& slot, bool& first )
+    {
+        if (empty)
+            return;
+
+        if (!first)
+            out += ',';
+        first = false;
+
+        out += name;
+        slot.appendTo(out);
+        out += ']';
+    }
+
+    Must _must;
+    Filter _filter;
+    Should _should;
+    MustNot _must_not;
+};
+
+/// {"terms":{"field":..,"size":..}} bucket aggregation, with an optional sub aggregation.
+template <typename Sub>
+class TermsAgg
+{
+public:
+    TermsAgg ( StringRef field, int size, StringRef subName, const Sub& sub )
+    : _field(field), _size(size), _sub_name(subName), _sub(sub)
+    {
+    }
+
+    /// aggregate the documents of every bucket
+    template <typename A>
+    TermsAgg<A> aggregation ( StringRef name, const A& agg ) const
+    {
+        return TermsAgg<A>(_field, _size, name, agg);
+    }
+
+    void appendTo ( std::string& out ) const
+    {
+        out += "{\"terms\":{\"field\":";
+        _field.appendTo(out);
+        out += ",\"size\":";
+        QueryValue(_size).appendTo(out);
+        out += '}';
+        if (!Sub::empty)
+        {
+            out += ",\"aggs\":{";
+            _sub_name.appendTo(out);
+            out += ':';
+            _sub.appendTo(out);
+            out += '}';
+        }
+        out += '}';
+    }
+
+    static const bool empty = false;
+
+private:
+    StringRef _field;
+    int _size;
+    StringRef _sub_name;
+    Sub _sub;
+};
+
+/// {kind:{"field":..}} single value metric, e.g. avg or cardinality.
+class MetricAgg
+{
+public:
+    MetricAgg ( const char* kind, StringRef field ) : _kind(kind), _field(field) { }
+
+    void appendTo ( std::string& out ) const
+    {
+        out += "{\"";
+        out += _kind;
+        out += "\":{\"field\":";
+        _field.appendTo(out);
+        out += "}}";
+    }
+
+    static const bool empty = false;
+
+private:
+    const char* _kind;
+    StringRef _field;
+};
+
+inline MatchAllQuery matchAllQuery ( )                                 { return MatchAllQuery(); }
+inline MatchQuery matchQuery ( StringRef field, QueryValue text )      { return MatchQuery(field, text); }
+inline TermQuery termQuery ( StringRef field, QueryValue value )       { return TermQuery(field, value); }
+inline RangeQuery rangeQuery ( StringRef field )                       { return RangeQuery(field); }
+
+template <typename T>
+inline TermsQuery<T> termsQuery ( StringRef field, const std::vector<T>& values )
+{
+    return TermsQuery<T>(field, values);
+}
+
+inline BoolQuery<NoClause, NoClause, NoClause, NoClause> boolQuery ( )
+{
+    return BoolQuery<NoClause, NoClause, NoClause, NoClause>(NoClause(), NoClause(), NoClause(), NoClause());
+}
+
+inline TermsAgg<NoClause> termsAgg ( StringRef field, int size = 10 ) { return TermsAgg<NoClause>(field, size, "", NoClause()); }
+inline MetricAgg avgAgg ( StringRef field )          { return MetricAgg("avg", field);         }
+inline MetricAgg minAgg ( StringRef field )          { return MetricAgg("min", field);         }
+inline MetricAgg maxAgg ( StringRef field )          { return MetricAgg("max", field);         }
+inline MetricAgg sumAgg ( StringRef field )          { return MetricAgg("sum", field);         }
+inline MetricAgg cardinalityAgg ( StringRef field )  { return MetricAgg("cardinality", field); }
+
+/*
+ * @brief Search body: query, size, from, sort and aggregations. Every
+ *  part is kept in its own buffer, str() joins them. clear() keeps the
+ *  capacity, so a builder reused for a query shape stops allocating.
+ */
+class QueryBuilder
+{
+public:
+    QueryBuilder ( );
+
+    /// start a new body
+    QueryBuilder& clear ( );
+
+    template <typename Q>
+    QueryBuilder& query ( const Q& clause )
+    {
+        _query.clear();
+        clause.appendTo(_query);
+        return *this;
+    }
+
+    /// hits returned, -1 for the server default
+    QueryBuilder& size ( int size )   { _size = size; return *this; }
+    QueryBuilder& from ( int from )   { _from = from; return *this; }
+
+    /// sort on field after the sorts given before
+    QueryBuilder& sort ( StringRef field, bool ascending = true );
+
+    template <typename A>
+    QueryBuilder& aggregation ( StringRef name, const A& agg )
+    {
+        if (!_aggs.empty())
+            _aggs += ',';
+        name.appendTo(_aggs);
+        _aggs += ':';
+        agg.appendTo(_aggs);
+        return *this;
+    }
+
+    /// the body, valid until the builder changes
+    const std::string& str ( );
+
+private:
+    std::string _query;
+    int _size;
+    int _from;
+    std::string _sort;
+    std::string _aggs;
+    std::string _body;
+};
+
+} // end namespace
+#endif // _QUERY_HEADER_H_
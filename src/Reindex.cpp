@@ -0,0 +1,380 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "Reindex.h"
+#include "BodySource.h"
+#include <algorithm>
+
+namespace cppes {
+
+// Start count threads on routine, return the ones started.
+
+static std::vector<pthread_t> startThreads(int count, void* (*routine)(void*), void* arg)
+{
+    std::vector<pthread_t> threads;
+    for (int i = 0; i < count; ++i)
+    {
+        pthread_t thread;
+        if (0 == pthread_create(&thread, NULL, routine, arg))
+            threads.push_back(thread);
+    }
+    return threads;
+}
+
+static void joinThreads(const std::vector<pthread_t>& threads)
+{
+    for (size_t i = 0; i < threads.size(); ++i)
+        pthread_join(threads[i], NULL);
+}
+
+Reindexer::Reindexer(ElasticSearch& source, ElasticSearch& dest, const ReindexOptions& options)
+: _source(source)
+, _dest(dest)
+, _options(options)
+, _index(NULL)
+, _type(NULL)
+, _pages(NULL)
+, _batches(NULL)
+, _next_slice(0)
+, _readers_left(0)
+, _workers_left(0)
+, _result(NULL)
+, _mutex()
+{
+}
+
+bool Reindexer::run(const std::string& index, const std::string& type, ReindexResult& result)
+{
+    result = ReindexResult();
+
+    int slices = _options.slices > 1 ? _options.slices : 1;
+    int workers = _options.workers > 0 ? _options.workers : 1;
+    int writers = _options.writers > 0 ? _options.writers : 1;
+
+    BlockingQueue<Json::Value*> pages(_options.queue_depth);
+    BlockingQueue<Batch*> batches(_options.queue_depth);
+
+    _index = &index;
+    _type = &type;
+    _pages = &pages;
+    _batches = &batches;
+    _next_slice = 0;
+    _readers_left = slices;
+    _workers_left = workers;
+    _result = &result;
+
+    // downstream first, so readers never wait for a stage not yet started
+    std::vector<pthread_t> writerThreads = startThreads(writers, writerThread, this);
+    std::vector<pthread_t> workerThreads = startThreads(workers, workerThread, this);
+    std::vector<pthread_t> readerThreads = startThreads(slices, readerThread, this);
+
+    if ((int) writerThreads.size() < writers || (int) workerThreads.size() < workers || (int) readerThreads.size() < slices)
+    {
+        // a stage missing threads would never close its output queue
+        fail("cannot create reindex threads");
+        pages.close();
+        batches.close();
+    }
+
+    joinThreads(readerThreads);
+    joinThreads(workerThreads);
+    joinThreads(writerThreads);
+
+    // left over after a failure
+    Json::Value* page;
+    while (pages.take(page))
+        delete page;
+
+    Batch* batch;
+    while (batches.take(batch))
+        delete batch;
+
+    _pages = NULL;
+    _batches = NULL;
+    _result = NULL;
+
+    return result.failure.empty();
+}
+
+void* Reindexer::readerThread(void* arg)
+{
+    Reindexer* reindexer = (Reindexer*) arg;
+    reindexer->read(__sync_fetch_and_add(&reindexer->_next_slice, 1));
+
+    // the last reader ends the input of the workers
+    if (0 == __sync_sub_and_fetch(&reindexer->_readers_left, 1))
+        reindexer->_pages->close();
+    return NULL;
+}
+
+void* Reindexer::workerThread(void* arg)
+{
+    Reindexer* reindexer = (Reindexer*) arg;
+    try
+    {
+        reindexer->transform();
+    }
+    catch (std::exception& e)
+    {
+        reindexer->halt(e.what());
+    }
+    catch (...)
+    {
+        reindexer->halt("reindex transform failed");
+    }
+
+    if (0 == __sync_sub_and_fetch(&reindexer->_workers_left, 1))
+        reindexer->_batches->close();
+    return NULL;
+}
+
+void* Reindexer::writerThread(void* arg)
+{
+    Reindexer* reindexer = (Reindexer*) arg;
+    try
+    {
+        reindexer->write();
+    }
+    catch (std::exception& e)
+    {
+        reindexer->halt(e.what());
+    }
+    catch (...)
+    {
+        reindexer->halt("reindex writer failed");
+    }
+    return NULL;
+}
+
+void Reindexer::read(int slice)
+{
+    int slices = _options.slices > 1 ? _options.slices : 1;
+    std::string scrollId;
+    Json::Value* page = new Json::Value(Json::arrayValue);
+
+    try
+    {
+        // one slice is a plain scroll, the slice clause is only sent for more
+        bool ok = _source.initSlicedScroll(scrollId, *_index, *_type, _options.query, slice, slices, *page, _options.scroll_size);
+        while (ok && !page->empty())
+        {
+            size_t hits = page->size();
+            if (!_pages->put(page))
+                break;
+
+            {
+                MutexLockGuard lock(_mutex);
+                _result->read += hits;
+            }
+            // queued, the workers delete it
+            page = NULL;
+            page = new Json::Value(Json::arrayValue);
+
+            ok = _source.scrollNext(scrollId, *page);
+        }
+
+        if (!ok)
+            fail("scroll failed on transport");
+    }
+    catch (Exception& e)
+    {
+        fail(e.what());
+    }
+    catch (std::exception& e)
+    {
+        halt(e.what());
+    }
+    catch (...)
+    {
+        halt("reindex reader failed");
+    }
+
+    delete page;
+
+    if (!scrollId.empty())
+    {
+        // the scroll times out anyway
+        try
+        {
+            _source.clearScroll(scrollId);
+        }
+        catch (...)
+        {
+        }
+    }
+}
+
+void Reindexer::transform()
+{
+    Json::Value* page;
+    while (_pages->take(page))
+    {
+        Batch* batch = NULL;
+        try
+        {
+            batch = new Batch;
+            transform(*page, *batch);
+        }
+        catch (...)
+        {
+            delete page;
+            delete batch;
+            throw;
+        }
+        delete page;
+
+        if (batch->ids.empty())
+        {
+            delete batch;
+            continue;
+        }
+
+        if (!_batches->put(batch))
+            delete batch;
+    }
+}
+
+void Reindexer::transform(Json::Value& page, Batch& batch)
+{
+    BulkBuilder bulk;
+    uint64_t dropped = 0;
+
+    for (Json::Value::ArrayIndex i = 0; i < page.size(); ++i)
+    {
+        Json::Value& hit = page[i];
+        if (!_options.dest_index.empty())
+            hit["_index"] = _options.dest_index;
+        if (!_options.dest_type.empty())
+            hit["_type"] = _options.dest_type;
+
+        if (NULL != _options.transform && !_options.transform(hit, _options.userdata))
+        {
+            ++dropped;
+            continue;
+        }
+
+        batch.indices.push_back(hit["_index"].asString());
+        batch.ids.push_back(hit["_id"].asString());
+        bulk.index(batch.indices.back(), hit["_type"].asString(), batch.ids.back(), hit["_source"]);
+    }
+
+    if (dropped > 0)
+    {
+        MutexLockGuard lock(_mutex);
+        _result->dropped += dropped;
+    }
+
+    if (!batch.ids.empty())
+        batch.body = bulk.str();
+}
+
+void Reindexer::write()
+{
+    Batch pending;
+    Batch* batch;
+    while (_batches->take(batch))
+    {
+        try
+        {
+            pending.body += batch->body;
+            pending.indices.insert(pending.indices.end(), batch->indices.begin(), batch->indices.end());
+            pending.ids.insert(pending.ids.end(), batch->ids.begin(), batch->ids.end());
+        }
+        catch (...)
+        {
+            delete batch;
+            throw;
+        }
+        delete batch;
+
+        if (pending.ids.size() >= _options.bulk_actions || pending.body.size() >= _options.bulk_bytes)
+            flush(pending);
+    }
+
+    flush(pending);
+}
+
+void Reindexer::flush(Batch& batch)
+{
+    if (batch.ids.empty())
+        return;
+
+    std::vector<BulkItemError> errors;
+    std::string failure;
+    try
+    {
+        if (!_dest.bulk(BodySource(batch.body), errors) && errors.empty())
+            failure = "bulk request failed";
+    }
+    catch (Exception& e)
+    {
+        failure = e.what();
+    }
+
+    MutexLockGuard lock(_mutex);
+    ReindexResult& result = *_result;
+    ++result.bulk_requests;
+
+    if (!failure.empty())
+    {
+        ++result.failed_requests;
+        if (result.errors.size() < _options.max_errors)
+        {
+            ReindexError error;
+            error.status = 0;
+            error.reason = failure;
+            result.errors.push_back(error);
+        }
+    }
+    else
+    {
+        // positions come from the server, they are not trusted to be in the batch
+        size_t failed = std::min(errors.size(), batch.ids.size());
+        result.written += batch.ids.size() - failed;
+        result.failed_actions += failed;
+        for (size_t i = 0; i < errors.size() && result.errors.size() < _options.max_errors; ++i)
+        {
+            ReindexError error;
+            size_t position = (size_t) errors[i].position;
+            if (errors[i].position >= 0 && position < batch.ids.size() && position < batch.indices.size())
+            {
+                error.index = batch.indices[position];
+                error.id = batch.ids[position];
+            }
+            error.status = errors[i].status;
+            error.type = errors[i].type;
+            error.reason = errors[i].reason;
+            result.errors.push_back(error);
+        }
+    }
+
+    batch.body.clear();
+    batch.indices.clear();
+    batch.ids.clear();
+}
+
+void Reindexer::halt(const std::string& reason)
+{
+    fail(reason);
+    _batches->close();
+}
+
+void Reindexer::fail(const std::string& reason)
+{
+    {
+        MutexLockGuard lock(_mutex);
+        if (_result->failure.empty())
+            _result->failure = reason;
+    }
+
+    // stop every reader, what was read is still written
+    _pages->close();
+}
+
+} // end namespace
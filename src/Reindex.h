@@ -0,0 +1,164 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _REINDEX_HEADER_H_
+#define _REINDEX_HEADER_H_
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "ElasticSearch.h"
+#include "BlockingQueue.h"
+
+namespace cppes {
+
+/*
+ * @brief Configuration of Reindexer.
+ */
+struct ReindexOptions
+{
+    /*
+     * @brief Change one hit before it is written, hit has _index, _type,
+     *  _id and _source, already renamed to the destination index/type.
+     *  Called from several workers at once.
+     * @return bool, false to drop the document
+     */
+    typedef bool ( *transform_type ) ( Json::Value& hit, void* userdata );
+
+    ReindexOptions ( )
+    : dest_index()
+    , dest_type()
+    , query()
+    , transform(NULL)
+    , userdata(NULL)
+    , slices(1)
+    , scroll_size(1000)
+    , workers(4)
+    , writers(2)
+    , bulk_actions(1000)
+    , bulk_bytes(5 * 1024 * 1024)
+    , queue_depth(4)
+    , max_errors(1000)
+    {
+    }
+
+    std::string dest_index;     // empty keeps the index of the hit
+    std::string dest_type;      // empty keeps the type of the hit
+    std::string query;          // search body selecting the documents, empty for all
+    transform_type transform;   // NULL copies documents unchanged
+    void* userdata;
+    int slices;                 // parallel readers, more than 1 uses a sliced scroll (ES 5.0)
+    int scroll_size;            // hits per scroll page
+    int workers;                // threads running transform
+    int writers;                // bulk requests in flight
+    size_t bulk_actions;        // documents of one bulk request
+    size_t bulk_bytes;          // body size of one bulk request
+    size_t queue_depth;         // pages and batches waiting between two stages
+    size_t max_errors;          // errors kept in ReindexResult::errors
+};
+
+/*
+ * @brief Document the destination refused.
+ */
+struct ReindexError
+{
+    std::string index;
+    std::string id;
+    int status;          // HTTP status code of the item
+    std::string type;    // error type, e.g. mapper_parsing_exception
+    std::string reason;
+};
+
+/*
+ * @brief Outcome of Reindexer::run().
+ */
+struct ReindexResult
+{
+    ReindexResult ( )
+    : read(0), dropped(0), written(0), bulk_requests(0), failed_requests(0), failed_actions(0)
+    , errors(), failure()
+    {
+    }
+
+    bool ok ( ) const { return failure.empty() && 0 == failed_requests && 0 == failed_actions; }
+
+    uint64_t read;              // hits scrolled from the source
+    uint64_t dropped;           // hits the transform dropped
+    uint64_t written;           // documents the destination accepted
+    uint64_t bulk_requests;
+    uint64_t failed_requests;   // bulk requests with no usable answer
+    uint64_t failed_actions;    // documents the destination refused
+    std::vector<ReindexError> errors;
+    std::string failure;        // why the copy stopped early, empty if it did not
+};
+
+/*
+ * @brief Copy documents from an index to another, on the same or another
+ *  cluster, through a user transform. Three stages run at once:
+ *    readers   scroll the source, one thread per slice;
+ *    workers   transform the hits of a page and serialize them with BulkBuilder;
+ *    writers   gather serialized documents into bulk requests to the destination.
+ *  Bounded queues between them hold at most queue_depth pages and batches,
+ *  so a slow stage holds back the ones before it instead of buffering.
+ *  One reindexer runs one run() at a time.
+ */
+class Reindexer
+{
+public:
+    Reindexer ( ElasticSearch& source, ElasticSearch& dest, const ReindexOptions& options );
+
+    /// copy index/type of the source, false if reading failed, see result.failure
+    bool run ( const std::string& index, const std::string& type, ReindexResult& result );
+
+private:
+    /// serialized documents of one page
+    struct Batch
+    {
+        std::string body;
+        std::vector<std::string> indices;
+        std::vector<std::string> ids;
+    };
+
+    static void* readerThread ( void* arg );
+    static void* workerThread ( void* arg );
+    static void* writerThread ( void* arg );
+
+    void read ( int slice );
+    void transform ( );
+    void transform ( Json::Value& page, Batch& batch );
+    void write ( );
+    void flush ( Batch& batch );
+    void fail ( const std::string& reason );
+
+    /// fail() on an unexpected exception, e.g. of the transform, and close
+    /// both queues so no stage waits for one that is gone
+    void halt ( const std::string& reason );
+
+    Reindexer ( const Reindexer& );
+    Reindexer& operator= ( const Reindexer& );
+
+    ElasticSearch& _source;
+    ElasticSearch& _dest;
+    const ReindexOptions _options;
+
+    /// state of the running copy
+    const std::string* _index;
+    const std::string* _type;
+    BlockingQueue<Json::Value*>* _pages;
+    BlockingQueue<Batch*>* _batches;
+    volatile int _next_slice;
+    volatile int _readers_left;
+    volatile int _workers_left;
+
+    /// result of the running copy, guarded by _mutex
+    ReindexResult* _result;
+    MutexLock _mutex;
+};
+
+} // end namespace
+#endif // _REINDEX_HEADER_H_
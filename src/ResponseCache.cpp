@@ -0,0 +1,290 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "ResponseCache.h"
+#include <sys/time.h>
+
+namespace cppes {
+
+struct ResponseCache::Entry
+{
+    std::string key;
+    Json::Value value;          // never changes once cached
+    Scope scope;
+    std::string index;
+    uint64_t generation;        // of index when the response was requested
+    uint64_t expires_us;        // 0 for never
+    size_t bytes;
+    bool hot;                   // in the protected segment
+    Segment::iterator position;
+    volatile int refs;          // the cache and readers copying the value
+};
+
+static uint64_t nowMicros()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// A query of several indices, or of a pattern, is made stale by any write.
+
+static bool severalIndices(const std::string& index)
+{
+    return index.empty() || "_all" == index || std::string::npos != index.find_first_of(",*");
+}
+
+ResponseCache::ResponseCache(const CacheOptions& options)
+: _options(options)
+, _protected_bytes_max(options.max_bytes / 100 * options.protected_percent)
+, _mutex()
+, _entries()
+, _probation()
+, _protected()
+, _bytes(0)
+, _protected_bytes(0)
+, _generations()
+, _writes(0)
+, _clears(0)
+, _stats()
+{
+}
+
+ResponseCache::~ResponseCache()
+{
+    clear();
+}
+
+bool ResponseCache::get(const std::string& key, const std::string& index, Json::Value& value, bool* stale)
+{
+    if (NULL != stale)
+        *stale = false;
+
+    Entry* entry;
+    {
+        MutexLockGuard lock(_mutex);
+        Entries::iterator it = _entries.find(key);
+        if (it == _entries.end())
+        {
+            ++_stats.misses;
+            return false;
+        }
+
+        entry = it->second;
+        if (0 != entry->expires_us && nowMicros() >= entry->expires_us)
+        {
+            if (NULL == stale || !_options.revalidate || DOCUMENT != entry->scope)
+            {
+                ++_stats.expirations;
+                ++_stats.misses;
+                unlink(it);
+                return false;
+            }
+
+            // counted by renew() if it is still current
+            *stale = true;
+        }
+        else if (QUERY == entry->scope && entry->generation != currentGeneration(index))
+        {
+            ++_stats.invalidations;
+            ++_stats.misses;
+            unlink(it);
+            return false;
+        }
+        else
+        {
+            ++_stats.hits;
+        }
+
+        promote(entry);
+        __sync_fetch_and_add(&entry->refs, 1);
+    }
+
+    value = entry->value;
+    release(entry);
+    return true;
+}
+
+void ResponseCache::renew(const std::string& key)
+{
+    MutexLockGuard lock(_mutex);
+    Entries::iterator it = _entries.find(key);
+    if (it == _entries.end())
+        return;
+
+    ++_stats.revalidations;
+    it->second->expires_us = nowMicros() + _options.ttl_us;
+}
+
+uint64_t ResponseCache::generation(const std::string& index) const
+{
+    MutexLockGuard lock(_mutex);
+    return currentGeneration(index);
+}
+
+void ResponseCache::put(const std::string& key, Scope scope, const std::string& index, uint64_t generation,
+                        const Json::Value& value, size_t bytes)
+{
+    if (!enabled())
+        return;
+
+    bytes += key.size();
+    if (bytes > _options.max_bytes)
+        return;
+
+    Entry* entry = new Entry;
+    entry->key = key;
+    entry->value = value;
+    entry->scope = scope;
+    entry->index = index;
+    entry->generation = generation;
+    entry->expires_us = _options.ttl_us > 0 ? nowMicros() + _options.ttl_us : 0;
+    entry->bytes = bytes;
+    entry->hot = false;
+    entry->refs = 1;
+
+    MutexLockGuard lock(_mutex);
+
+    // a write was under way, the response may be older than it
+    if (generation != currentGeneration(index))
+    {
+        release(entry);
+        return;
+    }
+
+    Entries::iterator it = _entries.find(key);
+    if (it != _entries.end())
+        unlink(it);
+
+    _entries.insert(std::make_pair(key, entry));
+    _probation.push_front(entry);
+    entry->position = _probation.begin();
+    _bytes += bytes;
+    ++_stats.insertions;
+
+    while (_bytes > _options.max_bytes)
+    {
+        Entry* victim = _probation.empty() ? _protected.back() : _probation.back();
+        ++_stats.evictions;
+        unlink(_entries.find(victim->key));
+    }
+}
+
+void ResponseCache::invalidate(const std::string& index, const std::string& prefix)
+{
+    if (!enabled())
+        return;
+
+    MutexLockGuard lock(_mutex);
+    ++_writes;
+    ++_generations[index];
+
+    if (prefix.empty())
+        return;
+
+    Entries::iterator it = _entries.lower_bound(prefix);
+    while (it != _entries.end() && 0 == it->first.compare(0, prefix.size(), prefix))
+    {
+        const std::string& key = it->first;
+        bool match = key.size() == prefix.size() || '/' == prefix[prefix.size() - 1] || '?' == key[prefix.size()];
+
+        Entries::iterator next = it;
+        ++next;
+        if (match)
+        {
+            ++_stats.invalidations;
+            unlink(it);
+        }
+        it = next;
+    }
+}
+
+void ResponseCache::clear()
+{
+    MutexLockGuard lock(_mutex);
+    ++_clears;
+
+    while (!_entries.empty())
+        unlink(_entries.begin());
+}
+
+CacheStats ResponseCache::stats() const
+{
+    MutexLockGuard lock(_mutex);
+    CacheStats stats = _stats;
+    stats.entries = _entries.size();
+    stats.bytes = _bytes;
+    return stats;
+}
+
+// Both counts only grow, their sum changes with either.
+
+uint64_t ResponseCache::currentGeneration(const std::string& index) const
+{
+    if (severalIndices(index))
+        return _clears + _writes;
+
+    std::map<std::string, uint64_t>::const_iterator it = _generations.find(index);
+    return _clears + (it == _generations.end() ? 0 : it->second);
+}
+
+// Move a read entry to the head of the protected segment, and the oldest
+// protected entries beyond its budget back to probation.
+
+void ResponseCache::promote(Entry* entry)
+{
+    if (entry->hot)
+    {
+        _protected.splice(_protected.begin(), _protected, entry->position);
+        return;
+    }
+
+    _probation.erase(entry->position);
+    _protected.push_front(entry);
+    entry->position = _protected.begin();
+    entry->hot = true;
+    _protected_bytes += entry->bytes;
+
+    while (_protected_bytes > _protected_bytes_max && _protected.size() > 1)
+    {
+        Entry* demoted = _protected.back();
+        _protected.pop_back();
+        _protected_bytes -= demoted->bytes;
+
+        _probation.push_front(demoted);
+        demoted->position = _probation.begin();
+        demoted->hot = false;
+    }
+}
+
+void ResponseCache::unlink(Entries::iterator it)
+{
+    Entry* entry = it->second;
+    if (entry->hot)
+    {
+        _protected.erase(entry->position);
+        _protected_bytes -= entry->bytes;
+    }
+    else
+    {
+        _probation.erase(entry->position);
+    }
+
+    _bytes -= entry->bytes;
+    _entries.erase(it);
+    release(entry);
+}
+
+void ResponseCache::release(Entry* entry)
+{
+    if (0 == __sync_sub_and_fetch(&entry->refs, 1))
+        delete entry;
+}
+
+} // end namespace
@@ -0,0 +1,161 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _RESPONSE_CACHE_HEADER_H_
+#define _RESPONSE_CACHE_HEADER_H_
+#include <string>
+#include <list>
+#include <map>
+#include <stdint.h>
+#include "Mutex.h"
+#include "json/json.h"
+
+namespace cppes {
+
+/*
+ * @brief Configuration of the read cache, see ClientOptions::cache.
+ *  Writes of the client make stale the reads of the index name they
+ *  went to, and the reads of several indices, a comma list or a pattern.
+ *  The client does not know aliases: a read through an alias is not made
+ *  stale by a write to its backing index, nor the other way round. Such
+ *  entries live until ttl_us, set it low or clear the cache after those
+ *  writes, or do not read cached through aliases.
+ */
+struct CacheOptions
+{
+    CacheOptions ( )
+    : max_bytes(0)
+    , ttl_us(60 * 1000000ULL)
+    , protected_percent(80)
+    , revalidate(false)
+    {
+    }
+
+    size_t max_bytes;        // response bytes kept, 0 disables the cache
+    uint64_t ttl_us;         // age at which an entry is fetched again, 0 for never
+    int protected_percent;   // share of max_bytes for entries read more than once
+    bool revalidate;         // an expired document is kept if its version did not change
+};
+
+/*
+ * @brief Counters of the read cache.
+ */
+struct CacheStats
+{
+    CacheStats ( )
+    : hits(0), misses(0), insertions(0), evictions(0), expirations(0), invalidations(0)
+    , revalidations(0), entries(0), bytes(0)
+    {
+    }
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;       // dropped to stay within max_bytes
+    uint64_t expirations;     // dropped after ttl_us
+    uint64_t invalidations;   // dropped after a write through the client
+    uint64_t revalidations;   // expired documents found unchanged and kept
+    uint64_t entries;
+    uint64_t bytes;
+};
+
+/*
+ * @brief Bounded cache of parsed read responses, with a segmented LRU:
+ *  a new entry goes to the probation segment and moves to the protected
+ *  one when it is read again. Eviction takes the oldest probation entry
+ *  first, so a scan of keys read once never pushes out the hot ones.
+ *
+ *  Entries are documents or queries. A write to a document drops the
+ *  entries of that document at once; queries of the index written are
+ *  found stale on their next read, from a generation counted per index.
+ *  A response fetched while a write was under way is not kept.
+ *
+ *  Values are shared with the readers, a hit copies the value without
+ *  holding the lock.
+ */
+class ResponseCache
+{
+public:
+    /// what a key reads, which decides how writes make it stale
+    enum Scope
+    {
+        DOCUMENT,    // one document, dropped by invalidate() of its url
+        QUERY        // any document of its index
+    };
+
+    explicit ResponseCache ( const CacheOptions& options );
+    ~ResponseCache ( );
+
+    bool enabled ( ) const { return _options.max_bytes > 0; }
+
+    /*
+     * @brief Copy the value of key, false if it is not cached. With stale
+     *  not NULL and revalidate on, an expired document is copied too and
+     *  stale set, the caller checks it is current then renew()s it.
+     */
+    bool get ( const std::string& key, const std::string& index, Json::Value& value, bool* stale = NULL );
+
+    /// start the ttl of an expired document again
+    void renew ( const std::string& key );
+
+    /// writes seen for index so far, taken before the request of a put()
+    uint64_t generation ( const std::string& index ) const;
+
+    /// keep value of key, bytes is its response size; ignored if index was written since generation
+    void put ( const std::string& key, Scope scope, const std::string& index, uint64_t generation,
+              const Json::Value& value, size_t bytes );
+
+    /*
+     * @brief A write to index went through. Queries of index become stale
+     *  and the keys equal to prefix, or continuing it with a '?' or after
+     *  a '/' ending it, are dropped.
+     */
+    void invalidate ( const std::string& index, const std::string& prefix );
+
+    /// drop every entry
+    void clear ( );
+
+    CacheStats stats ( ) const;
+
+private:
+    struct Entry;
+    typedef std::list<Entry*> Segment;
+    typedef std::map<std::string, Entry*> Entries;
+
+    ResponseCache ( const ResponseCache& );
+    ResponseCache& operator= ( const ResponseCache& );
+
+    /// following functions are called with the lock held
+    uint64_t currentGeneration ( const std::string& index ) const;
+    void promote ( Entry* entry );
+    void unlink ( Entries::iterator it );
+
+    /// drop one reference, the last one deletes the entry
+    static void release ( Entry* entry );
+
+    const CacheOptions _options;
+    const size_t _protected_bytes_max;
+
+    mutable MutexLock _mutex;
+    Entries _entries;
+    Segment _probation;
+    Segment _protected;
+    size_t _bytes;
+    size_t _protected_bytes;
+
+    /// writes per index, and in total for queries of several indices
+    std::map<std::string, uint64_t> _generations;
+    uint64_t _writes;
+    uint64_t _clears;
+
+    CacheStats _stats;
+};
+
+} // end namespace
+#endif // _RESPONSE_CACHE_HEADER_H_
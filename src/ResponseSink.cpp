@@ -0,0 +1,74 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "ResponseSink.h"
+#include <unistd.h>
+#include <errno.h>
+#include <exception>
+
+namespace cppes {
+
+void StringSink::expect(size_t length)
+{
+    if (length > MAX_RESERVE)
+        length = MAX_RESERVE;
+
+    // only a hint, the body is appended anyway
+    try {
+        _output.reserve(_output.size() + length);
+    } catch (std::exception&) {
+    }
+}
+
+// write() runs inside libcurl, an exception must not unwind its C frames:
+// failing the write makes curl abort with CURLE_WRITE_ERROR.
+
+bool StringSink::write(const char* data, size_t length)
+{
+    try {
+        _output.append(data, length);
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
+
+bool DiscardSink::write(const char* data, size_t length)
+{
+    _bytes += length;
+    return true;
+}
+
+bool FdSink::write(const char* data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t n = ::write(_fd, data, length);
+        if (n < 0)
+        {
+            if (EINTR == errno)
+                continue;
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+bool CallbackSink::write(const char* data, size_t length)
+{
+    try {
+        return _callback(data, length, _userdata);
+    } catch (...) {
+        return false;
+    }
+}
+
+} // end namespace
@@ -0,0 +1,103 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _RESPONSE_SINK_HEADER_H_
+#define _RESPONSE_SINK_HEADER_H_
+#include <string>
+#include <cstddef>
+
+namespace cppes {
+
+/*
+ * @brief Destination of a response body, chosen by the caller of HttpClient.
+ */
+class ResponseSink
+{
+public:
+    virtual ~ResponseSink ( ) { }
+
+    /// Called with Content-Length before the first write(), if the server sent it
+    /// and a body follows. Runs inside libcurl, must not throw.
+    virtual void expect ( size_t length ) { }
+
+    /// Consume one chunk of body, return false to abort the transfer.
+    /// Runs inside libcurl too, an exception is taken as false.
+    virtual bool write ( const char* data, size_t length ) = 0;
+};
+
+/*
+ * @brief Append to a std::string, reserved once from Content-Length so a
+ *  big response does not grow by repeated reallocation. The reserve is
+ *  capped at MAX_RESERVE, a bigger body grows as it arrives, so a bogus
+ *  length cannot allocate more than that before any byte is read.
+ */
+class StringSink : public ResponseSink
+{
+public:
+    enum { MAX_RESERVE = 4 * 1024 * 1024 };
+
+    explicit StringSink ( std::string& output ) : _output(output) { }
+
+    virtual void expect ( size_t length );
+    virtual bool write ( const char* data, size_t length );
+
+private:
+    std::string& _output;
+};
+
+/*
+ * @brief Drop the body, only count its bytes. For HEAD, refresh and the
+ *  other calls whose answer is in the status code.
+ */
+class DiscardSink : public ResponseSink
+{
+public:
+    DiscardSink ( ) : _bytes(0) { }
+
+    virtual bool write ( const char* data, size_t length );
+    size_t bytes ( ) const { return _bytes; }
+
+private:
+    size_t _bytes;
+};
+
+/*
+ * @brief Write the body to a file descriptor as it arrives, e.g. for exports.
+ */
+class FdSink : public ResponseSink
+{
+public:
+    explicit FdSink ( int fd ) : _fd(fd) { }
+
+    virtual bool write ( const char* data, size_t length );
+
+private:
+    int _fd;
+};
+
+/*
+ * @brief Hand every chunk to a function, e.g. a streaming parser.
+ */
+class CallbackSink : public ResponseSink
+{
+public:
+    /// return false, or throw, to abort the transfer
+    typedef bool ( *callback_type ) ( const char* data, size_t length, void* userdata );
+
+    CallbackSink ( callback_type callback, void* userdata ) : _callback(callback), _userdata(userdata) { }
+
+    virtual bool write ( const char* data, size_t length );
+
+private:
+    callback_type _callback;
+    void* _userdata;
+};
+
+} // end namespace
+#endif // _RESPONSE_SINK_HEADER_H_
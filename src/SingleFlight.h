@@ -0,0 +1,116 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _SINGLE_FLIGHT_HEADER_H_
+#define _SINGLE_FLIGHT_HEADER_H_
+#include <map>
+#include <string>
+#include "Mutex.h"
+
+namespace cppes {
+
+/*
+ * @brief Lets concurrent identical calls share one execution. The first
+ *  caller of a key leads: it runs the call and finish()es it with the
+ *  value. Callers of the same key arriving before that wait() for the
+ *  value of the leader instead of running the call again. A key is free
+ *  again as soon as its call finished, nothing is cached.
+ */
+template <typename T>
+class SingleFlight
+{
+public:
+    /// one execution in flight, shared by its leader and followers
+    class Call
+    {
+    public:
+        explicit Call ( MutexLock& mutex ) : value(), done(false), refs(1), finished(mutex) { }
+
+        T value;
+        bool done;
+        int refs;            // leader and followers not gone yet
+        Condition finished;
+
+    private:
+        Call ( const Call& );
+        Call& operator= ( const Call& );
+    };
+
+    SingleFlight ( ) : _calls(), _mutex() { }
+
+    ~SingleFlight ( )
+    {
+        // every caller is gone, calls left were never finished
+        typename std::map<std::string, Call*>::iterator it = _calls.begin();
+        for (; it != _calls.end(); ++it)
+            delete it->second;
+    }
+
+    /// call of key, leader is true if the caller must run it and finish() it
+    Call* join ( const std::string& key, bool& leader )
+    {
+        MutexLockGuard lock(_mutex);
+        typename std::map<std::string, Call*>::iterator it = _calls.find(key);
+        if (it != _calls.end())
+        {
+            ++it->second->refs;
+            leader = false;
+            return it->second;
+        }
+
+        Call* call = new Call(_mutex);
+        _calls.insert(std::make_pair(key, call));
+        leader = true;
+        return call;
+    }
+
+    /// publish the value of the leader, wake the followers up
+    void finish ( const std::string& key, Call* call, const T& value )
+    {
+        MutexLockGuard lock(_mutex);
+        _calls.erase(key);
+        call->value = value;
+        call->done = true;
+        call->finished.notifyAll();
+        release(call);
+    }
+
+    /// copy of the value of the leader, once it finished
+    void wait ( Call* call, T& value )
+    {
+        {
+            MutexLockGuard lock(_mutex);
+            while (!call->done)
+                call->finished.wait();
+        }
+
+        // the value does not change anymore, copy it without the lock
+        value = call->value;
+
+        MutexLockGuard lock(_mutex);
+        release(call);
+    }
+
+private:
+    SingleFlight ( const SingleFlight& );
+    SingleFlight& operator= ( const SingleFlight& );
+
+    /// called with the lock held
+    void release ( Call* call )
+    {
+        if (0 == --call->refs)
+            delete call;
+    }
+
+    std::map<std::string, Call*> _calls;
+    MutexLock _mutex;
+};
+
+} // end namespace
+#endif // _SINGLE_FLIGHT_HEADER_H_
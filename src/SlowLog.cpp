@@ -0,0 +1,173 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "SlowLog.h"
+#include "HttpClient.h"
+#include "JsonScanner.h"
+#include <sys/time.h>
+
+namespace cppes {
+
+static inline uint64_t toMicros(double seconds)
+{
+    return seconds > 0 ? (uint64_t) (seconds * 1000000.0) : 0;
+}
+
+// Head of the request body, a pull source cannot be read twice.
+
+static std::string bodySample(const BodySource& body, size_t limit)
+{
+    if (body.empty() || 0 == limit || !body.replayable())
+        return std::string();
+
+    if (body.contiguous())
+    {
+        size_t length = (size_t) body.length();
+        return std::string(body.data(), length < limit ? length : limit);
+    }
+
+    std::string sample(limit, '\0');
+    BodySource::Reader reader(body);
+    size_t size = 0, n;
+    while (size < limit && (n = reader.read(&sample[size], limit - size)) > 0)
+        size += n;
+
+    sample.resize(size);
+    return sample;
+}
+
+// "took" of a response, ES writes it first.
+
+static long responseTook(const std::string& response)
+{
+    JsonScanner scanner(response.data(), response.data() + response.size());
+    if (!scanner.beginObject())
+        return -1;
+
+    std::string key;
+    while (scanner.nextMember(key))
+    {
+        if ("took" == key)
+        {
+            long took;
+            return scanner.readInt(took) ? took : -1;
+        }
+
+        if (!scanner.skipValue())
+            break;
+    }
+
+    return -1;
+}
+
+void StreamSlowLogSink::write(const SlowRequest& request)
+{
+    MutexLockGuard lock(_mutex);
+
+    _out << "[Request]:(" << request.method << ")" << request.url << std::endl;
+    if (!request.body_sample.empty())
+        _out << "[Data]:" << request.body_sample << std::endl;
+    _out << "[Response]:" << request.response_sample << std::endl;
+    _out << "[Timing]:" << request.operation
+        << " status=" << request.status_code
+        << " took_ms=" << request.took_ms
+        << " total_us=" << request.total_us
+        << " ttfb_us=" << request.ttfb_us
+        << " dns_us=" << request.dns_us
+        << " connect_us=" << request.connect_us
+        << " tls_us=" << request.tls_us << std::endl;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+SlowLog::SlowLog(const SlowLogOptions& options)
+: _options(options)
+, _mutex()
+, _ring()
+, _next(0)
+, _total(0)
+{
+}
+
+void SlowLog::record(const char* operation, const char* method, const std::string& url,
+                     const BodySource& body, const HttpContext& context,
+                     const std::string* response, bool failed)
+{
+    SlowRequest request;
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    request.time_us = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+
+    request.operation = operation;
+    request.method = method;
+    request.url = url;
+    request.body_size = body.length();
+    request.body_sample = bodySample(body, _options.sample_bytes);
+    request.status_code = context.status_code;
+    request.failed = failed;
+
+    // curl times are cumulative from the start of the request
+    if (context.num_connects > 0)
+    {
+        request.dns_us = toMicros(context.namelookup_time);
+        request.connect_us = toMicros(context.connect_time - context.namelookup_time);
+        if (context.appconnect_time > 0)
+            request.tls_us = toMicros(context.appconnect_time - context.connect_time);
+    }
+    request.ttfb_us = toMicros(context.starttransfer_time);
+    request.total_us = toMicros(context.total_time);
+    request.response_size = (uint64_t) context.size_download;
+
+    if (NULL != response)
+    {
+        request.took_ms = responseTook(*response);
+        request.response_sample = response->substr(0, _options.sample_bytes);
+    }
+
+    __sync_fetch_and_add(&_total, 1);
+
+    if (NULL != _options.sink)
+        _options.sink->write(request);
+
+    if (0 == _options.capacity)
+        return;
+
+    MutexLockGuard lock(_mutex);
+    if (_ring.size() < _options.capacity)
+    {
+        _ring.push_back(request);
+    }
+    else
+    {
+        _ring[_next] = request;
+    }
+    _next = (_next + 1) % _options.capacity;
+}
+
+std::vector<SlowRequest> SlowLog::entries() const
+{
+    MutexLockGuard lock(_mutex);
+
+    std::vector<SlowRequest> entries;
+    entries.reserve(_ring.size());
+    if (_ring.size() < _options.capacity)
+    {
+        entries = _ring;
+    }
+    else
+    {
+        entries.insert(entries.end(), _ring.begin() + _next, _ring.end());
+        entries.insert(entries.end(), _ring.begin(), _ring.begin() + _next);
+    }
+
+    return entries;
+}
+
+} // end namespace
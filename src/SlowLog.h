@@ -0,0 +1,142 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _SLOW_LOG_HEADER_H_
+#define _SLOW_LOG_HEADER_H_
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdint.h>
+#include "Mutex.h"
+
+namespace cppes {
+
+struct HttpContext;
+class BodySource;
+
+/*
+ * @brief One request kept by the slow log: slower than the threshold, or
+ *  whose response the client did not understand.
+ */
+struct SlowRequest
+{
+    SlowRequest ( )
+    : time_us(0), operation(), method(), url(), body_size(0), body_sample()
+    , curl_code(0), status_code(0), took_ms(-1), failed(false)
+    , dns_us(0), connect_us(0), tls_us(0), ttfb_us(0), total_us(0)
+    , response_size(0), response_sample()
+    {
+    }
+
+    uint64_t time_us;              // wall clock of the end, since the epoch
+    std::string operation;         // ElasticSearch method, e.g. "search"
+    std::string method;            // HTTP method
+    std::string url;
+    long long body_size;           // request body bytes, -1 if sent chunked
+    std::string body_sample;       // head of the request body, truncated
+    int curl_code;                 // CURLcode, 0 on success
+    long status_code;              // HTTP status, 0 if no response
+    long took_ms;                  // "took" of the response, -1 if none
+    bool failed;                   // logged because the response was wrong
+
+    // client side breakdown in microseconds, dns/connect/tls are 0 on a reused connection
+    uint64_t dns_us;
+    uint64_t connect_us;
+    uint64_t tls_us;
+    uint64_t ttfb_us;
+    uint64_t total_us;
+
+    uint64_t response_size;        // response body bytes
+    std::string response_sample;   // head of the response body, truncated
+};
+
+/*
+ * @brief Destination of slow requests besides the ring buffer.
+ *  Called on the thread of the request, must be thread safe.
+ */
+class SlowLogSink
+{
+public:
+    virtual ~SlowLogSink ( ) { }
+    virtual void write ( const SlowRequest& request ) = 0;
+};
+
+/*
+ * @brief Print slow requests to a stream, the format of the old debug dumps.
+ */
+class StreamSlowLogSink : public SlowLogSink
+{
+public:
+    explicit StreamSlowLogSink ( std::ostream& out ) : _out(out) { }
+    virtual void write ( const SlowRequest& request );
+
+private:
+    MutexLock _mutex;
+    std::ostream& _out;
+};
+
+/*
+ * @brief Configuration of the slow log, see ClientOptions::slowLog.
+ */
+struct SlowLogOptions
+{
+    SlowLogOptions ( )
+    : threshold_us(0)
+    , capacity(128)
+    , sample_bytes(256)
+    , sink(NULL)
+    {
+    }
+
+    uint64_t threshold_us;   // requests at least this slow are logged, 0 for none
+    size_t capacity;         // entries kept in the ring buffer
+    size_t sample_bytes;     // bytes of request and response bodies kept
+    SlowLogSink* sink;       // also write every entry here, not owned, may be NULL
+};
+
+/*
+ * @brief Bounded log of slow and failed requests. A fast request costs one
+ *  comparison; only a logged one copies its url and body samples and takes
+ *  the lock of the ring buffer, where the oldest entry is overwritten.
+ */
+class SlowLog
+{
+public:
+    explicit SlowLog ( const SlowLogOptions& options );
+
+    /// true if a request which took total_time seconds is logged
+    bool isSlow ( double total_time ) const
+    {
+        return _options.threshold_us > 0 && total_time * 1000000.0 >= _options.threshold_us;
+    }
+
+    /// log one request, response may be NULL if the caller consumed it
+    void record ( const char* operation, const char* method, const std::string& url,
+                 const BodySource& body, const HttpContext& context,
+                 const std::string* response, bool failed );
+
+    /// logged entries, the oldest first
+    std::vector<SlowRequest> entries ( ) const;
+
+    /// requests logged since construction, including the overwritten ones
+    uint64_t total ( ) const { return _total; }
+
+private:
+    SlowLog ( const SlowLog& );
+    SlowLog& operator= ( const SlowLog& );
+
+    const SlowLogOptions _options;
+    mutable MutexLock _mutex;
+    std::vector<SlowRequest> _ring;
+    size_t _next;
+    volatile uint64_t _total;
+};
+
+} // end namespace
+#endif // _SLOW_LOG_HEADER_H_
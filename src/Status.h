@@ -0,0 +1,72 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _STATUS_HEADER_H_
+#define _STATUS_HEADER_H_
+#include <string>
+
+namespace cppes {
+
+/*
+ * @brief Kind of failure of a call, see Status.
+ */
+enum ErrorKind
+{
+    ERR_NONE = 0,       // success
+    ERR_NOT_FOUND,      // document or index does not exist
+    ERR_TRANSPORT,      // no response, see Status::curl_code
+    ERR_SERVER,         // the server answered with an error, see Status::reason
+    ERR_TIMED_OUT,      // the server gave up, e.g. search "timed_out"
+    ERR_RESPONSE,       // the response could not be understood
+    ERR_READ_ONLY,      // the client is read only
+    ERR_CONFLICT        // the document changed since the version a write was conditioned on
+};
+
+/*
+ * @brief Result of the non-throwing try* functions of ElasticSearch.
+ *  Nothing is allocated on success or on a plain miss; reason is only
+ *  filled when the server explains a failure or the response is wrong.
+ */
+struct Status
+{
+    Status ( ) : kind(ERR_NONE), http_status(0), curl_code(0), reason() { }
+
+    bool ok ( ) const        { return ERR_NONE == kind;      }
+    bool notFound ( ) const  { return ERR_NOT_FOUND == kind; }
+    bool conflict ( ) const  { return ERR_CONFLICT == kind;  }
+
+    /// reason, or a short description of kind if the server gave none
+    std::string message ( ) const
+    {
+        if (!reason.empty())
+            return reason;
+
+        switch (kind)
+        {
+            case ERR_NONE:      return "ok";
+            case ERR_NOT_FOUND: return "not found";
+            case ERR_TRANSPORT: return "transport failure";
+            case ERR_SERVER:    return "server error";
+            case ERR_TIMED_OUT: return "timed out";
+            case ERR_RESPONSE:  return "unexpected response";
+            case ERR_READ_ONLY: return "read only";
+            case ERR_CONFLICT:  return "version conflict";
+        }
+
+        return "unknown";
+    }
+
+    ErrorKind kind;
+    long http_status;        // HTTP status code, 0 if no response
+    int curl_code;           // CURLcode, 0 unless the transport failed
+    std::string reason;      // reason given by the server, or the response
+};
+
+} // end namespace
+#endif // _STATUS_HEADER_H_
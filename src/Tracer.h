@@ -0,0 +1,70 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#ifndef _TRACER_HEADER_H_
+#define _TRACER_HEADER_H_
+#include <cstddef>
+#include <stdint.h>
+
+namespace cppes {
+
+/*
+ * @brief One request of ElasticSearch as seen by a Tracer. The same span
+ *  is passed to every event of the request, filled a bit more each time.
+ *  Times are in microseconds, relative to start_us unless noted.
+ */
+struct TraceSpan
+{
+    TraceSpan ( )
+    : operation(NULL), method(NULL), url(NULL), request_id(0)
+    , curl_code(0), status_code(0), start_us(0), first_byte_us(0)
+    , total_us(0), parse_us(0), bytes_sent(0), bytes_received(0)
+    {
+    }
+
+    const char* operation;     // ElasticSearch method, e.g. "getDocument"
+    const char* method;        // HTTP method
+    const char* url;           // full request url, valid during the callback only
+    uint64_t request_id;       // unique in the process, same for every event of a request
+    int curl_code;             // CURLcode of the transfer, 0 on success
+    int status_code;           // HTTP status, 0 if no response
+    uint64_t start_us;         // wall clock of the start, since the epoch
+    uint64_t first_byte_us;    // first byte of the response
+    uint64_t total_us;         // end of the transfer
+    uint64_t parse_us;         // time spent parsing the response, after total_us
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+};
+
+/*
+ * @brief Request lifecycle callbacks, to bridge the client into a
+ *  distributed tracer. Install one with ClientOptions::tracer; without
+ *  it, every hook costs a single pointer test.
+ *  Callbacks run on the thread doing the request and must be thread safe.
+ */
+class Tracer
+{
+public:
+    virtual ~Tracer ( ) { }
+
+    /// Before the request is sent.
+    virtual void onStart ( const TraceSpan& span ) { }
+
+    /// First bytes of the response body arrived.
+    virtual void onFirstByte ( const TraceSpan& span ) { }
+
+    /// The transfer is over, successful or not.
+    virtual void onComplete ( const TraceSpan& span ) { }
+
+    /// The response has been parsed by the client.
+    virtual void onParsed ( const TraceSpan& span ) { }
+};
+
+} // end namespace
+#endif // _TRACER_HEADER_H_
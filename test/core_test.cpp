@@ -0,0 +1,521 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "testlib/lut.h"
+#include "HandlePool.h"
+#include "ResponseSink.h"
+#include "Metrics.h"
+#include "HttpClient.h"
+#include "SlowLog.h"
+#include "BodySource.h"
+#include "Exception.h"
+#include "Query.h"
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <pthread.h>
+#include <sys/time.h>
+
+using namespace cppes;
+
+/*
+ * 不需要网络的内部组件测试
+ */
+
+static volatile int s_destroyed = 0;
+
+static void countDestroy(void* handle)
+{
+    (void) handle;
+    __sync_fetch_and_add(&s_destroyed, 1);
+}
+
+TEST(HandlePool, GET_PUT)
+{
+    HandlePool pool(4, NULL);
+    ASSERT_TRUE(NULL == pool.acquire());
+
+    int a = 0;
+    ASSERT_TRUE(pool.release(&a));
+    ASSERT_TRUE(&a == pool.acquire());
+    ASSERT_TRUE(NULL == pool.acquire());
+}
+
+TEST(HandlePool, CAPACITY)
+{
+    // more than the slots of a cache line, over every shard
+    const size_t capacity = 67;
+    std::vector<int> handles(capacity + 5);
+
+    s_destroyed = 0;
+    {
+        HandlePool pool(capacity, countDestroy);
+        ASSERT_EQ(pool.capacity(), capacity);
+
+        size_t kept = 0;
+        for (size_t i = 0; i < handles.size(); ++i)
+            kept += pool.release(&handles[i]) ? 1 : 0;
+        ASSERT_EQ(kept, capacity);
+
+        // every handle kept comes back once
+        std::vector<bool> seen(handles.size(), false);
+        for (size_t i = 0; i < capacity; ++i)
+        {
+            int* handle = (int*) pool.acquire();
+            ASSERT_TRUE(NULL != handle);
+            size_t n = handle - &handles[0];
+            ASSERT_LT(n, handles.size());
+            ASSERT_TRUE(!seen[n]);
+            seen[n] = true;
+        }
+        ASSERT_TRUE(NULL == pool.acquire());
+
+        // the ones left at destruction go to the destroy function
+        for (size_t i = 0; i < 3; ++i)
+            ASSERT_TRUE(pool.release(&handles[i]));
+        ASSERT_EQ((int) s_destroyed, 0);
+    }
+    ASSERT_EQ((int) s_destroyed, 3);
+
+    HandlePool none(0, NULL);
+    ASSERT_TRUE(!none.release(&handles[0]));
+    ASSERT_TRUE(NULL == none.acquire());
+}
+
+struct PoolJob
+{
+    HandlePool* pool;
+    volatile int* owners;       // thread using each handle, 0 when idle
+    int thread;
+    int rounds;
+    int overlaps;               // handles found in use by another thread, or refused back
+};
+
+static void* usePool(void* arg)
+{
+    PoolJob* job = (PoolJob*) arg;
+    for (int i = 0; i < job->rounds; ++i)
+    {
+        int* handle = (int*) job->pool->acquire();
+        if (NULL == handle)
+            continue;
+
+        int n = *handle;
+        if (!__sync_bool_compare_and_swap(&job->owners[n], 0, job->thread))
+            ++job->overlaps;
+        __sync_bool_compare_and_swap(&job->owners[n], job->thread, 0);
+        if (!job->pool->release(handle))
+            ++job->overlaps;
+    }
+    return NULL;
+}
+
+TEST(HandlePool, CONCURRENT)
+{
+    const int threads = 8;
+    const int count = 16;
+    std::vector<int> handles(count);
+    std::vector<int> owners(count, 0);
+
+    HandlePool pool(count, NULL);
+    for (int i = 0; i < count; ++i)
+    {
+        handles[i] = i;
+        ASSERT_TRUE(pool.release(&handles[i]));
+    }
+
+    std::vector<PoolJob> jobs(threads);
+    std::vector<pthread_t> ids(threads);
+    for (int i = 0; i < threads; ++i)
+    {
+        PoolJob job = { &pool, (volatile int*) &owners[0], i + 1, 100000, 0 };
+        jobs[i] = job;
+        ASSERT_EQ(pthread_create(&ids[i], NULL, usePool, &jobs[i]), 0);
+    }
+    for (int i = 0; i < threads; ++i)
+        pthread_join(ids[i], NULL);
+
+    // no handle was held by two threads at once, none was lost
+    for (int i = 0; i < threads; ++i)
+        ASSERT_EQ(jobs[i].overlaps, 0);
+
+    std::vector<bool> seen(count, false);
+    for (int i = 0; i < count; ++i)
+    {
+        int* handle = (int*) pool.acquire();
+        ASSERT_TRUE(NULL != handle);
+        ASSERT_TRUE(!seen[*handle]);
+        seen[*handle] = true;
+    }
+    ASSERT_TRUE(NULL == pool.acquire());
+}
+
+TEST(ResponseSink, STRING_SINK)
+{
+    std::string output;
+    StringSink sink(output);
+
+    sink.expect(1000);
+    ASSERT_GE(output.capacity(), 1000u);
+    ASSERT_TRUE(sink.write("abc", 3));
+    ASSERT_EQ(output, std::string("abc"));
+
+    // a bogus Content-Length reserves no more than the cap
+    std::string huge;
+    StringSink capped(huge);
+    capped.expect((size_t) -1 / 2);
+    ASSERT_GE(huge.capacity(), (size_t) StringSink::MAX_RESERVE);
+    ASSERT_LT(huge.capacity(), (size_t) StringSink::MAX_RESERVE * 2);
+}
+
+TEST(Metrics, BUCKETS)
+{
+    // exact below LINEAR, the middle of the bucket above
+    for (uint64_t v = 0; v < LatencyHistogram::LINEAR; ++v)
+        ASSERT_EQ(LatencyHistogram::valueOf(LatencyHistogram::bucketOf(v)), v);
+
+    for (uint64_t v = LatencyHistogram::LINEAR; v < 0xFFFFFFFFULL; v = v * 5 / 4 + 1)
+    {
+        uint64_t back = LatencyHistogram::valueOf(LatencyHistogram::bucketOf(v));
+        uint64_t error = back > v ? back - v : v - back;
+        ASSERT_LE(error * 32, v);
+    }
+
+    // every bucket maps back to itself, and they stay in order
+    int last = LatencyHistogram::bucketOf(0xFFFFFFFFULL);
+    ASSERT_LT(last, (int) LatencyHistogram::BUCKETS);
+    for (int b = 0; b <= last; ++b)
+    {
+        ASSERT_EQ(LatencyHistogram::bucketOf(LatencyHistogram::valueOf(b)), b);
+        if (b > 0)
+            ASSERT_LT(LatencyHistogram::valueOf(b - 1), LatencyHistogram::valueOf(b));
+    }
+
+    // too big values are clamped to the last bucket
+    ASSERT_EQ(LatencyHistogram::bucketOf(1ULL << 40), last);
+}
+
+TEST(Metrics, PERCENTILES)
+{
+    LatencyHistogram histogram;
+    ASSERT_EQ(histogram.percentile(50), 0u);
+
+    for (uint64_t v = 1; v <= 10000; ++v)
+        histogram.record(v);
+
+    ASSERT_EQ(histogram.count(), 10000u);
+    ASSERT_EQ(histogram.max(), 10000u);
+    ASSERT_TRUE(histogram.mean() > 5000.4 && histogram.mean() < 5000.6);
+
+    double percents[] = { 1, 50, 90, 99, 99.9 };
+    for (size_t i = 0; i < sizeof (percents) / sizeof (percents[0]); ++i)
+    {
+        double exact = percents[i] * 100;
+        double value = (double) histogram.percentile(percents[i]);
+        ASSERT_TRUE(value > exact * 0.96 && value < exact * 1.04);
+    }
+    ASSERT_EQ(histogram.percentile(100), 10000u);
+
+    LatencyHistogram other;
+    other.record(20000);
+    histogram.merge(other);
+    ASSERT_EQ(histogram.count(), 10001u);
+    ASSERT_EQ(histogram.max(), 20000u);
+    ASSERT_EQ(histogram.percentile(100), 20000u);
+}
+
+static HttpContext requestTo(const char* ip, long connects, long status)
+{
+    HttpContext context;
+    strncpy(context.primary_ip, ip, sizeof (context.primary_ip) - 1);
+    context.num_connects = connects;
+    context.status_code = status;
+    context.starttransfer_time = 0.001;
+    context.total_time = 0.002;
+    context.size_upload = 10;
+    context.size_download = 100;
+    return context;
+}
+
+TEST(Metrics, COUNTS)
+{
+    Metrics metrics;
+    ASSERT_TRUE(metrics.enabled());
+
+    metrics.record(API_GET, requestTo("10.0.0.1", 1, 200), true);
+    metrics.record(API_GET, requestTo("10.0.0.1", 0, 200), true);
+    metrics.record(API_GET, requestTo("10.0.0.2", 0, 200), true);
+    metrics.record(API_INDEX, requestTo("10.0.0.2", 1, 503), false);
+
+    MetricsSnapshot snapshot = metrics.snapshot();
+    ASSERT_EQ(snapshot.apis.size(), 2u);
+    ASSERT_EQ(snapshot.apis[0].name, std::string("getDocument"));
+    ASSERT_EQ(snapshot.apis[0].requests, 3u);
+    ASSERT_EQ(snapshot.apis[0].errors, 0u);
+    ASSERT_EQ(snapshot.apis[0].new_connections, 1u);
+    ASSERT_EQ(snapshot.apis[0].bytes_received, 300u);
+    ASSERT_EQ(snapshot.apis[0].total.count, 3u);
+    ASSERT_EQ(snapshot.apis[1].name, std::string("index"));
+    ASSERT_EQ(snapshot.apis[1].errors, 1u);
+
+    ASSERT_EQ(snapshot.nodes.size(), 2u);
+    ASSERT_EQ(snapshot.nodes[0].name, std::string("10.0.0.1"));
+    ASSERT_EQ(snapshot.nodes[0].requests, 2u);
+    ASSERT_TRUE(snapshot.nodes[0].reuse_rate > 0.49 && snapshot.nodes[0].reuse_rate < 0.51);
+    ASSERT_EQ(snapshot.nodes[1].name, std::string("10.0.0.2"));
+    ASSERT_EQ(snapshot.nodes[1].requests, 2u);
+    ASSERT_EQ(snapshot.nodes[1].errors, 1u);
+
+    // nodes beyond the slots are only counted per operation
+    for (int i = 0; i < 40; ++i)
+    {
+        char ip[32];
+        snprintf(ip, sizeof (ip), "10.0.1.%d", i);
+        metrics.record(API_SEARCH, requestTo(ip, 0, 200), true);
+    }
+    snapshot = metrics.snapshot();
+    ASSERT_EQ(snapshot.nodes.size(), 16u);
+    ASSERT_EQ(snapshot.apis[2].name, std::string("search"));
+    ASSERT_EQ(snapshot.apis[2].requests, 40u);
+
+    Metrics disabled(false);
+    ASSERT_TRUE(!disabled.enabled());
+    disabled.record(API_GET, requestTo("10.0.0.1", 1, 200), true);
+    ASSERT_TRUE(disabled.snapshot().apis.empty());
+    ASSERT_TRUE(disabled.snapshot().nodes.empty());
+}
+
+/// counts what the slow log writes to it
+class CountingSlowLogSink : public SlowLogSink
+{
+public:
+    CountingSlowLogSink ( ) : written(0) { }
+    virtual void write ( const SlowRequest& ) { ++written; }
+
+    int written;
+};
+
+TEST(SlowLog, THRESHOLD)
+{
+    SlowLogOptions off;
+    ASSERT_TRUE(!SlowLog(off).isSlow(100.0));
+
+    SlowLogOptions options;
+    options.threshold_us = 1000;
+    SlowLog log(options);
+    ASSERT_TRUE(!log.isSlow(0.0009));
+    ASSERT_TRUE(log.isSlow(0.001));
+    ASSERT_TRUE(log.isSlow(2.0));
+}
+
+TEST(SlowLog, RING)
+{
+    SlowLogOptions options;
+    options.threshold_us = 1;
+    CountingSlowLogSink sink;
+    options.sink = &sink;
+    SlowLog log(options);
+    ASSERT_EQ(options.capacity, 128u);
+
+    HttpContext context;
+    for (int i = 0; i < 200; ++i)
+    {
+        std::ostringstream url;
+        url << "http://node/" << i;
+        log.record("search", "GET", url.str(), BodySource(), context, NULL, false);
+    }
+
+    // the oldest entries were overwritten, the rest come oldest first
+    std::vector<SlowRequest> entries = log.entries();
+    ASSERT_EQ(entries.size(), 128u);
+    ASSERT_EQ(entries.front().url, std::string("http://node/72"));
+    ASSERT_EQ(entries.back().url, std::string("http://node/199"));
+    ASSERT_EQ(log.total(), 200u);
+    ASSERT_EQ(sink.written, 200);
+}
+
+TEST(SlowLog, FAILURE)
+{
+    SlowLogOptions options;
+    options.sample_bytes = 16;
+    SlowLog log(options);
+
+    HttpContext context;
+    context.status_code = 200;
+    context.num_connects = 1;
+    context.namelookup_time = 0.001;
+    context.connect_time = 0.003;
+    context.starttransfer_time = 0.010;
+    context.total_time = 0.012;
+    context.size_download = 64;
+
+    std::string body = "{\"query\":{\"match_all\":{}}}";
+    std::string response = "{\"took\":42,\"timed_out\":false,\"hits\":{}}";
+    log.record("search", "POST", "http://node/_search", body, context, &response, true);
+
+    std::vector<SlowRequest> entries = log.entries();
+    ASSERT_EQ(entries.size(), 1u);
+    const SlowRequest& entry = entries[0];
+    ASSERT_TRUE(entry.failed);
+    ASSERT_EQ(entry.operation, std::string("search"));
+    ASSERT_EQ(entry.method, std::string("POST"));
+    ASSERT_EQ(entry.body_size, (long long) body.size());
+    ASSERT_EQ(entry.body_sample, body.substr(0, 16));
+    ASSERT_EQ(entry.response_sample, response.substr(0, 16));
+    ASSERT_EQ(entry.took_ms, 42L);
+    ASSERT_EQ(entry.status_code, 200L);
+    ASSERT_EQ(entry.dns_us, 1000u);
+    ASSERT_EQ(entry.connect_us, 2000u);
+    ASSERT_EQ(entry.total_us, 12000u);
+    ASSERT_EQ(entry.response_size, 64u);
+}
+
+static uint64_t nowMicros()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void throwDeep(int depth)
+{
+    if (depth > 0)
+        throwDeep(depth - 1);
+    else
+        EXCEPTION("deep");
+}
+
+TEST(Exception, CHEAP_WHAT)
+{
+    // a thrown and caught exception only captures addresses
+    const int count = 2000;
+    uint64_t start = nowMicros();
+    for (int i = 0; i < count; ++i)
+    {
+        try {
+            throwDeep(20);
+        } catch (Exception& e) {
+            ASSERT_EQ(std::string(e.what()), std::string("deep"));
+        }
+    }
+    uint64_t throw_us = (nowMicros() - start) / count;
+
+    // symbolizing is what costs, and it is done once per exception
+    start = nowMicros();
+    for (int i = 0; i < 20; ++i)
+    {
+        try {
+            throwDeep(20);
+        } catch (Exception& e) {
+            e.stackTrace();
+        }
+    }
+    uint64_t trace_us = (nowMicros() - start) / 20;
+
+    std::cout << "throw " << throw_us << "us, with stackTrace() " << trace_us << "us" << std::endl;
+    ASSERT_LT(throw_us, trace_us);
+}
+
+TEST(Exception, STACK_TRACE)
+{
+    try {
+        throwDeep(3);
+    } catch (Exception& e) {
+        const char* trace = e.stackTrace();
+        std::string text(trace);
+        ASSERT_TRUE(std::string::npos != text.find("core_test.cpp"));
+        ASSERT_TRUE(std::string::npos != text.find(">>>[0]"));
+
+        // built once, then the same text
+        ASSERT_TRUE(trace == e.stackTrace());
+
+        Exception copy(e);
+        ASSERT_EQ(std::string(copy.what()), std::string("deep"));
+        ASSERT_EQ(std::string(copy.stackTrace()), text);
+    }
+
+    int depth = Exception::stackTraceDepth();
+    Exception::setStackTraceDepth(0);
+    try {
+        throwDeep(3);
+    } catch (Exception& e) {
+        std::string text(e.stackTrace());
+        ASSERT_TRUE(std::string::npos != text.find("core_test.cpp"));
+        ASSERT_TRUE(std::string::npos == text.find(">>>"));
+    }
+    Exception::setStackTraceDepth(depth);
+}
+
+struct TraceJob
+{
+    const Exception* exception;
+    std::string trace;
+};
+
+static void* readTrace(void* arg)
+{
+    TraceJob* job = (TraceJob*) arg;
+    job->trace = job->exception->stackTrace();
+    return NULL;
+}
+
+TEST(Exception, CONCURRENT_STACK_TRACE)
+{
+    try {
+        throwDeep(5);
+    } catch (Exception& e) {
+        TraceJob jobs[8];
+        pthread_t threads[8];
+        for (int i = 0; i < 8; ++i)
+        {
+            jobs[i].exception = &e;
+            ASSERT_EQ(pthread_create(&threads[i], NULL, readTrace, &jobs[i]), 0);
+        }
+        for (int i = 0; i < 8; ++i)
+            pthread_join(threads[i], NULL);
+
+        for (int i = 0; i < 8; ++i)
+            ASSERT_EQ(jobs[i].trace, std::string(e.stackTrace()));
+    }
+}
+
+static std::vector<int> makeIds()
+{
+    std::vector<int> ids;
+    for (int i = 1; i <= 3; ++i)
+        ids.push_back(i);
+    return ids;
+}
+
+static std::vector<std::string> makeTags()
+{
+    std::vector<std::string> tags;
+    tags.push_back("x");
+    tags.push_back("y");
+    return tags;
+}
+
+TEST(Query, TERMS_KEPT)
+{
+    std::cout << "[1]terms built from temporaries, written in a later statement" << std::endl;
+    TermsQuery<int> ids = termsQuery("id", makeIds());
+    TermsQuery<std::string> tags = termsQuery("tag", makeTags());
+
+    // overwrite the heap the temporaries used
+    std::vector<std::string> noise(64, std::string(64, 'z'));
+
+    QueryBuilder builder;
+    ASSERT_EQ(builder.query(boolQuery().filter(ids).filter(tags)).str(),
+              std::string("{\"query\":{\"bool\":{\"filter\":[{\"terms\":{\"id\":[1,2,3]}},{\"terms\":{\"tag\":[\"x\",\"y\"]}}]}}}"));
+
+    std::cout << "[2]a kept query written again by a reused builder" << std::endl;
+    ASSERT_EQ(builder.clear().query(tags).str(), std::string("{\"query\":{\"terms\":{\"tag\":[\"x\",\"y\"]}}}"));
+}
@@ -0,0 +1,1729 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+#include "testlib/lut.h"
+#include "ElasticSearch.h"
+#include "BulkFile.h"
+#include "Reindex.h"
+#include "MockServer.h"
+#include "ResponseSink.h"
+#include "HttpClient.h"
+#include "BodySource.h"
+#include "MultiTransport.h"
+#include "Tracer.h"
+#include "Mutex.h"
+#include "curl/curl.h"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+
+using namespace cppes;
+
+/*
+ * 与 unit_test.cpp 相同的流程，但运行在进程内的 MockServer 上，不需要集群
+ */
+
+TEST(MockServer, DOCUMENT)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    try {
+        ElasticSearch es(server.url());
+        std::cout << "[1]connect mock:" << server.url() << std::endl;
+        ASSERT_TRUE(es.isActive());
+
+        Json::Value doc;
+        doc["user"] = "kimchy";
+        doc["message"] = "trying out Elasticsearch";
+
+        std::cout << "[2]index, get and exist" << std::endl;
+        ASSERT_TRUE(es.index("twitter", "tweet", "1", doc));
+        ASSERT_TRUE(es.existIndex("twitter"));
+        ASSERT_TRUE(es.exist("twitter", "tweet", "1"));
+        ASSERT_TRUE(!es.exist("twitter", "tweet", "2"));
+
+        Json::Value msg;
+        ASSERT_TRUE(es.getDocument("twitter", "tweet", "1", msg));
+        ASSERT_EQ(msg["_source"]["user"].asString(), std::string("kimchy"));
+        ASSERT_TRUE(es.tryGetDocument("twitter", "tweet", "2", msg).notFound());
+
+        std::cout << "[3]update and upsert" << std::endl;
+        ASSERT_TRUE(es.update("twitter", "tweet", "1", "message", "updated"));
+        ASSERT_TRUE(es.getDocument("twitter", "tweet", "1", msg));
+        ASSERT_EQ(msg["_source"]["message"].asString(), std::string("updated"));
+        ASSERT_EQ(msg["_source"]["user"].asString(), std::string("kimchy"));
+        ASSERT_TRUE(es.upsert("twitter", "tweet", "3", doc));
+        ASSERT_TRUE(es.exist("twitter", "tweet", "3"));
+
+        std::cout << "[4]auto id and delete" << std::endl;
+        std::string id = es.index("twitter", "tweet", doc);
+        ASSERT_TRUE(!id.empty());
+        ASSERT_EQ(es.getDocumentCount("twitter", "tweet"), 3);
+        ASSERT_TRUE(es.deleteDocument("twitter", "tweet", id.c_str()));
+        ASSERT_TRUE(es.tryDeleteDocument("twitter", "tweet", id.c_str()).notFound());
+
+        std::cout << "[5]delete index" << std::endl;
+        ASSERT_TRUE(es.deleteIndex("twitter"));
+        ASSERT_TRUE(!es.existIndex("twitter"));
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+TEST(MockServer, BULK_AND_SEARCH)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    try {
+        ElasticSearch es(server.url());
+
+        std::cout << "[1]bulk" << std::endl;
+        BulkBuilder bulk;
+        for (int i = 0; i < 25; ++i)
+        {
+            Json::Value doc;
+            doc["number"] = i;
+            std::ostringstream id;
+            id << i;
+            bulk.index("numbers", "doc", id.str(), doc);
+        }
+        bulk.create("numbers", "doc", "0", Json::Value(Json::objectValue));
+        bulk.update("numbers", "doc", "missing", Json::Value(Json::objectValue));
+
+        std::vector<BulkItemError> errors;
+        ASSERT_TRUE(!es.bulk(bulk.str().c_str(), errors));
+        ASSERT_EQ(errors.size(), 2u);
+
+        std::cout << "[2]search and mget" << std::endl;
+        Json::Value result;
+        ASSERT_EQ(es.search("numbers", "doc", "{\"query\":{\"match_all\":{}}}", result), 10);
+        ASSERT_EQ(result["hits"]["total"].asInt(), 25);
+
+        std::vector<std::string> ids;
+        ids.push_back("1");
+        ids.push_back("26");
+        Json::Value docs;
+        ASSERT_EQ(es.mget("numbers", "doc", ids, docs), 1);
+
+        std::cout << "[3]scroll" << std::endl;
+        Json::Value all(Json::arrayValue);
+        ASSERT_EQ(es.fullScan("numbers", "doc", "{\"query\":{\"match_all\":{}}}", all, 7), 25);
+        ASSERT_EQ(all.size(), 25u);
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+TEST(MockServer, SYNTHETIC)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setPayloadSize(1024);
+    server.setSyntheticCount(42);
+
+    try {
+        ElasticSearch es(server.url());
+
+        Json::Value msg;
+        ASSERT_TRUE(es.getDocument("any", "doc", "1", msg));
+        ASSERT_GE(msg["_source"]["payload"].asString().size(), 900u);
+
+        Json::Value result;
+        ASSERT_EQ(es.search("any", "doc", "{\"size\":100}", result), 42);
+        ASSERT_EQ(es.getDocumentCount("any", "doc"), 42);
+        ASSERT_GE(server.requestCount(), 3ul);
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+TEST(MockServer, BULK_FILE)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    char path[] = "/tmp/cppes_bulk_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0);
+
+    // 500 documents, 10 deletes, then a create conflict; no final newline
+    std::ostringstream oss;
+    for (int i = 0; i < 500; ++i)
+        oss << "{\"index\":{\"_index\":\"file\",\"_type\":\"doc\",\"_id\":\"" << i << "\"}}\n{\"number\":" << i << "}\n";
+    for (int i = 0; i < 10; ++i)
+        oss << "{\"delete\":{\"_index\":\"file\",\"_type\":\"doc\",\"_id\":\"" << i << "\"}}\n";
+    oss << "{\"create\":{\"_index\":\"file\",\"_type\":\"doc\",\"_id\":\"100\"}}\n{\"number\":100}";
+
+    std::string data = oss.str();
+    ASSERT_EQ(write(fd, data.data(), data.size()), (ssize_t) data.size());
+    close(fd);
+
+    try {
+        ElasticSearch es(server.url());
+
+        BulkFileOptions options;
+        options.max_bytes = 4096;
+        options.concurrency = 4;
+
+        BulkFileResult result;
+        ASSERT_TRUE(BulkFileLoader(es, options).load(path, result));
+        ASSERT_EQ(result.actions, 511u);
+        ASSERT_GT(result.requests, 4u);
+        ASSERT_EQ(result.bytes, data.size() + 1);
+        ASSERT_EQ(result.failed_requests, 0u);
+        ASSERT_EQ(result.failed_actions, 1u);
+        ASSERT_EQ(result.errors[0].position, 510);
+        ASSERT_EQ(result.errors[0].status, 409);
+        ASSERT_EQ(es.getDocumentCount("file", "doc"), 490);
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+
+    unlink(path);
+}
+
+static bool collect(const char* data, size_t length, void* userdata)
+{
+    ((std::string*) userdata)->append(data, length);
+    return true;
+}
+
+// Inflate concatenated gzip members.
+
+static std::string gunzip(const std::string& data)
+{
+    std::string text;
+    z_stream stream;
+    memset(&stream, 0, sizeof (stream));
+    inflateInit2(&stream, 15 + 16);
+
+    stream.next_in = (Bytef*) data.data();
+    stream.avail_in = data.size();
+    char buffer[4096];
+    while (stream.avail_in > 0)
+    {
+        stream.next_out = (Bytef*) buffer;
+        stream.avail_out = sizeof (buffer);
+        int ret = inflate(&stream, Z_NO_FLUSH);
+        text.append(buffer, sizeof (buffer) - stream.avail_out);
+        if (Z_STREAM_END == ret)
+            inflateReset(&stream);
+        else if (Z_OK != ret)
+            break;
+    }
+
+    inflateEnd(&stream);
+    return text;
+}
+
+TEST(MockServer, EXPORT)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    try {
+        ElasticSearch es(server.url());
+
+        BulkBuilder bulk;
+        for (int i = 0; i < 100; ++i)
+        {
+            Json::Value doc;
+            doc["number"] = i;
+            doc["text"] = "quote \" and \\ backslash";
+            std::ostringstream id;
+            id << i;
+            bulk.index("export", "doc", id.str(), doc);
+        }
+        std::vector<BulkItemError> errors;
+        ASSERT_TRUE(es.bulk(bulk.str().c_str(), errors));
+
+        std::cout << "[1]export sources, 3 slices" << std::endl;
+        std::string text;
+        CallbackSink sink(collect, &text);
+        ExportOptions options;
+        options.scroll_size = 7;
+        options.slices = 3;
+        options.batch_bytes = 256;
+
+        ExportResult result;
+        ASSERT_TRUE(es.exportDocuments("export", "doc", "{\"sort\":[\"_doc\"]}", sink, options, &result));
+        ASSERT_EQ(result.documents, 100u);
+        ASSERT_EQ(result.bytes_written, text.size());
+        ASSERT_EQ((int) std::count(text.begin(), text.end(), '\n'), 100);
+
+        Json::Value doc;
+        ASSERT_TRUE(Json::Reader().parse(text.substr(0, text.find('\n')), doc));
+        ASSERT_EQ(doc["text"].asString(), std::string("quote \" and \\ backslash"));
+
+        std::cout << "[2]export gzip bulk file, load it back" << std::endl;
+        std::string compressed;
+        CallbackSink gzipSink(collect, &compressed);
+        options.compress = true;
+        options.bulk_format = true;
+        ASSERT_TRUE(es.exportDocuments("export", "doc", "", gzipSink, options, &result));
+        ASSERT_EQ(result.documents, 100u);
+        ASSERT_EQ((unsigned char) compressed[0], 0x1f);
+
+        std::string ndjson = gunzip(compressed);
+        ASSERT_EQ((int) std::count(ndjson.begin(), ndjson.end(), '\n'), 200);
+
+        ASSERT_TRUE(es.deleteIndex("export"));
+        BulkFileResult loaded;
+        BulkFileLoader(es).load(ndjson.data(), ndjson.size(), loaded);
+        ASSERT_TRUE(loaded.ok());
+        ASSERT_EQ(es.getDocumentCount("export", "doc"), 100);
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+// Keep even numbers and tag them.
+
+static bool evenOnly(Json::Value& hit, void* userdata)
+{
+    Json::Value& source = hit["_source"];
+    if (source["number"].asInt() % 2 != 0)
+        return false;
+
+    source["copied"] = *(const char**) userdata;
+    return true;
+}
+
+TEST(MockServer, REINDEX)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    try {
+        ElasticSearch es(server.url());
+
+        BulkBuilder bulk;
+        for (int i = 0; i < 200; ++i)
+        {
+            Json::Value doc;
+            doc["number"] = i;
+            std::ostringstream id;
+            id << i;
+            bulk.index("origin", "doc", id.str(), doc);
+        }
+        std::vector<BulkItemError> errors;
+        ASSERT_TRUE(es.bulk(bulk.str().c_str(), errors));
+
+        const char* tag = "yes";
+        ReindexOptions options;
+        options.dest_index = "copy";
+        options.transform = evenOnly;
+        options.userdata = &tag;
+        options.scroll_size = 15;
+        options.bulk_actions = 40;
+
+        for (int slices = 1; slices <= 3; slices += 2)
+        {
+            std::cout << "[" << slices << "]reindex with " << slices << " slice(s)" << std::endl;
+            options.slices = slices;
+
+            ReindexResult result;
+            ASSERT_TRUE(Reindexer(es, es, options).run("origin", "doc", result));
+            ASSERT_TRUE(result.ok());
+            ASSERT_EQ(result.read, 200u);
+            ASSERT_EQ(result.dropped, 100u);
+            ASSERT_EQ(result.written, 100u);
+            ASSERT_GE(result.bulk_requests, 3u);
+            ASSERT_EQ(es.getDocumentCount("copy", "doc"), 100);
+
+            Json::Value doc;
+            ASSERT_TRUE(es.getDocument("copy", "doc", "42", doc));
+            ASSERT_EQ(doc["_source"]["copied"].asString(), std::string("yes"));
+            ASSERT_TRUE(!es.exist("copy", "doc", "43"));
+            ASSERT_TRUE(es.deleteIndex("copy"));
+        }
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+struct CoalesceJob
+{
+    ElasticSearch* es;
+    volatile int found;
+    volatile int hits;
+};
+
+static void* coalesceThread(void* arg)
+{
+    CoalesceJob* job = (CoalesceJob*) arg;
+
+    Json::Value doc;
+    if (job->es->getDocument("hot", "doc", "1", doc) && "hot" == doc["_source"]["name"].asString())
+        __sync_fetch_and_add(&job->found, 1);
+
+    Json::Value result;
+    if (1 == job->es->search("hot", "doc", "{\"query\":{\"match_all\":{}}}", result))
+        __sync_fetch_and_add(&job->hits, 1);
+    return NULL;
+}
+
+TEST(MockServer, COALESCE)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    try {
+        ClientOptions options;
+        options.coalesce = true;
+        ElasticSearch es(server.url(), options);
+
+        Json::Value doc;
+        doc["name"] = "hot";
+        ASSERT_TRUE(es.index("hot", "doc", "1", doc));
+        es.refresh("hot");
+
+        std::cout << "[1]8 threads read the same document and search" << std::endl;
+        server.setLatency(100000);
+        unsigned long before = server.requestCount();
+
+        CoalesceJob job;
+        job.es = &es;
+        job.found = 0;
+        job.hits = 0;
+
+        std::vector<pthread_t> threads;
+        for (int i = 0; i < 8; ++i)
+        {
+            pthread_t thread;
+            ASSERT_EQ(pthread_create(&thread, NULL, coalesceThread, &job), 0);
+            threads.push_back(thread);
+        }
+        for (size_t i = 0; i < threads.size(); ++i)
+            pthread_join(threads[i], NULL);
+
+        ASSERT_EQ(job.found, 8);
+        ASSERT_EQ(job.hits, 8);
+        // one get and one search, 16 requests without coalescing
+        ASSERT_LE(server.requestCount() - before, 4ul);
+        server.setLatency(0);
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+TEST(MockServer, CACHE)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    try {
+        ClientOptions options;
+        options.cache.max_bytes = 4096;
+        ElasticSearch es(server.url(), options);
+
+        Json::Value doc;
+        doc["name"] = "reference";
+        ASSERT_TRUE(es.index("ref", "doc", "1", doc));
+        es.refresh("ref");
+
+        std::cout << "[1]read through the cache" << std::endl;
+        unsigned long before = server.requestCount();
+        Json::Value msg;
+        ASSERT_TRUE(es.getDocument("ref", "doc", "1", msg));
+        ASSERT_TRUE(es.getDocument("ref", "doc", "1", msg));
+        ASSERT_EQ(msg["_source"]["name"].asString(), std::string("reference"));
+        ASSERT_EQ(server.requestCount() - before, 1ul);
+
+        Json::Value result;
+        ASSERT_EQ(es.search("ref", "doc", "{\"query\":{\"match_all\":{}}}", result), 1);
+        ASSERT_EQ(es.search("ref", "doc", "{ \"query\" : { \"match_all\" : { } } }", result), 1);
+        ASSERT_EQ(server.requestCount() - before, 2ul);
+        ASSERT_EQ(es.cacheStats().hits, 2u);
+
+        std::cout << "[2]writes of the client invalidate" << std::endl;
+        ASSERT_TRUE(es.update("ref", "doc", "1", "name", "changed"));
+        ASSERT_TRUE(es.getDocument("ref", "doc", "1", msg));
+        ASSERT_EQ(msg["_source"]["name"].asString(), std::string("changed"));
+
+        ASSERT_TRUE(es.index("ref", "doc", "2", doc));
+        es.refresh("ref");
+        ASSERT_EQ(es.search("ref", "doc", "{\"query\":{\"match_all\":{}}}", result), 2);
+
+        std::cout << "[3]a scan does not evict the hot document" << std::endl;
+        ASSERT_TRUE(es.getDocument("ref", "doc", "1", msg));
+        for (int i = 0; i < 40; ++i)
+        {
+            std::ostringstream id;
+            id << "scan" << i;
+            ASSERT_TRUE(es.index("ref", "doc", id.str(), doc));
+            ASSERT_TRUE(es.getDocument("ref", "doc", id.str().c_str(), msg));
+        }
+        CacheStats stats = es.cacheStats();
+        ASSERT_LE(stats.bytes, 4096u);
+        ASSERT_GT(stats.evictions, 0u);
+
+        before = server.requestCount();
+        ASSERT_TRUE(es.getDocument("ref", "doc", "1", msg));
+        ASSERT_EQ(server.requestCount() - before, 0ul);
+
+        es.clearCache();
+        ASSERT_EQ(es.cacheStats().entries, 0u);
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+TEST(MockServer, REVALIDATE)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    try {
+        ClientOptions options;
+        options.cache.max_bytes = 65536;
+        options.cache.ttl_us = 1;
+        options.cache.revalidate = true;
+        ElasticSearch es(server.url(), options);
+        ElasticSearch other(server.url());
+
+        Json::Value doc;
+        doc["name"] = "first";
+        ASSERT_TRUE(es.index("occ", "doc", "1", doc));
+
+        std::cout << "[1]expired documents are revalidated" << std::endl;
+        Json::Value msg;
+        ASSERT_TRUE(es.getDocument("occ", "doc", "1", msg));
+        usleep(10);
+        ASSERT_TRUE(es.getDocument("occ", "doc", "1", msg));
+        ASSERT_EQ(msg["_source"]["name"].asString(), std::string("first"));
+        ASSERT_EQ(es.cacheStats().revalidations, 1u);
+
+        doc["name"] = "second";
+        ASSERT_TRUE(other.index("occ", "doc", "1", doc));
+        usleep(10);
+        ASSERT_TRUE(es.getDocument("occ", "doc", "1", msg));
+        ASSERT_EQ(msg["_source"]["name"].asString(), std::string("second"));
+        ASSERT_EQ(es.cacheStats().revalidations, 1u);
+
+        std::cout << "[2]conditional writes" << std::endl;
+        DocVersion read = DocVersion::of(msg);
+        ASSERT_TRUE(read.known());
+
+        DocVersion written;
+        doc["name"] = "third";
+        ASSERT_TRUE(es.tryIndex("occ", "doc", "1", doc, read, &written).ok());
+        ASSERT_TRUE(written.known());
+        ASSERT_TRUE(!written.same(read));
+        ASSERT_TRUE(es.tryIndex("occ", "doc", "1", doc, read).conflict());
+
+        Json::Value fields;
+        fields["name"] = "fourth";
+        ASSERT_TRUE(es.tryUpdate("occ", "doc", "1", fields, read).conflict());
+        ASSERT_TRUE(es.tryUpdate("occ", "doc", "1", fields, written, &written).ok());
+        ASSERT_TRUE(es.getDocument("occ", "doc", "1", msg));
+        ASSERT_EQ(msg["_source"]["name"].asString(), std::string("fourth"));
+        ASSERT_TRUE(DocVersion::of(msg).same(written));
+        ASSERT_TRUE(es.tryUpdate("occ", "doc", "2", fields, written).conflict());
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+TEST(MockServer, QUERY_BUILDER)
+{
+    std::cout << "[1]typed clauses" << std::endl;
+    std::string title = "say \"hi\"\n\\";
+    std::vector<std::string> tags;
+    tags.push_back("a");
+    tags.push_back("b");
+
+    QueryBuilder builder;
+    builder.query(boolQuery()
+                      .must(matchQuery("title", title))
+                      .filter(termQuery("status", "published"))
+                      .filter(rangeQuery("age").gte(18).lt(65.5))
+                      .filter(termsQuery("tag", tags))
+                      .mustNot(termQuery("deleted", true)))
+           .size(20)
+           .from(40)
+           .sort("date", false)
+           .sort("_score")
+           .aggregation("by_tag", termsAgg("tag", 5).aggregation("age", avgAgg("age")))
+           .aggregation("authors", cardinalityAgg("author"));
+
+    const std::string expected =
+        "{\"query\":{\"bool\":{"
+        "\"must\":[{\"match\":{\"title\":\"say \\\"hi\\\"\\n\\\\\"}}],"
+        "\"filter\":[{\"term\":{\"status\":\"published\"}},"
+        "{\"range\":{\"age\":{\"gte\":18,\"lt\":65.5}}},"
+        "{\"terms\":{\"tag\":[\"a\",\"b\"]}}],"
+        "\"must_not\":[{\"term\":{\"deleted\":true}}]}},"
+        "\"size\":20,\"from\":40,"
+        "\"sort\":[{\"date\":{\"order\":\"desc\"}},{\"_score\":{\"order\":\"asc\"}}],"
+        "\"aggs\":{\"by_tag\":{\"terms\":{\"field\":\"tag\",\"size\":5},\"aggs\":{\"age\":{\"avg\":{\"field\":\"age\"}}}},"
+        "\"authors\":{\"cardinality\":{\"field\":\"author\"}}}}";
+    ASSERT_EQ(builder.str(), expected);
+
+    Json::Value parsed;
+    ASSERT_TRUE(Json::Reader().parse(builder.str(), parsed));
+    ASSERT_EQ(parsed["query"]["bool"]["must"][0u]["match"]["title"].asString(), title);
+
+    ASSERT_EQ(builder.clear().query(matchAllQuery()).str(), std::string("{\"query\":{\"match_all\":{}}}"));
+    ASSERT_EQ(builder.clear().str(), std::string("{}"));
+
+    std::cout << "[2]values with quotes reach the server intact" << std::endl;
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    try {
+        ElasticSearch es(server.url());
+
+        Json::Value doc;
+        doc["name"] = "plain";
+        ASSERT_TRUE(es.index("quotes", "doc", "1", doc));
+        es.refresh("quotes");
+
+        Json::Value msg;
+        ASSERT_TRUE(es.getDocument("quotes", "doc", "name", "it's a \"quoted\" name", msg));
+        ASSERT_TRUE(es.update("quotes", "doc", "1", "name", "a \"quoted\" name"));
+        ASSERT_TRUE(es.getDocument("quotes", "doc", "1", msg));
+        ASSERT_EQ(msg["_source"]["name"].asString(), std::string("a \"quoted\" name"));
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+struct SharedClientJob
+{
+    ElasticSearch* es;
+    int thread;
+    int matched;    // reads which returned what the thread wrote
+};
+
+static void* sharedClientThread(void* arg)
+{
+    SharedClientJob* job = (SharedClientJob*) arg;
+
+    std::ostringstream id;
+    id << "t" << job->thread;
+
+    Json::Value doc;
+    doc["thread"] = job->thread;
+    if (!job->es->index("pthread", "doc", id.str(), doc))
+        return NULL;
+
+    for (int i = 0; i < 20; ++i)
+    {
+        Json::Value msg;
+        if (job->es->getDocument("pthread", "doc", id.str().c_str(), msg)
+            && job->thread == msg["_source"]["thread"].asInt())
+            ++job->matched;
+    }
+    return NULL;
+}
+
+TEST(MockServer, SHARED_CLIENT)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    try {
+        ElasticSearch es(server.url());
+
+        std::cout << "[1]8 threads write and read their own document through one client" << std::endl;
+        SharedClientJob jobs[8];
+        pthread_t threads[8];
+        for (int i = 0; i < 8; ++i)
+        {
+            jobs[i].es = &es;
+            jobs[i].thread = i;
+            jobs[i].matched = 0;
+            ASSERT_EQ(pthread_create(&threads[i], NULL, sharedClientThread, &jobs[i]), 0);
+        }
+
+        for (int i = 0; i < 8; ++i)
+            pthread_join(threads[i], NULL);
+
+        for (int i = 0; i < 8; ++i)
+            ASSERT_EQ(jobs[i].matched, 20);
+
+        ASSERT_EQ(es.getDocumentCount("pthread", "doc"), 8);
+        ASSERT_TRUE(es.deleteIndex("pthread"));
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+TEST(MockServer, CONNECTION_REUSE)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    try {
+        ElasticSearch es(server.url());
+
+        std::cout << "[1]16 threads share the connections of one client" << std::endl;
+        SharedClientJob jobs[16];
+        pthread_t threads[16];
+        for (int i = 0; i < 16; ++i)
+        {
+            jobs[i].es = &es;
+            jobs[i].thread = i;
+            jobs[i].matched = 0;
+            ASSERT_EQ(pthread_create(&threads[i], NULL, sharedClientThread, &jobs[i]), 0);
+        }
+
+        for (int i = 0; i < 16; ++i)
+            pthread_join(threads[i], NULL);
+
+        for (int i = 0; i < 16; ++i)
+            ASSERT_EQ(jobs[i].matched, 20);
+
+        // about one connection per thread, not one per request beyond libcurl's default cache of 5
+        MetricsSnapshot metrics = es.metrics();
+        ASSERT_EQ(metrics.nodes.size(), 1u);
+        std::cout << "[2]" << metrics.nodes[0].requests << " requests opened "
+                  << metrics.nodes[0].new_connections << " connections" << std::endl;
+        ASSERT_GE(metrics.nodes[0].requests, 16u * 21);
+        ASSERT_LE(metrics.nodes[0].new_connections, 32u);
+
+        ASSERT_TRUE(es.deleteIndex("pthread"));
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+// the transport only runs when libcurl has HTTP/2 multiplexing, not with the bundled headers
+#ifdef CURLPIPE_MULTIPLEX
+
+struct MultiJob
+{
+    MultiTransport* transport;
+    std::string url;
+    int rounds;
+    int result;      // curl code of the last transfer
+    int matched;     // transfers which returned the document
+};
+
+static size_t appendBody(char* data, size_t size, size_t count, void* out)
+{
+    ((std::string*) out)->append(data, size * count);
+    return size * count;
+}
+
+static void* multiThread(void* arg)
+{
+    MultiJob* job = (MultiJob*) arg;
+    for (int i = 0; i < job->rounds; ++i)
+    {
+        std::string body;
+        CURL* curl = curl_easy_init();
+        curl_easy_setopt(curl, CURLOPT_URL, job->url.c_str());
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, appendBody);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*) &body);
+
+        job->result = job->transport->perform(curl);
+        long status = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+        curl_easy_cleanup(curl);
+
+        if (CURLE_OK == job->result && 200 == status && std::string::npos != body.find("kimchy"))
+            ++job->matched;
+    }
+    return NULL;
+}
+
+TEST(MockServer, MULTI_TRANSPORT)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    try {
+        ElasticSearch es(server.url());
+        Json::Value doc;
+        doc["user"] = "kimchy";
+        ASSERT_TRUE(es.index("twitter", "tweet", "1", doc));
+
+        std::cout << "[1]4 threads run their transfers on one multi handle" << std::endl;
+        MultiJob jobs[4];
+        pthread_t threads[4];
+        {
+            MultiTransport transport;
+            ASSERT_TRUE(transport.valid());
+            for (int i = 0; i < 4; ++i)
+            {
+                MultiJob job = { &transport, server.url() + "/twitter/tweet/1", 25, -1, 0 };
+                jobs[i] = job;
+                ASSERT_EQ(pthread_create(&threads[i], NULL, multiThread, &jobs[i]), 0);
+            }
+            for (int i = 0; i < 4; ++i)
+                pthread_join(threads[i], NULL);
+        }
+
+        for (int i = 0; i < 4; ++i)
+            ASSERT_EQ(jobs[i].matched, 25);
+
+        std::cout << "[2]transfers in flight fail when the transport goes away" << std::endl;
+        server.setLatency(2000000);
+        {
+            MultiTransport transport;
+            for (int i = 0; i < 4; ++i)
+            {
+                MultiJob job = { &transport, server.url() + "/twitter/tweet/1", 1, -1, 0 };
+                jobs[i] = job;
+                ASSERT_EQ(pthread_create(&threads[i], NULL, multiThread, &jobs[i]), 0);
+            }
+
+            // let the loop put them on the multi handle
+            usleep(200000);
+        }
+
+        for (int i = 0; i < 4; ++i)
+        {
+            pthread_join(threads[i], NULL);
+            ASSERT_EQ(jobs[i].result, (int) CURLE_ABORTED_BY_CALLBACK);
+            ASSERT_EQ(jobs[i].matched, 0);
+        }
+        server.setLatency(0);
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+#endif // CURLPIPE_MULTIPLEX
+
+/// keeps the last request it received, answers every one with reply after delay_us
+class EchoServer : public mock::MockServer
+{
+public:
+    EchoServer ( ) : last(), reply("{}"), delay_us(0) { }
+
+    mock::Request last;
+    std::string reply;
+    unsigned int delay_us;
+
+protected:
+    virtual void handle(const mock::Request& request, mock::Response& response)
+    {
+        if (delay_us > 0)
+            usleep(delay_us);
+
+        last = request;
+        response.body = reply;
+    }
+};
+
+struct PullState
+{
+    const std::string* data;
+    size_t offset;
+    size_t step;    // most bytes given per call
+    int calls;
+};
+
+static size_t pullBody(char* buffer, size_t size, void* userdata)
+{
+    PullState* state = (PullState*) userdata;
+    ++state->calls;
+
+    size_t n = state->data->size() - state->offset;
+    n = std::min(n, std::min(size, state->step));
+    memcpy(buffer, state->data->data() + state->offset, n);
+    state->offset += n;
+    return n;
+}
+
+TEST(MockServer, BODY_SOURCE)
+{
+    EchoServer server;
+    ASSERT_TRUE(server.start());
+
+    // larger than the read buffer of libcurl, so it is asked several times
+    std::string large;
+    for (int i = 0; large.size() < 100000; ++i)
+        large += (char) ('a' + i % 26);
+
+    HttpClient http;
+    std::string url = server.url() + "/body/_doc/1";
+    std::string output;
+
+    std::cout << "[1]one buffer" << std::endl;
+    BodySource plain(large);
+    ASSERT_TRUE(plain.contiguous());
+    ASSERT_TRUE(plain.replayable());
+    ASSERT_EQ(http.post(url, plain, output), 0);
+    ASSERT_EQ(server.last.method, std::string("POST"));
+    ASSERT_TRUE(server.last.body == large);
+
+    std::cout << "[2]iovec chain, with an empty buffer in it" << std::endl;
+    std::string head = "{\"index\":{}}\n";
+    std::string tail = "\n";
+    struct iovec iov[4];
+    iov[0].iov_base = (void*) head.data();
+    iov[0].iov_len = head.size();
+    iov[1].iov_base = NULL;
+    iov[1].iov_len = 0;
+    iov[2].iov_base = (void*) large.data();
+    iov[2].iov_len = large.size();
+    iov[3].iov_base = (void*) tail.data();
+    iov[3].iov_len = tail.size();
+
+    BodySource chain(iov, 4);
+    ASSERT_TRUE(!chain.contiguous());
+    ASSERT_TRUE(chain.replayable());
+    ASSERT_EQ(chain.length(), (long long) (head.size() + large.size() + tail.size()));
+    ASSERT_EQ(http.put(url, chain, output), 0);
+    ASSERT_EQ(server.last.method, std::string("PUT"));
+    ASSERT_TRUE(server.last.body == head + large + tail);
+
+    // a second request reads the chain from its start again
+    ASSERT_EQ(http.post(url, chain, output), 0);
+    ASSERT_TRUE(server.last.body == head + large + tail);
+
+    std::cout << "[3]pull callback of known length" << std::endl;
+    PullState state = { &large, 0, 7000, 0 };
+    BodySource pulled(pullBody, &state, (long long) large.size());
+    ASSERT_TRUE(!pulled.contiguous());
+    ASSERT_TRUE(!pulled.replayable());
+    ASSERT_EQ(http.post(url, pulled, output), 0);
+    ASSERT_TRUE(server.last.body == large);
+    ASSERT_EQ(server.last.headers["content-length"], std::string("100000"));
+    ASSERT_GT(state.calls, 14);
+
+    std::cout << "[4]pull callback of unknown length, sent chunked" << std::endl;
+    PullState chunks = { &large, 0, 3000, 0 };
+    BodySource chunked(pullBody, &chunks);
+    ASSERT_EQ(chunked.length(), -1LL);
+    ASSERT_EQ(http.post(url, chunked, output), 0);
+    ASSERT_EQ(server.last.headers["transfer-encoding"], std::string("chunked"));
+    ASSERT_TRUE(server.last.body == large);
+    ASSERT_GT(chunks.calls, 33);
+
+    std::cout << "[5]empty body" << std::endl;
+    ASSERT_EQ(http.post(url, BodySource(), output), 0);
+    ASSERT_TRUE(server.last.body.empty());
+}
+
+/// records the lengths announced to it
+class ExpectSink : public ResponseSink
+{
+public:
+    ExpectSink ( ) : expected(0), calls(0), body() { }
+
+    virtual void expect(size_t length)
+    {
+        expected = length;
+        ++calls;
+    }
+
+    virtual bool write(const char* data, size_t length)
+    {
+        body.append(data, length);
+        return true;
+    }
+
+    size_t expected;
+    int calls;
+    std::string body;
+};
+
+static bool throwingWrite(const char* data, size_t length, void* userdata)
+{
+    throw std::runtime_error("sink failed");
+}
+
+static size_t throwingPull(char* buffer, size_t size, void* userdata)
+{
+    throw std::runtime_error("pull failed");
+}
+
+TEST(MockServer, RESPONSE_SINK)
+{
+    EchoServer server;
+    ASSERT_TRUE(server.start());
+
+    HttpClient http;
+    std::string url = server.url() + "/sink/_doc/1";
+
+    std::cout << "[1]a GET announces its Content-Length" << std::endl;
+    ExpectSink get;
+    ASSERT_EQ(http.get(url, get), 0);
+    ASSERT_EQ(get.calls, 1);
+    ASSERT_EQ(get.expected, 2u);
+    ASSERT_EQ(get.body, std::string("{}"));
+
+    std::cout << "[2]a HEAD has no body, nothing is reserved" << std::endl;
+    ExpectSink head;
+    ASSERT_EQ(http.head(url, head), 0);
+    ASSERT_EQ(server.last.method, std::string("HEAD"));
+    ASSERT_EQ(head.calls, 0);
+    ASSERT_TRUE(head.body.empty());
+
+    std::string output;
+    ASSERT_EQ(http.head(url, output), 0);
+    ASSERT_EQ(output.capacity(), std::string().capacity());
+
+    std::cout << "[3]a throwing callback aborts the transfer, the handle is reusable" << std::endl;
+    CallbackSink throwing(throwingWrite, NULL);
+    ASSERT_EQ(http.get(url, throwing), (int) CURLE_WRITE_ERROR);
+    ASSERT_EQ(http.post(url, BodySource(throwingPull, NULL), output), (int) CURLE_ABORTED_BY_CALLBACK);
+
+    output.clear();
+    ASSERT_EQ(http.get(url, output), 0);
+    ASSERT_EQ(output, std::string("{}"));
+}
+
+/// keeps every event it is told of, in order
+class RecordingTracer : public Tracer
+{
+public:
+    struct Event
+    {
+        std::string name;
+        TraceSpan span;
+        std::string url;
+    };
+
+    virtual void onStart(const TraceSpan& span)     { add("start", span); }
+    virtual void onFirstByte(const TraceSpan& span) { add("first_byte", span); }
+    virtual void onComplete(const TraceSpan& span)  { add("complete", span); }
+    virtual void onParsed(const TraceSpan& span)    { add("parsed", span); }
+
+    std::vector<Event> events;
+
+private:
+    void add(const char* name, const TraceSpan& span)
+    {
+        MutexLockGuard lock(_mutex);
+        Event event;
+        event.name = name;
+        event.span = span;
+        event.url = NULL == span.url ? "" : span.url;
+        events.push_back(event);
+    }
+
+    MutexLock _mutex;
+};
+
+TEST(MockServer, TRACER)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    RecordingTracer tracer;
+    ClientOptions options;
+    options.tracer = &tracer;
+
+    try {
+        ElasticSearch es(server.url(), options);
+        Json::Value doc;
+        doc["user"] = "kimchy";
+        ASSERT_TRUE(es.index("twitter", "tweet", "1", doc));
+
+        std::cout << "[1]a read goes through start, first byte, complete and parsed" << std::endl;
+        tracer.events.clear();
+        server.setLatency(20000);
+        Json::Value msg;
+        ASSERT_TRUE(es.getDocument("twitter", "tweet", "1", msg));
+        server.setLatency(0);
+
+        ASSERT_EQ(tracer.events.size(), 4u);
+        const char* names[] = { "start", "first_byte", "complete", "parsed" };
+        for (size_t i = 0; i < 4; ++i)
+        {
+            const RecordingTracer::Event& event = tracer.events[i];
+            ASSERT_EQ(event.name, std::string(names[i]));
+            ASSERT_EQ(event.span.request_id, tracer.events[0].span.request_id);
+            ASSERT_EQ(std::string(event.span.operation), std::string("getDocument"));
+            ASSERT_EQ(std::string(event.span.method), std::string("GET"));
+            ASSERT_TRUE(std::string::npos != event.url.find("/twitter/tweet/1"));
+        }
+
+        const TraceSpan& first = tracer.events[1].span;
+        const TraceSpan& done = tracer.events[2].span;
+        ASSERT_GT(tracer.events[0].span.start_us, 0u);
+        ASSERT_GE(first.first_byte_us, 20000u);
+        ASSERT_EQ(first.total_us, 0u);
+        ASSERT_LE(done.first_byte_us, done.total_us);
+        ASSERT_EQ(done.curl_code, 0);
+        ASSERT_EQ(done.status_code, 200);
+        ASSERT_GT(done.bytes_received, 0u);
+
+        std::cout << "[2]every request gets its own id" << std::endl;
+        tracer.events.clear();
+        ASSERT_TRUE(es.tryGetDocument("twitter", "tweet", "2", msg).notFound());
+        ASSERT_TRUE(es.getDocument("twitter", "tweet", "1", msg));
+        ASSERT_EQ(tracer.events.front().name, std::string("start"));
+        ASSERT_EQ(tracer.events.back().name, std::string("parsed"));
+        ASSERT_EQ(tracer.events[0].span.request_id + 1, tracer.events.back().span.request_id);
+
+        int completes = 0;
+        for (size_t i = 0; i < tracer.events.size(); ++i)
+        {
+            if ("complete" != tracer.events[i].name)
+                continue;
+            ++completes;
+            if (1 == completes)
+                ASSERT_EQ(tracer.events[i].span.status_code, 404);
+        }
+        ASSERT_EQ(completes, 2);
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+
+    std::cout << "[3]a transport failure completes without a first byte" << std::endl;
+    server.stop();
+    tracer.events.clear();
+    try {
+        ElasticSearch es(server.url(), options);
+        Json::Value msg;
+        es.tryGetDocument("twitter", "tweet", "1", msg);
+    } catch (Exception &e) {
+    }
+
+    ASSERT_GE(tracer.events.size(), 2u);
+    ASSERT_EQ(tracer.events[0].name, std::string("start"));
+    ASSERT_EQ(tracer.events[1].name, std::string("complete"));
+    ASSERT_NE(tracer.events[1].span.curl_code, 0);
+    ASSERT_EQ(tracer.events[1].span.status_code, 0);
+}
+
+TEST(MockServer, SLOW_LOG)
+{
+    EchoServer server;
+    ASSERT_TRUE(server.start());
+
+    ClientOptions options;
+    options.slowLog.threshold_us = 50000;
+
+    try {
+        ElasticSearch es(server.url(), options);
+
+        std::cout << "[1]a fast request is not logged, a slow one is" << std::endl;
+        server.reply = "{\"took\":3,\"count\":7}";
+        ASSERT_EQ(es.getDocumentCount("twitter", "tweet"), 7);
+        ASSERT_TRUE(es.slowRequests().empty());
+
+        server.delay_us = 60000;
+        ASSERT_EQ(es.getDocumentCount("twitter", "tweet"), 7);
+        server.delay_us = 0;
+
+        std::vector<SlowRequest> slow = es.slowRequests();
+        ASSERT_EQ(slow.size(), 1u);
+        ASSERT_EQ(slow[0].operation, std::string("getDocumentCount"));
+        ASSERT_EQ(slow[0].took_ms, 3L);
+        ASSERT_TRUE(!slow[0].failed);
+        ASSERT_GE(slow[0].total_us, 50000u);
+
+        std::cout << "[2]a count without count is logged as failed, debug or not" << std::endl;
+        server.reply = "{\"error\":\"boom\"}";
+        ASSERT_EQ(es.getDocumentCount("twitter", "tweet"), 0);
+
+        slow = es.slowRequests();
+        ASSERT_EQ(slow.size(), 2u);
+        ASSERT_TRUE(slow[1].failed);
+        ASSERT_EQ(slow[1].method, std::string("GET"));
+        ASSERT_TRUE(std::string::npos != slow[1].url.find("/twitter/tweet/_count"));
+        ASSERT_EQ(slow[1].response_sample, server.reply);
+        ASSERT_EQ(slow[1].status_code, 200L);
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+TEST(MockServer, STATUS)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    try {
+        ElasticSearch es(server.url());
+        Json::Value doc;
+        doc["user"] = "kimchy";
+        ASSERT_TRUE(es.index("twitter", "tweet", "1", doc));
+
+        std::cout << "[1]tryGetDocument of a document, a missing one and a missing index" << std::endl;
+        Json::Value msg;
+        Status status = es.tryGetDocument("twitter", "tweet", "1", msg);
+        ASSERT_TRUE(status.ok());
+        ASSERT_EQ(status.http_status, 200L);
+        ASSERT_EQ(msg["_source"]["user"].asString(), std::string("kimchy"));
+
+        status = es.tryGetDocument("twitter", "tweet", "2", msg);
+        ASSERT_TRUE(status.notFound());
+        ASSERT_EQ(status.http_status, 404L);
+        ASSERT_TRUE(status.reason.empty());
+
+        status = es.tryGetDocument("nosuchindex", "tweet", "1", msg);
+        ASSERT_TRUE(status.notFound());
+
+        std::cout << "[2]getDocument of a missing document throws the response" << std::endl;
+        bool thrown = false;
+        try {
+            es.getDocument("twitter", "tweet", "2", msg);
+        } catch (Exception& e) {
+            thrown = true;
+            Json::Value response;
+            ASSERT_TRUE(Json::Reader().parse(e.what(), response));
+            ASSERT_EQ(response["_id"].asString(), std::string("2"));
+            ASSERT_TRUE(!response["found"].asBool());
+        }
+        ASSERT_TRUE(thrown);
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+
+    std::cout << "[3]a transport failure is a status, and false from the wrappers" << std::endl;
+    ElasticSearch* es = NULL;
+    try {
+        es = new ElasticSearch(server.url());
+    } catch (Exception &e) {
+        ASSERT_TRUE(false);
+    }
+    server.stop();
+
+    Json::Value msg;
+    Status status = es->tryGetDocument("twitter", "tweet", "1", msg);
+    ASSERT_EQ(status.kind, ERR_TRANSPORT);
+    ASSERT_NE(status.curl_code, 0);
+    ASSERT_TRUE(!es->getDocument("twitter", "tweet", "1", msg));
+    delete es;
+}
+
+TEST(MockServer, INDEX_NOT_ACKNOWLEDGED)
+{
+    EchoServer server;
+    ASSERT_TRUE(server.start());
+
+    try {
+        ElasticSearch es(server.url());
+        Json::Value doc;
+        doc["user"] = "kimchy";
+
+        std::cout << "[1]an index answer without _version is false, not an exception" << std::endl;
+        server.reply = "{\"result\":\"noop\"}";
+        ASSERT_TRUE(!es.index("twitter", "tweet", "1", doc));
+
+        Status status = es.tryIndex("twitter", "tweet", "1", doc);
+        ASSERT_EQ(status.kind, ERR_RESPONSE);
+
+        std::cout << "[2]an unreadable answer still throws" << std::endl;
+        server.reply = "not json";
+        bool thrown = false;
+        try {
+            es.index("twitter", "tweet", "1", doc);
+        } catch (Exception& e) {
+            thrown = true;
+        }
+        ASSERT_TRUE(thrown);
+
+        std::cout << "[3]in debug mode the answer without _version throws" << std::endl;
+        server.reply = "{}";
+        ClientOptions options;
+        options.debug = true;
+        ElasticSearch debug(server.url(), options);
+        server.reply = "{\"result\":\"noop\"}";
+        thrown = false;
+        try {
+            debug.index("twitter", "tweet", "1", doc);
+        } catch (Exception& e) {
+            thrown = true;
+        }
+        ASSERT_TRUE(thrown);
+
+        std::cout << "[4]an ES 5 error object is false, a top level reason or error string throws" << std::endl;
+        server.reply = "{\"error\":{\"type\":\"mapper_parsing_exception\",\"reason\":\"bad\"},\"status\":400}";
+        ASSERT_TRUE(!es.index("twitter", "tweet", "1", doc));
+        ASSERT_EQ(es.tryIndex("twitter", "tweet", "1", doc).kind, ERR_SERVER);
+
+        thrown = false;
+        try {
+            debug.index("twitter", "tweet", "1", doc);
+        } catch (Exception& e) {
+            thrown = true;
+        }
+        ASSERT_TRUE(thrown);
+
+        const char* fatal[] = { "{\"error\":\"MapperParsingException[bad]\"}", "{\"reason\":\"bad\"}" };
+        for (int i = 0; i < 2; ++i)
+        {
+            server.reply = fatal[i];
+            thrown = false;
+            try {
+                es.index("twitter", "tweet", "1", doc);
+            } catch (Exception& e) {
+                thrown = true;
+            }
+            ASSERT_TRUE(thrown);
+        }
+
+        std::cout << "[5]deleteDocument throws on an unreadable answer, is false on a miss" << std::endl;
+        server.reply = "not json";
+        thrown = false;
+        try {
+            es.deleteDocument("twitter", "tweet", "1");
+        } catch (Exception& e) {
+            thrown = true;
+        }
+        ASSERT_TRUE(thrown);
+
+        server.reply = "{\"found\":false}";
+        ASSERT_TRUE(!es.deleteDocument("twitter", "tweet", "1"));
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+class RecordingServer : public mock::MockServer
+{
+public:
+    RecordingServer ( ) : queries(), _mutex() { }
+
+    std::string lastQuery ( )
+    {
+        MutexLockGuard lock(_mutex);
+        return queries.empty() ? std::string() : queries.back();
+    }
+
+    std::vector<std::string> queries;
+
+protected:
+    virtual void handle(const mock::Request& request, mock::Response& response)
+    {
+        {
+            MutexLockGuard lock(_mutex);
+            queries.push_back(request.query);
+        }
+        mock::MockServer::handle(request, response);
+    }
+
+private:
+    MutexLock _mutex;
+};
+
+TEST(MockServer, PROJECTION)
+{
+    RecordingServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    try {
+        ElasticSearch es(server.url());
+        for (int i = 0; i < 12; ++i)
+        {
+            Json::Value doc;
+            doc["name"] = "kimchy";
+            doc["age"] = i;
+            doc["address"]["city"] = "beijing";
+            doc["address"]["street"] = "wangfujing";
+            doc["comment"] = "trying out Elasticsearch";
+            std::ostringstream id;
+            id << i;
+            ASSERT_TRUE(es.index("people", "doc", id.str(), doc));
+        }
+
+        std::cout << "[1]get with includes" << std::endl;
+        Json::Value msg;
+        Projection projection = Projection().include("name").include("address.city");
+        ASSERT_TRUE(es.getDocument("people", "doc", "3", projection, msg));
+        ASSERT_TRUE(std::string::npos != server.lastQuery().find("_source_includes=name,address.city"));
+        ASSERT_EQ(msg["_source"]["name"].asString(), std::string("kimchy"));
+        ASSERT_EQ(msg["_source"]["address"]["city"].asString(), std::string("beijing"));
+        ASSERT_TRUE(!msg["_source"]["address"].isMember("street"));
+        ASSERT_TRUE(!msg["_source"].isMember("age"));
+        ASSERT_TRUE(!msg["_source"].isMember("comment"));
+
+        std::cout << "[2]search with excludes" << std::endl;
+        Json::Value result;
+        ASSERT_EQ(es.search("people", "doc", "{\"query\":{\"match_all\":{}}}", Projection().exclude("comm*").exclude("address"), result), 10);
+        ASSERT_TRUE(std::string::npos != server.lastQuery().find("_source_excludes=comm*,address"));
+        const Json::Value& hits = result["hits"]["hits"];
+        for (Json::UInt i = 0; i < hits.size(); ++i)
+        {
+            ASSERT_TRUE(hits[i]["_source"].isMember("name"));
+            ASSERT_TRUE(hits[i]["_source"].isMember("age"));
+            ASSERT_TRUE(!hits[i]["_source"].isMember("comment"));
+            ASSERT_TRUE(!hits[i]["_source"].isMember("address"));
+        }
+
+        std::cout << "[3]get without source" << std::endl;
+        ASSERT_TRUE(es.getDocument("people", "doc", "3", Projection().noSource(), msg));
+        ASSERT_TRUE(std::string::npos != server.lastQuery().find("_source=false"));
+        ASSERT_TRUE(!msg.isMember("_source"));
+
+        std::cout << "[4]full scan with includes, every page trimmed, no scan" << std::endl;
+        server.queries.clear();
+        Json::Value all(Json::arrayValue);
+        ASSERT_EQ(es.fullScan("people", "doc", "{\"query\":{\"match_all\":{}}}", Projection().include("age"), all, 5), 12);
+        for (size_t i = 0; i < server.queries.size(); ++i)
+            ASSERT_TRUE(std::string::npos == server.queries[i].find("search_type=scan"));
+        for (Json::UInt i = 0; i < all.size(); ++i)
+        {
+            ASSERT_EQ(all[i]["_source"].size(), 1u);
+            ASSERT_TRUE(all[i]["_source"].isMember("age"));
+        }
+
+        std::cout << "[5]full scan without projection keeps scan" << std::endl;
+        server.queries.clear();
+        ASSERT_EQ(es.fullScan("people", "doc", "{\"query\":{\"match_all\":{}}}", all, 5), 12);
+        ASSERT_TRUE(std::string::npos != server.queries[0].find("search_type=scan"));
+        ASSERT_EQ(all[(Json::UInt) 0]["_source"].size(), 4u);
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+TEST(MockServer, REINDEX_ITEM_POSITIONS)
+{
+    mock::MockServer source;
+    ASSERT_TRUE(source.start());
+    source.setSynthetic(false);
+
+    EchoServer dest;
+    ASSERT_TRUE(dest.start());
+
+    try {
+        ElasticSearch from(source.url());
+        ElasticSearch to(dest.url());
+
+        Json::Value doc;
+        doc["number"] = 1;
+        ASSERT_TRUE(from.index("origin", "doc", "1", doc));
+        ASSERT_TRUE(from.index("origin", "doc", "2", doc));
+
+        std::cout << "[1]a bulk response with more items than actions" << std::endl;
+        std::string item = "{\"index\":{\"status\":400,\"error\":{\"type\":\"mapper_parsing_exception\",\"reason\":\"bad\"}}}";
+        dest.reply = "{\"errors\":true,\"items\":[" + item + "," + item + "," + item + "," + item + "]}";
+
+        ReindexOptions options;
+        options.dest_index = "copy";
+        ReindexResult result;
+        Reindexer(from, to, options).run("origin", "doc", result);
+        ASSERT_EQ(result.read, 2u);
+        ASSERT_EQ(result.written, 0u);
+        ASSERT_EQ(result.failed_actions, 2u);
+        ASSERT_EQ(result.errors.size(), 4u);
+        ASSERT_TRUE(!result.errors[0].id.empty());
+        ASSERT_EQ(result.errors[0].index, std::string("copy"));
+        ASSERT_TRUE(result.errors[3].id.empty());
+        ASSERT_TRUE(result.errors[3].index.empty());
+        ASSERT_EQ(result.errors[3].status, 400);
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+class ThrowingTracer : public Tracer
+{
+public:
+    ThrowingTracer ( ) : armed(true) { }
+
+    virtual void onComplete(const TraceSpan& span)
+    {
+        if (armed)
+            throw std::runtime_error("tracer failed");
+    }
+
+    volatile bool armed;
+};
+
+struct FlightJob
+{
+    ElasticSearch* es;
+    volatile int thrown;
+    volatile int failed;
+};
+
+static void* flightThread(void* arg)
+{
+    FlightJob* job = (FlightJob*) arg;
+
+    Json::Value doc;
+    try {
+        if (ERR_TRANSPORT == job->es->tryGetDocument("hot", "doc", "1", doc).kind)
+            __sync_fetch_and_add(&job->failed, 1);
+    } catch (std::runtime_error& e) {
+        __sync_fetch_and_add(&job->thrown, 1);
+    }
+    return NULL;
+}
+
+TEST(MockServer, COALESCE_LEADER_THROWS)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    ThrowingTracer tracer;
+    tracer.armed = false;
+    ClientOptions options;
+    options.coalesce = true;
+    options.tracer = &tracer;
+
+    try {
+        ElasticSearch es(server.url(), options);
+
+        Json::Value doc;
+        doc["name"] = "hot";
+        ASSERT_TRUE(es.index("hot", "doc", "1", doc));
+
+        std::cout << "[1]the leader throws, its followers fail instead of waiting" << std::endl;
+        tracer.armed = true;
+        server.setLatency(100000);
+
+        FlightJob job;
+        job.es = &es;
+        job.thrown = 0;
+        job.failed = 0;
+
+        std::vector<pthread_t> threads;
+        for (int i = 0; i < 8; ++i)
+        {
+            pthread_t thread;
+            ASSERT_EQ(pthread_create(&thread, NULL, flightThread, &job), 0);
+            threads.push_back(thread);
+        }
+        for (size_t i = 0; i < threads.size(); ++i)
+            pthread_join(threads[i], NULL);
+
+        ASSERT_GE(job.thrown, 1);
+        ASSERT_EQ(job.thrown + job.failed, 8);
+
+        std::cout << "[2]the read is not stuck in flight" << std::endl;
+        tracer.armed = false;
+        server.setLatency(0);
+        ASSERT_TRUE(es.getDocument("hot", "doc", "1", doc));
+        ASSERT_EQ(doc["_source"]["name"].asString(), std::string("hot"));
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+static bool throwingTransform(Json::Value& hit, void* userdata)
+{
+    if (hit["_source"]["number"].asInt() == 77)
+        throw std::runtime_error("transform failed");
+    return true;
+}
+
+TEST(MockServer, REINDEX_FAILURES)
+{
+    RecordingServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    try {
+        ElasticSearch es(server.url());
+
+        BulkBuilder bulk;
+        for (int i = 0; i < 200; ++i)
+        {
+            Json::Value doc;
+            doc["number"] = i;
+            std::ostringstream id;
+            id << i;
+            bulk.index("origin", "doc", id.str(), doc);
+        }
+        std::vector<BulkItemError> errors;
+        ASSERT_TRUE(es.bulk(bulk.str().c_str(), errors));
+
+        ReindexOptions options;
+        options.dest_index = "copy";
+        options.scroll_size = 15;
+        options.bulk_actions = 40;
+
+        std::cout << "[1]one slice is a plain scroll, not a scan" << std::endl;
+        server.queries.clear();
+        ReindexResult result;
+        ASSERT_TRUE(Reindexer(es, es, options).run("origin", "doc", result));
+        ASSERT_EQ(result.written, 200u);
+        for (size_t i = 0; i < server.queries.size(); ++i)
+            ASSERT_TRUE(std::string::npos == server.queries[i].find("search_type=scan"));
+
+        std::cout << "[2]a throwing transform fails the copy instead of the process" << std::endl;
+        options.transform = throwingTransform;
+        for (int slices = 1; slices <= 3; slices += 2)
+        {
+            options.slices = slices;
+            ASSERT_TRUE(!Reindexer(es, es, options).run("origin", "doc", result));
+            ASSERT_EQ(result.failure, std::string("transform failed"));
+        }
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+/// throws on the write after the first ones
+class ThrowingSink : public ResponseSink
+{
+public:
+    ThrowingSink ( ) : writes(0) { }
+
+    virtual bool write(const char* data, size_t length)
+    {
+        if (__sync_add_and_fetch(&writes, 1) > 2)
+            throw std::runtime_error("sink failed");
+        return true;
+    }
+
+    volatile int writes;
+};
+
+TEST(MockServer, EXPORT_SINK_THROWS)
+{
+    mock::MockServer server;
+    ASSERT_TRUE(server.start());
+    server.setSynthetic(false);
+
+    try {
+        ElasticSearch es(server.url());
+
+        BulkBuilder bulk;
+        for (int i = 0; i < 100; ++i)
+        {
+            Json::Value doc;
+            doc["number"] = i;
+            std::ostringstream id;
+            id << i;
+            bulk.index("export", "doc", id.str(), doc);
+        }
+        std::vector<BulkItemError> errors;
+        ASSERT_TRUE(es.bulk(bulk.str().c_str(), errors));
+
+        std::cout << "[1]a throwing output stops every slice, the export throws" << std::endl;
+        ExportOptions options;
+        options.slices = 3;
+        options.scroll_size = 5;
+        options.batch_bytes = 1;
+
+        ThrowingSink sink;
+        bool thrown = false;
+        try {
+            es.exportDocuments("export", "doc", "{}", sink, options);
+        } catch (Exception& e) {
+            thrown = true;
+            ASSERT_TRUE(std::string::npos != std::string(e.what()).find("sink failed"));
+        }
+        ASSERT_TRUE(thrown);
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
+
+TEST(MockServer, CACHE_ALIAS)
+{
+    EchoServer server;
+    ASSERT_TRUE(server.start());
+
+    try {
+        ClientOptions options;
+        options.cache.max_bytes = 4096;
+        ElasticSearch es(server.url(), options);
+
+        const std::string query = "{\"query\":{\"match_all\":{}}}";
+        Json::Value doc;
+        doc["name"] = "new";
+        Json::Value result;
+
+        std::cout << "[1]a write to a backing index does not reach reads through an alias" << std::endl;
+        server.reply = "{\"timed_out\":false,\"hits\":{\"total\":1,\"hits\":[{\"_id\":\"1\",\"_source\":{\"name\":\"old\"}}]}}";
+        ASSERT_EQ(es.search("logs", "doc", query, result), 1);
+
+        server.reply = "{\"_version\":2}";
+        ASSERT_TRUE(es.index("logs-2018", "doc", "1", doc));
+
+        ASSERT_EQ(es.search("logs", "doc", query, result), 1);
+        ASSERT_EQ(es.cacheStats().hits, 1u);
+
+        es.clearCache();
+        ASSERT_EQ(es.cacheStats().entries, 0u);
+
+        std::cout << "[2]reads of a pattern or a list are made stale by any write" << std::endl;
+        server.reply = "{\"timed_out\":false,\"hits\":{\"total\":1,\"hits\":[{\"_id\":\"1\",\"_source\":{\"name\":\"old\"}}]}}";
+        ASSERT_EQ(es.search("logs-*", "doc", query, result), 1);
+        ASSERT_EQ(es.search("logs-2017,logs-2018", "doc", query, result), 1);
+
+        server.reply = "{\"_version\":3}";
+        ASSERT_TRUE(es.index("logs-2018", "doc", "1", doc));
+
+        server.reply = "{\"timed_out\":false,\"hits\":{\"total\":1,\"hits\":[{\"_id\":\"1\",\"_source\":{\"name\":\"new\"}}]}}";
+        uint64_t hits = es.cacheStats().hits;
+        ASSERT_EQ(es.search("logs-*", "doc", query, result), 1);
+        ASSERT_EQ(result["hits"]["hits"][(Json::UInt) 0]["_source"]["name"].asString(), std::string("new"));
+        ASSERT_EQ(es.search("logs-2017,logs-2018", "doc", query, result), 1);
+        ASSERT_EQ(es.cacheStats().hits, hits);
+
+    } catch (Exception &e) {
+        std::cout << "Failed:" << e.what() << std::endl;
+        ASSERT_TRUE(false);
+    }
+}
@@ -11,6 +11,7 @@
 #include "ElasticSearch.h"
 #include <iostream>
 #include <cstdlib>
+#include <unistd.h>
 
 using namespace cppes;
 
@@ -106,6 +107,8 @@ TEST(ElasticSearch, TEST_2)
         ret=es.existIndex("facebook",indexInfo);
         ASSERT_TRUE(ret);
         ASSERT_TRUE(!indexInfo.empty());
+        ASSERT_TRUE(es.existIndex("facebook"));
+        ASSERT_TRUE(!es.existIndex("no-such-index"));
 
         std::cout << "[4]update by index/type/id and key ,set value" << std::endl;
         ret = es.update("facebook", "document", id.c_str(), "message", "XXXXXXXXXXXXX");
@@ -140,6 +143,18 @@ TEST(ElasticSearch, TEST_2)
         ret = es.getDocument("facebook", "document", "user", "2", doc);
         ASSERT_TRUE(!doc.empty());
 
+        std::cout << "[9.1]read a missing document without exception" << std::endl;
+        Status status = es.tryGetDocument("facebook", "document", "no-such-id", doc);
+        ASSERT_TRUE(status.notFound());
+        ASSERT_EQ(status.http_status, 404);
+
+        std::cout << "[9.2]read only some fields of a document" << std::endl;
+        doc.clear();
+        ret = es.getDocument("facebook", "document", id.c_str(), Projection().include("name"), doc);
+        ASSERT_TRUE(ret);
+        ASSERT_TRUE(doc["_source"].isMember("name"));
+        ASSERT_TRUE(!doc["_source"].isMember("message"));
+
         std::cout << "[10]delete index" << std::endl;
         ret = es.deleteIndex("facebook");
         ASSERT_TRUE(ret);
@@ -190,18 +205,24 @@ TEST(ElasticSearch, TEST_3)
         bool ret = es.bulk(builder.str().c_str(), result);
         ASSERT_EQ(ret, true);
         ASSERT_TRUE(!result.empty());
+
+        std::cout << "[3]bulk upsert again and only report failed items" << std::endl;
+        std::vector<BulkItemError> errors;
+        ret = es.bulk(builder.str().c_str(), errors);
+        ASSERT_EQ(ret, true);
+        ASSERT_TRUE(errors.empty());
         
         builder.clear();
 
         sleep(2);
-        std::cout << "[3]full scan all match query documents by index/type" << std::endl;
+        std::cout << "[4]full scan all match query documents by index/type" << std::endl;
         std::string query="{\"query\":{\"match\":{\"name\":\"tang\"}}}";
         Json::Value resultArray;
         int count = es.fullScan("hadoop", "hdfs", query, resultArray);
         ASSERT_GT(count, 0);
         ASSERT_TRUE(!resultArray.empty());
         
-        std::cout << "[4]delete index" << std::endl;
+        std::cout << "[5]delete index" << std::endl;
         ret = es.deleteIndex("hadoop");
         ASSERT_TRUE(ret);
 
@@ -0,0 +1,665 @@
+// Copyright tang.  All rights reserved.
+// https://github.com/tangyibo/libcppes
+//
+// Use of this source code is governed by a BSD-style license
+//
+// Author: tang (inrgihc@126.com)
+// Data : 2018/8/2
+// Location: beijing , china
+/////////////////////////////////////////////////////////////
+//
+// Load generator for an elasticsearch cluster, built on the client itself.
+//
+//   esbench [options]
+//
+//   --node URL          node to load, default http://127.0.0.1:9200
+//   --mock              start an in-process mock server instead of --node
+//   --mode MODE         closed: every thread sends its next request when the
+//                       previous one is answered; open: requests are started
+//                       at --rate per second whatever the answer times
+//   --threads N         concurrency, the most requests in flight, default 8
+//   --rate R            open loop arrival rate per second, default 1000
+//   --duration S        seconds of load, default 10
+//   --mix SPEC          weights of operations, default index:1,get:8,search:1,bulk:0
+//   --index NAME        default bench
+//   --type NAME         default doc
+//   --ids N             documents are index/get with ids in [0, N), default 10000
+//   --preload           bulk index the N documents before the load
+//   --bulk-size N       documents per bulk request, default 500
+//   --template TEXT     document template, @FILE reads it from FILE
+//   --query TEXT        search template, @FILE reads it from FILE
+//
+// Templates are JSON with placeholders, expanded for every request:
+//
+//   {{seq}}             sequence number of the document
+//   {{id}}              id of the document
+//   {{int:MIN:MAX}}     random integer in [MIN, MAX]
+//   {{word}}            random word
+//   {{words:N}}         N random words separated by spaces
+//   {{date}}            current time, yyyy-MM-ddTHH:mm:ss
+//
+// The report is one key=value line per operation. In open loop the latency
+// of a request is taken from the time it should have been sent, so time it
+// spent waiting for a free thread is counted (coordinated omission); the
+// service time alone is reported as service_p*. Requests still due at
+// the end of the duration are not sent and are counted as unsent.
+//
+#include "ElasticSearch.h"
+#include "Metrics.h"
+#include "MockServer.h"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/time.h>
+
+using namespace cppes;
+
+enum Operation
+{
+    OP_INDEX = 0,
+    OP_GET,
+    OP_SEARCH,
+    OP_BULK,
+    OP_MAX
+};
+
+static const char* s_op_names[OP_MAX] = { "index", "get", "search", "bulk" };
+
+struct Config
+{
+    Config()
+    : node("http://127.0.0.1:9200")
+    , mock(false)
+    , open(false)
+    , threads(8)
+    , rate(1000)
+    , duration(10)
+    , index("bench")
+    , type("doc")
+    , ids(10000)
+    , preload(false)
+    , bulk_size(500)
+    , doc_template("{\"user\":\"user{{int:1:1000}}\",\"seq\":{{seq}},\"post_date\":\"{{date}}\",\"message\":\"{{words:12}}\"}")
+    , query_template("{\"query\":{\"term\":{\"user\":\"user{{int:1:1000}}\"}},\"size\":10}")
+    {
+        weights[OP_INDEX] = 1;
+        weights[OP_GET] = 8;
+        weights[OP_SEARCH] = 1;
+        weights[OP_BULK] = 0;
+    }
+
+    std::string node;
+    bool mock;
+    bool open;
+    int threads;
+    double rate;
+    double duration;
+    std::string index;
+    std::string type;
+    long ids;
+    bool preload;
+    int bulk_size;
+    std::string doc_template;
+    std::string query_template;
+    int weights[OP_MAX];
+};
+
+/// Counters of one operation, shared by every thread.
+struct OpStats
+{
+    OpStats() : latency(), service(), ok(0), errors(0), misses(0) { }
+
+    LatencyHistogram latency;    // from the intended start, in microseconds
+    LatencyHistogram service;    // from the actual start
+    volatile uint64_t ok;
+    volatile uint64_t errors;
+    volatile uint64_t misses;    // get of a missing document
+};
+
+static uint64_t nowMicros()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// templates
+
+static const char* s_words[] = {
+    "elastic", "search", "cluster", "shard", "replica", "index", "mapping", "query",
+    "bulk", "scroll", "node", "segment", "merge", "refresh", "flush", "translog",
+    "beijing", "kimchy", "trying", "out", "document", "field", "term", "match"
+};
+
+static const size_t WORD_COUNT = sizeof (s_words) / sizeof (s_words[0]);
+
+/// A template cut into literal text and placeholders once, expanded many times.
+class Template
+{
+public:
+    explicit Template(const std::string& text)
+    {
+        size_t pos = 0;
+        while (pos < text.length())
+        {
+            size_t open = text.find("{{", pos);
+            size_t close = std::string::npos == open ? open : text.find("}}", open);
+            if (std::string::npos == close)
+            {
+                _parts.push_back(Part(text.substr(pos)));
+                break;
+            }
+
+            if (open > pos)
+                _parts.push_back(Part(text.substr(pos, open - pos)));
+            _parts.push_back(placeholder(text.substr(open + 2, close - open - 2)));
+            pos = close + 2;
+        }
+    }
+
+    /// Append the expansion to out.
+    void render(long seq, const std::string& id, unsigned int& seed, std::string& out) const
+    {
+        char buffer[32];
+        for (size_t i = 0; i < _parts.size(); ++i)
+        {
+            const Part& part = _parts[i];
+            switch (part.kind)
+            {
+                case Part::TEXT:
+                    out += part.text;
+                    break;
+                case Part::SEQ:
+                    snprintf(buffer, sizeof (buffer), "%ld", seq);
+                    out += buffer;
+                    break;
+                case Part::ID:
+                    out += id;
+                    break;
+                case Part::INT:
+                    snprintf(buffer, sizeof (buffer), "%ld", part.min + (long) (rand_r(&seed) % (part.max - part.min + 1)));
+                    out += buffer;
+                    break;
+                case Part::WORDS:
+                    for (long w = 0; w < part.min; ++w)
+                    {
+                        if (w > 0)
+                            out += ' ';
+                        out += s_words[rand_r(&seed) % WORD_COUNT];
+                    }
+                    break;
+                case Part::DATE:
+                {
+                    time_t now = time(NULL);
+                    struct tm tm;
+                    strftime(buffer, sizeof (buffer), "%Y-%m-%dT%H:%M:%S", localtime_r(&now, &tm));
+                    out += buffer;
+                    break;
+                }
+            }
+        }
+    }
+
+private:
+    struct Part
+    {
+        enum Kind { TEXT, SEQ, ID, INT, WORDS, DATE };
+
+        explicit Part(const std::string& literal) : kind(TEXT), text(literal), min(0), max(0) { }
+        Part(Kind k, long lo, long hi) : kind(k), text(), min(lo), max(hi) { }
+
+        Kind kind;
+        std::string text;
+        long min;
+        long max;
+    };
+
+    static Part placeholder(const std::string& name)
+    {
+        long lo = 0, hi = 0;
+        if ("seq" == name)
+            return Part(Part::SEQ, 0, 0);
+        if ("id" == name)
+            return Part(Part::ID, 0, 0);
+        if ("date" == name)
+            return Part(Part::DATE, 0, 0);
+        if ("word" == name)
+            return Part(Part::WORDS, 1, 0);
+        if (1 == sscanf(name.c_str(), "words:%ld", &lo))
+            return Part(Part::WORDS, lo, 0);
+        if (2 == sscanf(name.c_str(), "int:%ld:%ld", &lo, &hi) && hi >= lo)
+            return Part(Part::INT, lo, hi);
+
+        fprintf(stderr, "unknown placeholder {{%s}}, kept as text\n", name.c_str());
+        return Part("{{" + name + "}}");
+    }
+
+    std::vector<Part> _parts;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// load
+
+struct Shared
+{
+    const Config* config;
+    ElasticSearch* es;
+    const Template* doc;
+    const Template* query;
+    int weight_total;
+    uint64_t start_us;
+    uint64_t end_us;
+    volatile uint64_t next;    // open loop: index of the next scheduled request
+    volatile uint64_t seq;     // documents written
+    OpStats stats[OP_MAX];
+};
+
+struct Worker
+{
+    Shared* shared;
+    unsigned int seed;
+};
+
+static Operation pick(const Shared& shared, unsigned int& seed)
+{
+    int ticket = rand_r(&seed) % shared.weight_total;
+    for (int op = 0; op < OP_MAX; ++op)
+    {
+        ticket -= shared.config->weights[op];
+        if (ticket < 0)
+            return (Operation) op;
+    }
+    return OP_GET;
+}
+
+static std::string idOf(long n)
+{
+    char buffer[24];
+    snprintf(buffer, sizeof (buffer), "%ld", n);
+    return buffer;
+}
+
+/// Send one request of op, returns false on error; miss is set for a get of a missing document.
+static bool execute(Shared& shared, Operation op, unsigned int& seed, bool& miss)
+{
+    const Config& config = *shared.config;
+    ElasticSearch& es = *shared.es;
+    miss = false;
+
+    switch (op)
+    {
+        case OP_INDEX:
+        {
+            long seq = (long) __sync_fetch_and_add(&shared.seq, 1);
+            std::string id = idOf(seq % config.ids);
+            std::string text;
+            shared.doc->render(seq, id, seed, text);
+
+            Json::Value doc;
+            if (!Json::Reader().parse(text, doc))
+                return false;
+            return es.index(config.index, config.type, id, doc);
+        }
+        case OP_GET:
+        {
+            std::string id = idOf(rand_r(&seed) % config.ids);
+            Json::Value doc;
+            Status status = es.tryGetDocument(config.index.c_str(), config.type.c_str(), id.c_str(), doc);
+            miss = status.notFound();
+            return status.ok() || miss;
+        }
+        case OP_SEARCH:
+        {
+            std::string query;
+            shared.query->render(0, "", seed, query);
+            Json::Value result;
+            return es.trySearch(config.index, config.type, query, result).ok();
+        }
+        case OP_BULK:
+        {
+            std::string body;
+            for (int i = 0; i < config.bulk_size; ++i)
+            {
+                long seq = (long) __sync_fetch_and_add(&shared.seq, 1);
+                std::string id = idOf(seq % config.ids);
+                body += "{\"index\":{\"_index\":\"" + config.index + "\",\"_type\":\"" + config.type + "\",\"_id\":\"" + id + "\"}}\n";
+                shared.doc->render(seq, id, seed, body);
+                body += '\n';
+            }
+
+            std::vector<BulkItemError> errors;
+            return es.bulk(body.c_str(), errors);
+        }
+        default:
+            return false;
+    }
+}
+
+static void account(Shared& shared, Operation op, uint64_t intended, uint64_t started, bool ok, bool miss)
+{
+    uint64_t end = nowMicros();
+    OpStats& stats = shared.stats[op];
+    stats.latency.record(end - intended);
+    stats.service.record(end - started);
+
+    if (!ok)
+        __sync_fetch_and_add(&stats.errors, 1);
+    else if (miss)
+        __sync_fetch_and_add(&stats.misses, 1);
+    else
+        __sync_fetch_and_add(&stats.ok, 1);
+}
+
+static bool run(Shared& shared, Operation op, unsigned int& seed, uint64_t intended)
+{
+    uint64_t started = nowMicros();
+    bool ok = false, miss = false;
+    try
+    {
+        ok = execute(shared, op, seed, miss);
+    }
+    catch (Exception& e)
+    {
+        ok = false;
+    }
+
+    account(shared, op, intended, started, ok, miss);
+    return ok;
+}
+
+static void* closedLoop(void* arg)
+{
+    Worker* worker = (Worker*) arg;
+    Shared& shared = *worker->shared;
+
+    uint64_t now;
+    while ((now = nowMicros()) < shared.end_us)
+        run(shared, pick(shared, worker->seed), worker->seed, now);
+    return NULL;
+}
+
+static void* openLoop(void* arg)
+{
+    Worker* worker = (Worker*) arg;
+    Shared& shared = *worker->shared;
+    double interval = 1000000.0 / shared.config->rate;
+
+    for (;;)
+    {
+        // requests are due on a fixed schedule, a late thread takes the
+        // next due one and its wait is part of the latency
+        uint64_t n = __sync_fetch_and_add(&shared.next, 1);
+        uint64_t intended = shared.start_us + (uint64_t) (n * interval);
+        if (intended >= shared.end_us)
+            break;
+
+        // past the duration the backlog is dropped, and reported as unsent
+        uint64_t now = nowMicros();
+        if (now >= shared.end_us)
+            break;
+        if (intended > now)
+            usleep(intended - now);
+
+        run(shared, pick(shared, worker->seed), worker->seed, intended);
+    }
+    return NULL;
+}
+
+static void preload(Shared& shared)
+{
+    const Config& config = *shared.config;
+    unsigned int seed = 1;
+
+    for (long n = 0; n < config.ids; n += config.bulk_size)
+    {
+        std::string body;
+        for (long seq = n; seq < n + config.bulk_size && seq < config.ids; ++seq)
+        {
+            std::string id = idOf(seq);
+            body += "{\"index\":{\"_index\":\"" + config.index + "\",\"_type\":\"" + config.type + "\",\"_id\":\"" + id + "\"}}\n";
+            shared.doc->render(seq, id, seed, body);
+            body += '\n';
+        }
+
+        std::vector<BulkItemError> errors;
+        shared.es->bulk(body.c_str(), errors);
+    }
+
+    shared.es->refresh(config.index);
+    shared.seq = config.ids;
+}
+
+static void report(const Shared& shared, double seconds)
+{
+    const Config& config = *shared.config;
+    for (int op = 0; op < OP_MAX; ++op)
+    {
+        const OpStats& stats = shared.stats[op];
+        if (0 == stats.latency.count())
+            continue;
+
+        printf("op=%s mode=%s threads=%d ok=%llu misses=%llu errors=%llu ops_per_sec=%.1f"
+               " p50_us=%llu p90_us=%llu p99_us=%llu p999_us=%llu max_us=%llu",
+               s_op_names[op], config.open ? "open" : "closed", config.threads,
+               (unsigned long long) stats.ok, (unsigned long long) stats.misses, (unsigned long long) stats.errors,
+               stats.latency.count() / seconds,
+               (unsigned long long) stats.latency.percentile(50),
+               (unsigned long long) stats.latency.percentile(90),
+               (unsigned long long) stats.latency.percentile(99),
+               (unsigned long long) stats.latency.percentile(99.9),
+               (unsigned long long) stats.latency.max());
+        if (config.open)
+        {
+            printf(" service_p50_us=%llu service_p99_us=%llu",
+                   (unsigned long long) stats.service.percentile(50),
+                   (unsigned long long) stats.service.percentile(99));
+        }
+        printf("\n");
+    }
+
+    if (config.open)
+    {
+        uint64_t sent = 0;
+        for (int op = 0; op < OP_MAX; ++op)
+            sent += shared.stats[op].latency.count();
+
+        uint64_t scheduled = (uint64_t) (config.duration * config.rate);
+        printf("mode=open rate=%.1f scheduled=%llu sent=%llu unsent=%llu\n", config.rate,
+               (unsigned long long) scheduled, (unsigned long long) sent,
+               (unsigned long long) (scheduled > sent ? scheduled - sent : 0));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// options
+
+static bool readText(const char* arg, std::string& text)
+{
+    if ('@' != arg[0])
+    {
+        text = arg;
+        return true;
+    }
+
+    std::ifstream in(arg + 1);
+    if (!in)
+        return false;
+
+    std::ostringstream oss;
+    oss << in.rdbuf();
+    text = oss.str();
+    return true;
+}
+
+static bool parseMix(const char* spec, Config& config)
+{
+    memset(config.weights, 0, sizeof (config.weights));
+
+    std::istringstream iss(spec);
+    std::string item;
+    while (std::getline(iss, item, ','))
+    {
+        size_t colon = item.find(':');
+        std::string name = item.substr(0, colon);
+        int weight = std::string::npos == colon ? 1 : atoi(item.c_str() + colon + 1);
+
+        int op = 0;
+        while (op < OP_MAX && name != s_op_names[op])
+            ++op;
+        if (OP_MAX == op || weight < 0)
+            return false;
+        config.weights[op] = weight;
+    }
+    return true;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: esbench [--node URL | --mock] [--mode closed|open] [--threads N] [--rate R]\n"
+            "               [--duration S] [--mix index:1,get:8,search:1,bulk:0] [--index NAME]\n"
+            "               [--type NAME] [--ids N] [--preload] [--bulk-size N]\n"
+            "               [--template TEXT|@FILE] [--query TEXT|@FILE]\n");
+}
+
+static bool parseOptions(int argc, char* argv[], Config& config)
+{
+    static struct option options[] = {
+        { "node",      required_argument, NULL, 'n' },
+        { "mock",      no_argument,       NULL, 'M' },
+        { "mode",      required_argument, NULL, 'm' },
+        { "threads",   required_argument, NULL, 't' },
+        { "rate",      required_argument, NULL, 'r' },
+        { "duration",  required_argument, NULL, 'd' },
+        { "mix",       required_argument, NULL, 'x' },
+        { "index",     required_argument, NULL, 'i' },
+        { "type",      required_argument, NULL, 'y' },
+        { "ids",       required_argument, NULL, 'k' },
+        { "preload",   no_argument,       NULL, 'p' },
+        { "bulk-size", required_argument, NULL, 'b' },
+        { "template",  required_argument, NULL, 'T' },
+        { "query",     required_argument, NULL, 'q' },
+        { "help",      no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int c;
+    while (-1 != (c = getopt_long(argc, argv, "", options, NULL)))
+    {
+        switch (c)
+        {
+            case 'n': config.node = optarg; break;
+            case 'M': config.mock = true; break;
+            case 'm':
+                if (0 != strcmp(optarg, "open") && 0 != strcmp(optarg, "closed"))
+                    return false;
+                config.open = 0 == strcmp(optarg, "open");
+                break;
+            case 't': config.threads = atoi(optarg); break;
+            case 'r': config.rate = atof(optarg); break;
+            case 'd': config.duration = atof(optarg); break;
+            case 'x':
+                if (!parseMix(optarg, config))
+                    return false;
+                break;
+            case 'i': config.index = optarg; break;
+            case 'y': config.type = optarg; break;
+            case 'k': config.ids = atol(optarg); break;
+            case 'p': config.preload = true; break;
+            case 'b': config.bulk_size = atoi(optarg); break;
+            case 'T':
+                if (!readText(optarg, config.doc_template))
+                    return false;
+                break;
+            case 'q':
+                if (!readText(optarg, config.query_template))
+                    return false;
+                break;
+            default:
+                return false;
+        }
+    }
+
+    return optind == argc && config.threads > 0 && config.rate > 0 && config.duration > 0
+        && config.ids > 0 && config.bulk_size > 0;
+}
+
+int main(int argc, char* argv[])
+{
+    Config config;
+    if (!parseOptions(argc, argv, config))
+    {
+        usage();
+        return 2;
+    }
+
+    Shared shared;
+    shared.config = &config;
+    shared.weight_total = 0;
+    for (int op = 0; op < OP_MAX; ++op)
+        shared.weight_total += config.weights[op];
+    if (0 == shared.weight_total)
+    {
+        usage();
+        return 2;
+    }
+
+    mock::MockServer server;
+    if (config.mock)
+    {
+        if (!server.start())
+        {
+            fprintf(stderr, "cannot start mock server\n");
+            return 1;
+        }
+        config.node = server.url();
+    }
+
+    try
+    {
+        ElasticSearch es(config.node);
+        Template doc(config.doc_template);
+        Template query(config.query_template);
+
+        shared.es = &es;
+        shared.doc = &doc;
+        shared.query = &query;
+        shared.next = 0;
+        shared.seq = 0;
+
+        if (config.preload)
+            preload(shared);
+
+        std::vector<pthread_t> tids(config.threads);
+        std::vector<Worker> workers(config.threads);
+        shared.start_us = nowMicros();
+        shared.end_us = shared.start_us + (uint64_t) (config.duration * 1000000.0);
+
+        for (int i = 0; i < config.threads; ++i)
+        {
+            workers[i].shared = &shared;
+            workers[i].seed = (unsigned int) (shared.start_us + i * 7919);
+            pthread_create(&tids[i], NULL, config.open ? openLoop : closedLoop, &workers[i]);
+        }
+
+        for (int i = 0; i < config.threads; ++i)
+            pthread_join(tids[i], NULL);
+
+        report(shared, (nowMicros() - shared.start_us) / 1000000.0);
+    }
+    catch (Exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}